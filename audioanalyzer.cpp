@@ -0,0 +1,491 @@
+// SPDX-FileCopyrightText: 2023-2026 Minei3oat
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "audioanalyzer.h"
+#include "cache.h"
+#include "logger.h"
+#include "sceneanalyzer.h"
+#include "statistics.h"
+#include "tracing.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+typedef struct audio_cache_header {
+    char magic[4];
+    uint32_t version;
+    int32_t stream_index;
+    int32_t window;
+    int64_t start_time;
+    uint64_t count;
+} audio_cache_header_t;
+
+/**
+ * Add up the squares and find the highest absolute value of float samples
+ * @param samples The samples, full scale is 1.0
+ * @param count The number of samples
+ * @param sum The squares are added to it
+ * @param peak Raised to the highest absolute value
+ */
+static void measure_samples(const float* samples, int count, double* sum, float* peak)
+{
+    float local_sum = 0;
+    float local_peak = *peak;
+    int i = 0;
+#ifdef __SSE2__
+    __m128 sums = _mm_setzero_ps();
+    __m128 peaks = _mm_set1_ps(local_peak);
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    for (; i + 4 <= count; i += 4) {
+        __m128 values = _mm_loadu_ps(samples + i);
+        sums = _mm_add_ps(sums, _mm_mul_ps(values, values));
+        peaks = _mm_max_ps(peaks, _mm_and_ps(values, abs_mask));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, sums);
+    local_sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    _mm_storeu_ps(lanes, peaks);
+    local_peak = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#endif
+    for (; i < count; i++) {
+        local_sum += samples[i] * samples[i];
+        local_peak = std::max(local_peak, std::fabs(samples[i]));
+    }
+    *sum += local_sum;
+    *peak = local_peak;
+}
+
+/**
+ * Convert samples to float
+ * @param data The samples of a plane or the interleaved samples
+ * @param format The sample format
+ * @param offset The index of the first sample to convert
+ * @param count The number of samples to convert
+ * @param buffer Holds the converted samples if a conversion is needed
+ * @return The float samples or NULL if the format is not supported
+ */
+static const float* convert_samples(const uint8_t* data, AVSampleFormat format, int offset, int count, std::vector<float>& buffer)
+{
+    format = av_get_packed_sample_fmt(format);
+    if (format == AV_SAMPLE_FMT_FLT) {
+        return (const float*) data + offset;
+    }
+
+    buffer.resize(count);
+    switch (format) {
+        case AV_SAMPLE_FMT_U8:
+            for (int i = 0; i < count; i++) {
+                buffer[i] = (data[offset + i] - 128) * (1.0f / 128);
+            }
+            break;
+        case AV_SAMPLE_FMT_S16:
+            for (int i = 0; i < count; i++) {
+                buffer[i] = ((const int16_t*) data)[offset + i] * (1.0f / 32768);
+            }
+            break;
+        case AV_SAMPLE_FMT_S32:
+            for (int i = 0; i < count; i++) {
+                buffer[i] = ((const int32_t*) data)[offset + i] * (1.0f / 2147483648.0f);
+            }
+            break;
+        case AV_SAMPLE_FMT_DBL:
+            for (int i = 0; i < count; i++) {
+                buffer[i] = ((const double*) data)[offset + i];
+            }
+            break;
+        default:
+            return NULL;
+    }
+    return buffer.data();
+}
+
+/**
+ * Convert a power ratio to dBFS
+ * @param power The mean square or squared peak relative to full scale
+ * @return The level, at least SILENCE_LEVEL
+ */
+static float to_decibel(double power)
+{
+    return power > 0 ? std::max<float>(10 * log10(power), SILENCE_LEVEL) : SILENCE_LEVEL;
+}
+
+AudioAnalyzer::AudioAnalyzer(const MediaFile* source)
+{
+    for (int i = 0; i < source->get_stream_count(); i++) {
+        if (source->is_audio_stream(i)) {
+            stream_index = i;
+            break;
+        }
+    }
+    cache_path = Cache::get_path(source->get_filename(), AUDIO_CACHE_SUFFIX);
+
+    // a clone is only needed if there is something to analyze
+    if (stream_index >= 0 && !load_cache()) {
+        media_file = new MediaFile(*source);
+    }
+}
+
+AudioAnalyzer::~AudioAnalyzer()
+{
+    stop();
+    delete media_file;
+}
+
+/**
+ * Start the analysis thread, unless the results were cached
+ */
+void AudioAnalyzer::start()
+{
+    if (media_file == NULL) {
+        progress = 100;
+        finished = true;
+        return;
+    }
+    worker = std::thread(&AudioAnalyzer::run, this);
+}
+
+/**
+ * Cancel the analysis and wait for the thread, the windows measured so far are kept
+ */
+void AudioAnalyzer::stop()
+{
+    stop_analysis_wait(stopping);
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+/**
+ * Wait for a free slot, analyze the audio with a low priority and cache the results
+ */
+void AudioAnalyzer::run()
+{
+    if (!acquire_analysis_slot(stopping)) {
+        finished = true;
+        return;
+    }
+
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), ANALYSIS_NICENESS);
+    if (analyze() && !stopping) {
+        progress = 100;
+        save_cache();
+    }
+
+    release_analysis_slot();
+    finished = true;
+}
+
+/**
+ * Read the whole file once and measure every window of the audio stream
+ * @return False if the stream can not be decoded
+ */
+bool AudioAnalyzer::analyze()
+{
+    AVCodecContext* decode_context = media_file->open_decoder(stream_index, 1);
+    if (decode_context == NULL) {
+        log_warning(LOG_CATEGORY_ANALYSIS, "no decoder for the audio of %s", media_file->get_filename().c_str());
+        return false;
+    }
+
+    // the progress is measured by the offset of the last video frame
+    const packet_info_t* last_frame = media_file->get_frame_info(media_file->get_frame_count() - 1);
+    int64_t end_offset = last_frame != NULL && last_frame->offset > 0 ? last_frame->offset : 1;
+    AVRational time_base = media_file->get_stream(stream_index)->time_base;
+
+    static Counter& analyzed_frames = Statistics::counter("analysis.audio_frames");
+    bool read = media_file->decode_stream(decode_context, stream_index, 0, INT64_MIN, INT64_MAX, false, stopping, [&](const AVFrame* frame, int64_t position) {
+        progress = std::min<int64_t>(position * 100 / end_offset, 99);
+        TraceSpan span("analyze");
+        add_frame(frame, time_base);
+        analyzed_frames.add();
+        return true;
+    });
+    if (read) {
+        finish_window();
+    }
+
+    avcodec_free_context(&decode_context);
+    return read;
+}
+
+/**
+ * Measure a decoded frame. Gaps in the timestamps are filled with silent windows
+ * @param frame The decoded audio frame
+ * @param time_base The time base of the stream
+ */
+void AudioAnalyzer::add_frame(const AVFrame* frame, AVRational time_base)
+{
+    if (frame->sample_rate <= 0 || frame->nb_samples <= 0) {
+        return;
+    }
+    int window_size = std::max(frame->sample_rate * AUDIO_WINDOW / 1000, 1);
+
+    if (frame->pts != AV_NOPTS_VALUE) {
+        int64_t position = av_rescale_q(frame->pts, time_base, AVRational { 1, frame->sample_rate });
+        if (first_position == AV_NOPTS_VALUE) {
+            first_position = position;
+            std::lock_guard<std::mutex> lock(mutex);
+            start_time = av_rescale_q(frame->pts, time_base, AV_TIME_BASE_Q);
+        } else if (position - first_position > next_position + window_size) {
+            // no audio for at least a window, e.g. at a splice point
+            finish_window();
+            std::lock_guard<std::mutex> lock(mutex);
+            while ((int64_t) (windows.size() + 1) * window_size <= position - first_position) {
+                windows.push_back({ SILENCE_LEVEL, SILENCE_LEVEL });
+            }
+            next_position = (int64_t) windows.size() * window_size;
+        }
+    }
+
+    // split the frame at the window boundaries
+    int offset = 0;
+    while (offset < frame->nb_samples) {
+        int count = std::min(frame->nb_samples - offset, window_size - window_fill);
+        add_samples(frame, offset, count);
+        offset += count;
+        window_fill += count;
+        next_position += count;
+        if (window_fill >= window_size) {
+            finish_window();
+        }
+    }
+}
+
+/**
+ * Measure samples of all channels of a frame for the current window
+ * @param frame The decoded audio frame
+ * @param offset The first sample per channel
+ * @param count The number of samples per channel
+ */
+void AudioAnalyzer::add_samples(const AVFrame* frame, int offset, int count)
+{
+    AVSampleFormat format = (AVSampleFormat) frame->format;
+    int channels = frame->ch_layout.nb_channels;
+    std::vector<float> buffer;
+    if (av_sample_fmt_is_planar(format)) {
+        for (int channel = 0; channel < channels; channel++) {
+            const float* samples = convert_samples(frame->extended_data[channel], format, offset, count, buffer);
+            if (samples != NULL) {
+                measure_samples(samples, count, &window_sum, &window_peak);
+            }
+        }
+    } else {
+        const float* samples = convert_samples(frame->extended_data[0], format, offset * channels, count * channels, buffer);
+        if (samples != NULL) {
+            measure_samples(samples, count * channels, &window_sum, &window_peak);
+        }
+    }
+    window_samples += (int64_t) count * channels;
+}
+
+/**
+ * Store the current window, if it has samples
+ */
+void AudioAnalyzer::finish_window()
+{
+    if (window_fill == 0) {
+        return;
+    }
+
+    audio_window_t window;
+    window.rms = window_samples > 0 ? to_decibel(window_sum / window_samples) : SILENCE_LEVEL;
+    window.peak = to_decibel((double) window_peak * window_peak);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        windows.push_back(window);
+    }
+    window_sum = 0;
+    window_peak = 0;
+    window_samples = 0;
+    window_fill = 0;
+}
+
+/**
+ * Load the cached results of a previous analysis
+ * @return True if the cache matches the file and was loaded completely
+ */
+bool AudioAnalyzer::load_cache()
+{
+    if (cache_path.empty()) {
+        return false;
+    }
+    FILE* file = fopen(cache_path.c_str(), "rb");
+    if (file == NULL) {
+        return false;
+    }
+
+    audio_cache_header_t header;
+    bool loaded = false;
+    if (fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, "MCLD", 4) == 0 && header.version == AUDIO_CACHE_VERSION &&
+        header.stream_index == stream_index && header.window == AUDIO_WINDOW) {
+        std::vector<audio_window_t> cached(header.count);
+        if (fread(cached.data(), sizeof(audio_window_t), cached.size(), file) == cached.size()) {
+            std::lock_guard<std::mutex> lock(mutex);
+            windows.swap(cached);
+            start_time = header.start_time;
+            loaded = true;
+        }
+    }
+    fclose(file);
+    return loaded;
+}
+
+/**
+ * Write the results to the cache
+ */
+void AudioAnalyzer::save_cache() const
+{
+    if (cache_path.empty()) {
+        return;
+    }
+    std::string temporary_path = cache_path + ".tmp";
+    FILE* file = fopen(temporary_path.c_str(), "wb");
+    if (file == NULL) {
+        log_warning(LOG_CATEGORY_ANALYSIS, "failed to write %s", temporary_path.c_str());
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    audio_cache_header_t header = { { 'M', 'C', 'L', 'D' }, AUDIO_CACHE_VERSION, stream_index, AUDIO_WINDOW, start_time, windows.size() };
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(windows.data(), sizeof(audio_window_t), windows.size(), file) == windows.size();
+    written = fclose(file) == 0 && written;
+    if (!written || !Cache::replace(temporary_path, cache_path)) {
+        remove(temporary_path.c_str());
+        log_warning(LOG_CATEGORY_ANALYSIS, "failed to write %s", cache_path.c_str());
+    }
+}
+
+/**
+ * Get the window a frame is shown in, the mutex must be held
+ * @param media_file The media file to resolve the index with
+ * @param frame_index The index of the frame
+ * @return The index of the window, it may be outside of the measured windows
+ */
+int64_t AudioAnalyzer::get_window(const MediaFile* media_file, ssize_t frame_index) const
+{
+    const packet_info_t* info = media_file->get_frame_info(frame_index);
+    if (info == NULL || start_time == AV_NOPTS_VALUE) {
+        return -1;
+    }
+    int64_t time = av_rescale_q(info->pts, media_file->get_video_stream()->time_base, AV_TIME_BASE_Q) - start_time;
+    int64_t window_length = AUDIO_WINDOW * 1000;
+    return time >= 0 ? time / window_length : (time - window_length + 1) / window_length;
+}
+
+/**
+ * Get the first frame shown during a window, the mutex must be held
+ * @param media_file The media file to resolve the index with
+ * @param window The index of the window
+ * @return The index of the frame or -1 if the window is after the last frame
+ */
+ssize_t AudioAnalyzer::get_frame(const MediaFile* media_file, int64_t window) const
+{
+    int64_t time = start_time + window * AUDIO_WINDOW * 1000;
+    return media_file->find_frame(av_rescale_q(time, AV_TIME_BASE_Q, media_file->get_video_stream()->time_base));
+}
+
+/**
+ * Check if a silence long enough starts with a window, the mutex must be held
+ * @param window The index of the window
+ * @return True if the window is the first of a silence
+ */
+bool AudioAnalyzer::is_silence_start(size_t window) const
+{
+    if (windows[window].rms >= SILENCE_THRESHOLD || (window > 0 && windows[window - 1].rms < SILENCE_THRESHOLD)) {
+        return false;
+    }
+
+    // a silence reaching the windows still to be measured may become long enough
+    size_t min_windows = (SILENCE_MIN_DURATION + AUDIO_WINDOW - 1) / AUDIO_WINDOW;
+    for (size_t i = window; i < window + min_windows; i++) {
+        if (i >= windows.size()) {
+            return !finished;
+        }
+        if (windows[i].rms >= SILENCE_THRESHOLD) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Find the next silence after a frame
+ * @param media_file The media file to resolve the index with
+ * @param frame_index The index to search from
+ * @return The first frame shown during the silence or -1 if there is none
+ */
+ssize_t AudioAnalyzer::find_next_silence(const MediaFile* media_file, ssize_t frame_index) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    int64_t window = get_window(media_file, frame_index);
+    for (size_t i = std::max<int64_t>(window + 1, 0); i < windows.size(); i++) {
+        if (is_silence_start(i)) {
+            ssize_t found = get_frame(media_file, i);
+            if (found > frame_index) {
+                return found;
+            }
+        }
+    }
+    return -1;
+}
+
+/**
+ * Find the previous silence before a frame
+ * @param media_file The media file to resolve the index with
+ * @param frame_index The index to search from
+ * @return The first frame shown during the silence or -1 if there is none
+ */
+ssize_t AudioAnalyzer::find_previous_silence(const MediaFile* media_file, ssize_t frame_index) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    int64_t window = std::min<int64_t>(get_window(media_file, frame_index), windows.size());
+    for (int64_t i = window - 1; i >= 0; i--) {
+        if (is_silence_start(i)) {
+            ssize_t found = get_frame(media_file, i);
+            if (found >= 0 && found < frame_index) {
+                return found;
+            }
+        }
+    }
+    return -1;
+}
+
+/**
+ * Get the loudness over the whole video for drawing an overview
+ * @param media_file The media file to resolve the index with
+ * @param columns The number of values
+ * @return The highest RMS level in dBFS of the windows of each column, NAN if none is measured yet
+ */
+std::vector<float> AudioAnalyzer::get_levels(const MediaFile* media_file, int columns) const
+{
+    std::vector<float> levels(std::max(columns, 0), NAN);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (windows.empty() || columns <= 0) {
+        return levels;
+    }
+
+    int64_t first = get_window(media_file, 0);
+    int64_t last = get_window(media_file, media_file->get_frame_count() - 1);
+    int64_t span = std::max<int64_t>(last - first + 1, 1);
+    for (int column = 0; column < columns; column++) {
+        int64_t start = first + span * column / columns;
+        int64_t end = std::max(first + span * (column + 1) / columns, start + 1);
+        for (int64_t i = std::max<int64_t>(start, 0); i < end && i < (int64_t) windows.size(); i++) {
+            if (std::isnan(levels[column]) || windows[i].rms > levels[column]) {
+                levels[column] = windows[i].rms;
+            }
+        }
+    }
+    return levels;
+}
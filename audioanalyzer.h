@@ -0,0 +1,92 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2026 Minei3oat
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef AUDIOANALYZER_H
+#define AUDIOANALYZER_H
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mediafile.h"
+
+// length of an analysis window in milliseconds
+#define AUDIO_WINDOW 50
+// windows with a lower RMS level in dBFS are silent
+#define SILENCE_THRESHOLD -50
+// minimum length of a silence in milliseconds
+#define SILENCE_MIN_DURATION 300
+// level in dBFS of windows without any signal
+#define SILENCE_LEVEL -100
+// suffix of the cache files
+#define AUDIO_CACHE_SUFFIX ".loudness"
+#define AUDIO_CACHE_VERSION 1
+
+typedef struct audio_window {
+    float rms;      // level of all channels in dBFS
+    float peak;     // highest sample of all channels in dBFS
+} audio_window_t;
+
+/**
+ * Measures the loudness of the first audio stream of a media file in the background, window by window.
+ * The audio is read through a clone of the media file, the results are cached per file, so it is only analyzed once.
+ */
+class AudioAnalyzer
+{
+public:
+    AudioAnalyzer(const MediaFile* source);
+    ~AudioAnalyzer();
+
+    void start();
+    void stop();
+
+    bool is_finished() const { return finished; }
+    int get_progress() const { return progress; }
+    int get_stream_index() const { return stream_index; }
+
+    ssize_t find_next_silence(const MediaFile* media_file, ssize_t frame_index) const;
+    ssize_t find_previous_silence(const MediaFile* media_file, ssize_t frame_index) const;
+    std::vector<float> get_levels(const MediaFile* media_file, int columns) const;
+
+private:
+    void run();
+    bool analyze();
+    void add_frame(const AVFrame* frame, AVRational time_base);
+    void add_samples(const AVFrame* frame, int offset, int count);
+    void finish_window();
+    bool load_cache();
+    void save_cache() const;
+
+    int64_t get_window(const MediaFile* media_file, ssize_t frame_index) const;
+    ssize_t get_frame(const MediaFile* media_file, int64_t window) const;
+    bool is_silence_start(size_t window) const;
+
+    MediaFile* media_file = NULL;
+    int stream_index = -1;
+    std::string cache_path;
+
+    // windows measured so far, the first one starts at start_time in microseconds
+    std::vector<audio_window_t> windows;
+    int64_t start_time = AV_NOPTS_VALUE;
+    mutable std::mutex mutex;
+
+    // window being measured
+    int64_t first_position = AV_NOPTS_VALUE;
+    int64_t next_position = 0;
+    double window_sum = 0;
+    float window_peak = 0;
+    int64_t window_samples = 0;
+    int window_fill = 0;
+
+    std::thread worker;
+    std::atomic<bool> stopping { false };
+    std::atomic<bool> finished { false };
+    std::atomic<int> progress { 0 };
+};
+
+#endif // AUDIOANALYZER_H
@@ -0,0 +1,507 @@
+// SPDX-FileCopyrightText: 2023-2026 Minei3oat
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Benchmark of opening, seeking, querying and exporting synthetic media files.
+// The sources are generated with the libav encoders, so no external media is needed.
+// The results are written as JSON, the log of MCut goes to stderr.
+
+#include "exporter.h"
+#include "mediafile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+extern "C" {
+    #include <libavutil/channel_layout.h>
+    #include <libavutil/opt.h>
+}
+
+// properties of the generated sources
+#define BENCH_WIDTH 640
+#define BENCH_HEIGHT 360
+#define BENCH_FRAME_RATE 25
+#define BENCH_SAMPLE_RATE 48000
+#define BENCH_DEFAULT_DURATION 60
+// seed of all random choices, so runs are comparable
+#define BENCH_SEED 42
+#define BENCH_RANDOM_FRAMES 50
+#define BENCH_SEQUENTIAL_FRAMES 200
+#define BENCH_QUERIES 100000
+
+typedef struct bench_source {
+    const char* name;
+    const char* extension;
+    AVCodecID video_codec;
+    int gop_size;
+    int max_b_frames;
+    int audio_tracks;
+} bench_source_t;
+
+static const bench_source_t sources[] = {
+    { "ts-mpeg2-gop12-b2-a2", "ts", AV_CODEC_ID_MPEG2VIDEO, 12, 2, 2 },
+    { "ts-h264-gop50-b3-a2", "ts", AV_CODEC_ID_H264, 50, 3, 2 },
+    { "mkv-h264-gop250-b0-a1", "mkv", AV_CODEC_ID_H264, 250, 0, 1 },
+    { "mkv-mpeg2-gop25-b0-a3", "mkv", AV_CODEC_ID_MPEG2VIDEO, 25, 0, 3 },
+};
+
+typedef std::chrono::steady_clock bench_clock;
+
+/**
+ * Get the milliseconds since a point in time
+ * @param start The point in time
+ * @return The elapsed milliseconds
+ */
+static double elapsed_ms(bench_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+/**
+ * Get a percentile of measured values
+ * @param values The values, they are sorted
+ * @param percentile The percentile between 0 and 100
+ * @return The value at the percentile or 0 if there are no values
+ */
+static double percentile(std::vector<double>& values, int percentile)
+{
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[(values.size() - 1) * percentile / 100];
+}
+
+/**
+ * Encode a frame and write all packets the encoder returns
+ * @param output_context The muxer to write to
+ * @param encode_context The encoder
+ * @param stream The stream of the packets
+ * @param frame The frame to encode or NULL to flush the encoder
+ * @return True on success
+ */
+static bool encode_frame(AVFormatContext* output_context, AVCodecContext* encode_context, AVStream* stream, AVFrame* frame)
+{
+    if (avcodec_send_frame(encode_context, frame) < 0) {
+        return false;
+    }
+    AVPacket* packet = av_packet_alloc();
+    while (avcodec_receive_packet(encode_context, packet) == 0) {
+        av_packet_rescale_ts(packet, encode_context->time_base, stream->time_base);
+        packet->stream_index = stream->index;
+        av_interleaved_write_frame(output_context, packet);
+    }
+    av_packet_free(&packet);
+    return true;
+}
+
+/**
+ * Generate a source with a moving pattern and sine tones
+ * @param filename The file to write
+ * @param source The properties of the source
+ * @param duration The duration in seconds
+ * @return True on success, false if an encoder is not available
+ */
+static bool generate_source(const std::string& filename, const bench_source_t& source, int duration)
+{
+    AVFormatContext* output_context = NULL;
+    avformat_alloc_output_context2(&output_context, NULL, NULL, filename.c_str());
+    if (output_context == NULL) {
+        return false;
+    }
+
+    // video encoder
+    const AVCodec* video_encoder = avcodec_find_encoder(source.video_codec);
+    if (video_encoder == NULL) {
+        avformat_free_context(output_context);
+        return false;
+    }
+    AVCodecContext* video_context = avcodec_alloc_context3(video_encoder);
+    video_context->width = BENCH_WIDTH;
+    video_context->height = BENCH_HEIGHT;
+    video_context->pix_fmt = AV_PIX_FMT_YUV420P;
+    video_context->time_base = AVRational { 1, BENCH_FRAME_RATE };
+    video_context->framerate = AVRational { BENCH_FRAME_RATE, 1 };
+    video_context->gop_size = source.gop_size;
+    video_context->keyint_min = source.gop_size;
+    video_context->max_b_frames = source.max_b_frames;
+    video_context->bit_rate = 2000000;
+    av_opt_set(video_context->priv_data, "preset", "ultrafast", 0);
+    if (source.max_b_frames == 0) {
+        av_opt_set(video_context->priv_data, "tune", "zerolatency", 0);
+    }
+    if (output_context->oformat->flags & AVFMT_GLOBALHEADER) {
+        video_context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+    if (avcodec_open2(video_context, video_encoder, NULL) < 0) {
+        avcodec_free_context(&video_context);
+        avformat_free_context(output_context);
+        return false;
+    }
+    AVStream* video_stream = avformat_new_stream(output_context, NULL);
+    avcodec_parameters_from_context(video_stream->codecpar, video_context);
+    video_stream->time_base = video_context->time_base;
+    video_stream->avg_frame_rate = video_context->framerate;
+
+    // audio encoders
+    const AVCodec* audio_encoder = avcodec_find_encoder(AV_CODEC_ID_MP2);
+    std::vector<AVCodecContext*> audio_contexts;
+    std::vector<AVStream*> audio_streams;
+    for (int i = 0; i < source.audio_tracks && audio_encoder != NULL; i++) {
+        AVCodecContext* audio_context = avcodec_alloc_context3(audio_encoder);
+        audio_context->sample_fmt = AV_SAMPLE_FMT_S16;
+        audio_context->sample_rate = BENCH_SAMPLE_RATE;
+        av_channel_layout_default(&audio_context->ch_layout, 2);
+        audio_context->bit_rate = 192000;
+        audio_context->time_base = AVRational { 1, BENCH_SAMPLE_RATE };
+        if (output_context->oformat->flags & AVFMT_GLOBALHEADER) {
+            audio_context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        }
+        if (avcodec_open2(audio_context, audio_encoder, NULL) < 0) {
+            avcodec_free_context(&audio_context);
+            break;
+        }
+        AVStream* audio_stream = avformat_new_stream(output_context, NULL);
+        avcodec_parameters_from_context(audio_stream->codecpar, audio_context);
+        audio_stream->time_base = audio_context->time_base;
+        audio_contexts.push_back(audio_context);
+        audio_streams.push_back(audio_stream);
+    }
+
+    // write
+    bool success = avio_open(&output_context->pb, filename.c_str(), AVIO_FLAG_WRITE) >= 0 && avformat_write_header(output_context, NULL) >= 0;
+    AVFrame* video_frame = av_frame_alloc();
+    video_frame->format = video_context->pix_fmt;
+    video_frame->width = video_context->width;
+    video_frame->height = video_context->height;
+    av_frame_get_buffer(video_frame, 0);
+    AVFrame* audio_frame = av_frame_alloc();
+    if (!audio_contexts.empty()) {
+        audio_frame->format = audio_contexts[0]->sample_fmt;
+        audio_frame->sample_rate = BENCH_SAMPLE_RATE;
+        audio_frame->nb_samples = audio_contexts[0]->frame_size;
+        av_channel_layout_copy(&audio_frame->ch_layout, &audio_contexts[0]->ch_layout);
+        av_frame_get_buffer(audio_frame, 0);
+    }
+    int64_t frame_count = (int64_t) duration * BENCH_FRAME_RATE;
+    int64_t sample_position = 0;
+    for (int64_t i = 0; i < frame_count && success; i++) {
+        // moving gradient, so the encoder has to code motion
+        av_frame_make_writable(video_frame);
+        for (int y = 0; y < video_frame->height; y++) {
+            for (int x = 0; x < video_frame->width; x++) {
+                video_frame->data[0][y * video_frame->linesize[0] + x] = x + y + i * 3;
+            }
+        }
+        for (int y = 0; y < video_frame->height / 2; y++) {
+            for (int x = 0; x < video_frame->width / 2; x++) {
+                video_frame->data[1][y * video_frame->linesize[1] + x] = 128 + y + i * 2;
+                video_frame->data[2][y * video_frame->linesize[2] + x] = 64 + x + i * 5;
+            }
+        }
+        video_frame->pts = i;
+        success = encode_frame(output_context, video_context, video_stream, video_frame);
+
+        // audio up to the end of the video frame, a different tone per track
+        int64_t sample_end = (i + 1) * BENCH_SAMPLE_RATE / BENCH_FRAME_RATE;
+        while (!audio_contexts.empty() && sample_position < sample_end && success) {
+            for (size_t track = 0; track < audio_contexts.size() && success; track++) {
+                av_frame_make_writable(audio_frame);
+                int16_t* samples = (int16_t*) audio_frame->data[0];
+                for (int j = 0; j < audio_frame->nb_samples; j++) {
+                    int16_t value = 8000 * sin(2 * M_PI * 440 * (track + 1) * (sample_position + j) / BENCH_SAMPLE_RATE);
+                    samples[2 * j] = value;
+                    samples[2 * j + 1] = value;
+                }
+                audio_frame->pts = sample_position;
+                success = encode_frame(output_context, audio_contexts[track], audio_streams[track], audio_frame);
+            }
+            sample_position += audio_frame->nb_samples;
+        }
+    }
+
+    // flush and cleanup
+    if (success) {
+        encode_frame(output_context, video_context, video_stream, NULL);
+        for (size_t track = 0; track < audio_contexts.size(); track++) {
+            encode_frame(output_context, audio_contexts[track], audio_streams[track], NULL);
+        }
+        success = av_write_trailer(output_context) >= 0;
+    }
+    av_frame_free(&video_frame);
+    av_frame_free(&audio_frame);
+    avcodec_free_context(&video_context);
+    for (AVCodecContext* audio_context : audio_contexts) {
+        avcodec_free_context(&audio_context);
+    }
+    avio_closep(&output_context->pb);
+    avformat_free_context(output_context);
+    return success;
+}
+
+/**
+ * Measure the latency of decoding frames in random and sequential order
+ * @param results The JSON output
+ * @param media_file The media file to decode
+ */
+static void bench_get_frame(FILE* results, MediaFile* media_file)
+{
+    std::mt19937 random(BENCH_SEED);
+    std::uniform_int_distribution<ssize_t> distribution(0, media_file->get_frame_count() - 1);
+    std::vector<double> latencies;
+    for (int i = 0; i < BENCH_RANDOM_FRAMES; i++) {
+        ssize_t frame_index = distribution(random);
+        bench_clock::time_point start = bench_clock::now();
+        AVFrame* frame = media_file->get_frame(frame_index);
+        latencies.push_back(elapsed_ms(start));
+        av_frame_free(&frame);
+    }
+    double random_p50 = percentile(latencies, 50);
+    double random_p95 = percentile(latencies, 95);
+
+    latencies.clear();
+    ssize_t sequential_frames = std::min((ssize_t) BENCH_SEQUENTIAL_FRAMES, media_file->get_frame_count());
+    for (ssize_t i = 0; i < sequential_frames; i++) {
+        bench_clock::time_point start = bench_clock::now();
+        AVFrame* frame = media_file->get_frame(i);
+        latencies.push_back(elapsed_ms(start));
+        av_frame_free(&frame);
+    }
+    double sequential_p50 = percentile(latencies, 50);
+    double sequential_p95 = percentile(latencies, 95);
+
+    fprintf(results, "      \"get_frame_random_ms\": { \"p50\": %.3f, \"p95\": %.3f },\n", random_p50, random_p95);
+    fprintf(results, "      \"get_frame_sequential_ms\": { \"p50\": %.3f, \"p95\": %.3f },\n", sequential_p50, sequential_p95);
+}
+
+/**
+ * Measure the cost of the index queries
+ * @param results The JSON output
+ * @param media_file The media file to query
+ */
+static void bench_queries(FILE* results, MediaFile* media_file)
+{
+    std::mt19937 random(BENCH_SEED);
+    std::uniform_int_distribution<ssize_t> distribution(0, media_file->get_frame_count() - 1);
+    std::vector<ssize_t> frame_indices(BENCH_QUERIES);
+    for (ssize_t& frame_index : frame_indices) {
+        frame_index = distribution(random);
+    }
+    int audio_stream = -1;
+    for (int i = 0; i < media_file->get_stream_count(); i++) {
+        if (media_file->is_audio_stream(i)) {
+            audio_stream = i;
+            break;
+        }
+    }
+
+    // sum the results, so the calls are not optimized away
+    volatile ssize_t sink = 0;
+    bench_clock::time_point start = bench_clock::now();
+    for (ssize_t frame_index : frame_indices) {
+        sink += media_file->find_iframe_before(frame_index) + media_file->find_iframe_after(frame_index);
+    }
+    double find_iframe_ns = elapsed_ms(start) * 1e6 / (2 * BENCH_QUERIES);
+
+    start = bench_clock::now();
+    for (ssize_t frame_index : frame_indices) {
+        sink += media_file->find_pframe_before(frame_index) + media_file->find_pframe_after(frame_index);
+    }
+    double find_pframe_ns = elapsed_ms(start) * 1e6 / (2 * BENCH_QUERIES);
+
+    double packet_info_ns = 0;
+    if (audio_stream != -1) {
+        start = bench_clock::now();
+        for (ssize_t frame_index : frame_indices) {
+            const packet_info_t* info = media_file->get_packet_info(audio_stream, media_file->get_frame_info(frame_index)->pts);
+            sink += info != NULL;
+        }
+        packet_info_ns = elapsed_ms(start) * 1e6 / BENCH_QUERIES;
+    }
+
+    fprintf(results, "      \"find_iframe_ns\": %.1f,\n", find_iframe_ns);
+    fprintf(results, "      \"find_pframe_ns\": %.1f,\n", find_pframe_ns);
+    fprintf(results, "      \"get_packet_info_ns\": %.1f,\n", packet_info_ns);
+}
+
+/**
+ * Measure the export throughput of a cut list
+ * @param results The JSON output
+ * @param name The name of the cut list
+ * @param cuts The cuts to export
+ * @param filename The file to export to
+ * @param last True if this is the last result of the source
+ */
+static void bench_export(FILE* results, const char* name, const std::vector<cut_t>& cuts, const std::string& filename, bool last)
+{
+    size_t frames = 0;
+    for (const cut_t& cut : cuts) {
+        frames += cut.cut_out - cut.cut_in + 1;
+    }
+
+    bench_clock::time_point start = bench_clock::now();
+    Exporter exporter(cuts);
+    bool success = exporter.run(filename);
+    double ms = elapsed_ms(start);
+
+    struct stat info;
+    int64_t size = stat(filename.c_str(), &info) == 0 ? info.st_size : 0;
+    unlink(filename.c_str());
+
+    fprintf(results, "      \"export_%s\": { \"success\": %s, \"cuts\": %zu, \"frames\": %zu, \"ms\": %.1f, \"frames_per_s\": %.1f, \"mib_per_s\": %.2f }%s\n",
+        name, success ? "true" : "false", cuts.size(), frames, ms, ms > 0 ? frames * 1000 / ms : 0, ms > 0 ? size / 1048576.0 * 1000 / ms : 0, last ? "" : ",");
+}
+
+/**
+ * Print the command line usage
+ * @param program The name of the executable
+ */
+static void print_usage(const char* program)
+{
+    fprintf(stderr, "Usage: %s [--output <file>] [--dir <directory>] [--duration <seconds>] [--keep]\n", program);
+    fprintf(stderr, "  --output    write the JSON results to a file instead of stdout\n");
+    fprintf(stderr, "  --dir       directory for the generated sources (default: a new directory in /tmp)\n");
+    fprintf(stderr, "  --duration  duration of each source in seconds (default: %d)\n", BENCH_DEFAULT_DURATION);
+    fprintf(stderr, "  --keep      keep the generated sources\n");
+}
+
+int main(int argc, char* argv[])
+{
+    // parse arguments
+    std::string output_filename;
+    std::string directory;
+    int duration = BENCH_DEFAULT_DURATION;
+    bool keep = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output_filename = argv[++i];
+        } else if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc) {
+            directory = argv[++i];
+        } else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            duration = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--keep") == 0) {
+            keep = true;
+        } else {
+            print_usage(argv[0]);
+            return 2;
+        }
+    }
+
+    // keep the log out of the results
+    fflush(stdout);
+    FILE* results = output_filename.empty() ? fdopen(dup(STDOUT_FILENO), "w") : fopen(output_filename.c_str(), "w");
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+    if (results == NULL) {
+        perror("failed to open results");
+        return 1;
+    }
+    if (directory.empty()) {
+        char temp_directory[] = "/tmp/mcut_bench.XXXXXX";
+        if (mkdtemp(temp_directory) == NULL) {
+            perror("failed to create directory");
+            return 1;
+        }
+        directory = temp_directory;
+    }
+
+    fprintf(results, "{\n");
+    fprintf(results, "  \"libavformat\": \"%s\",\n", LIBAVFORMAT_IDENT);
+    fprintf(results, "  \"libavcodec\": \"%s\",\n", LIBAVCODEC_IDENT);
+    fprintf(results, "  \"duration_s\": %d,\n", duration);
+    fprintf(results, "  \"sources\": [\n");
+    size_t source_count = sizeof(sources) / sizeof(sources[0]);
+    for (size_t i = 0; i < source_count; i++) {
+        const bench_source_t& source = sources[i];
+        std::string filename = directory + "/" + source.name + "." + source.extension;
+        const char* separator = i + 1 < source_count ? "," : "";
+        fprintf(results, "    {\n      \"name\": \"%s\",\n", source.name);
+
+        // generate
+        fprintf(stderr, "generating %s\n", filename.c_str());
+        bench_clock::time_point start = bench_clock::now();
+        if (!generate_source(filename, source, duration)) {
+            fprintf(results, "      \"skipped\": \"encoder not available\"\n    }%s\n", separator);
+            unlink(filename.c_str());
+            continue;
+        }
+        struct stat info;
+        stat(filename.c_str(), &info);
+        fprintf(results, "      \"generate_ms\": %.1f,\n", elapsed_ms(start));
+        fprintf(results, "      \"size\": %ld,\n", (long) info.st_size);
+
+        // open, full scan and quick open
+        MediaFile* media_file = NULL;
+        double open_ms = 0;
+        double quick_open_ms = 0;
+        try {
+            start = bench_clock::now();
+            MediaFile* quick_media_file = new MediaFile(filename, MEDIAFILE_QUICK_OPEN);
+            quick_open_ms = elapsed_ms(start);
+            delete quick_media_file;
+
+            start = bench_clock::now();
+            media_file = new MediaFile(filename);
+            open_ms = elapsed_ms(start);
+        } catch (const std::runtime_error& error) {
+            fprintf(results, "      \"skipped\": \"%s\"\n    }%s\n", error.what(), separator);
+            unlink(filename.c_str());
+            continue;
+        }
+        ssize_t frame_count = media_file->get_frame_count();
+        fprintf(results, "      \"frames\": %zd,\n", frame_count);
+        fprintf(results, "      \"open_ms\": %.1f,\n", open_ms);
+        fprintf(results, "      \"quick_open_ms\": %.1f,\n", quick_open_ms);
+
+        bench_get_frame(results, media_file);
+        bench_queries(results, media_file);
+
+        // copy heavy: few long cuts starting within a group of pictures
+        std::vector<cut_t> cuts;
+        for (int j = 0; j < 3; j++) {
+            cut_t cut;
+            cut.media_file = media_file;
+            cut.cut_in = frame_count * j / 3 + source.gop_size / 2;
+            cut.cut_out = frame_count * (j + 1) / 3 - source.gop_size / 2 - 1;
+            if (cut.cut_in < cut.cut_out) {
+                cuts.push_back(cut);
+            }
+        }
+        std::string export_filename = directory + "/export-" + source.name + "." + source.extension;
+        bench_export(results, "copy", cuts, export_filename, false);
+
+        // re-encode heavy: many short cuts within the groups of pictures
+        cuts.clear();
+        for (ssize_t j = source.gop_size / 4; j + source.gop_size / 2 < frame_count && cuts.size() < 20; j += frame_count / 20) {
+            cut_t cut;
+            cut.media_file = media_file;
+            cut.cut_in = j;
+            cut.cut_out = j + std::max(source.gop_size / 2, 2) - 1;
+            cuts.push_back(cut);
+        }
+        bench_export(results, "reencode", cuts, export_filename, true);
+
+        fprintf(results, "    }%s\n", separator);
+        delete media_file;
+        if (!keep) {
+            unlink(filename.c_str());
+        }
+    }
+    fprintf(results, "  ]\n}\n");
+    fclose(results);
+
+    if (!keep) {
+        rmdir(directory.c_str());
+    }
+    return 0;
+}
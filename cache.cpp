@@ -0,0 +1,84 @@
+// SPDX-FileCopyrightText: 2023-2026 Minei3oat
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "cache.h"
+
+#include <functional>
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+/**
+ * Get the cache directory and create it if needed
+ * @return The path of the directory or an empty string if there is none
+ */
+std::string Cache::get_directory()
+{
+    std::string directory;
+    if (const char* value = getenv(CACHE_DIR_ENV); value != NULL && *value) {
+        directory = value;
+    } else if (const char* value = getenv("XDG_CACHE_HOME"); value != NULL && *value) {
+        directory = std::string(value) + "/mcut";
+    } else if (const char* value = getenv("HOME"); value != NULL && *value) {
+        directory = std::string(value) + "/.cache/mcut";
+    } else {
+        return "";
+    }
+
+    // create all missing parents
+    for (size_t position = directory.find('/', 1); ; position = directory.find('/', position + 1)) {
+        std::string parent = directory.substr(0, position);
+        if (mkdir(parent.c_str(), 0755) != 0 && errno != EEXIST) {
+            return "";
+        }
+        if (position == std::string::npos) {
+            break;
+        }
+    }
+    return directory;
+}
+
+/**
+ * Get the path of a cache file belonging to a media file
+ * @param filename The media file
+ * @param suffix The suffix identifying the kind of cache file, e.g. ".loudness"
+ * @return The path of the cache file or an empty string if the media file or the cache directory is not accessible
+ */
+std::string Cache::get_path(const std::string& filename, const std::string& suffix)
+{
+    char absolute[PATH_MAX];
+    struct stat info;
+    if (realpath(filename.c_str(), absolute) == NULL || stat(absolute, &info) != 0) {
+        return "";
+    }
+    std::string directory = get_directory();
+    if (directory.empty()) {
+        return "";
+    }
+
+    // keep the name readable, the hash tells files of the same name apart
+    std::string path(absolute);
+    std::string name = path.substr(path.rfind('/') + 1);
+    char key[17];
+    snprintf(key, sizeof(key), "%016zx", std::hash<std::string>()(path + "\n" + std::to_string(info.st_size) + "\n" + std::to_string(info.st_mtime)));
+    return directory + "/" + name + "-" + key + suffix;
+}
+
+/**
+ * Move a completely written cache file into place, so readers never see a partial file
+ * @param temporary_path The written file
+ * @param path The path of the cache file
+ * @return True on success
+ */
+bool Cache::replace(const std::string& temporary_path, const std::string& path)
+{
+    if (rename(temporary_path.c_str(), path.c_str()) != 0) {
+        remove(temporary_path.c_str());
+        return false;
+    }
+    return true;
+}
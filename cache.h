@@ -0,0 +1,27 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2026 Minei3oat
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <string>
+
+// environment variable overriding the cache directory, by default $XDG_CACHE_HOME/mcut or ~/.cache/mcut
+#define CACHE_DIR_ENV "MCUT_CACHE_DIR"
+
+/**
+ * Locates files derived from a media file, e.g. analysis results, in the cache directory.
+ * The name of a cache file depends on the path, size and modification time of the media file, so changed files are not matched.
+ */
+class Cache
+{
+public:
+    static std::string get_directory();
+    static std::string get_path(const std::string& filename, const std::string& suffix);
+    static bool replace(const std::string& temporary_path, const std::string& path);
+};
+
+#endif // CACHE_H
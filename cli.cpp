@@ -0,0 +1,252 @@
+// SPDX-FileCopyrightText: 2023-2026 Minei3oat
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "cli.h"
+#include "exporter.h"
+#include "inputio.h"
+#include "mediafileloader.h"
+#include "splitexporter.h"
+#include "statistics.h"
+#include "tracing.h"
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonValue>
+
+// milliseconds between progress updates of a split export
+#define CLI_PROGRESS_INTERVAL 200
+
+/**
+ * Print the command line usage
+ * @param program The name of the executable
+ */
+static void print_usage(const char* program)
+{
+    fprintf(stderr, "Usage: %s --export <project> <output> [--format <name>] [--output <output> [--format <name>]]... [--fast-start] [--split] [--quick-open] [--read-ahead <MiB>] [--trace <file>] [--stats <file>]\n", program);
+    fprintf(stderr, "  <output> may be a file, a named pipe or - for stdout\n");
+    fprintf(stderr, "  --output        additional output, written in the same pass\n");
+    fprintf(stderr, "  --format        container of the preceding output, e.g. mpegts or matroska (default: guessed from the file name, mpegts for pipes)\n");
+    fprintf(stderr, "  --segment-time  target duration in seconds of the segments of the preceding output, e.g. a .m3u8 playlist (default: %d)\n", SEGMENT_DEFAULT_DURATION);
+    fprintf(stderr, "  --segment-type  container of the segments of the preceding output: ts or fmp4 (default: ts)\n");
+    fprintf(stderr, "  --fast-start    write the index of the preceding mp4 or matroska output at its start\n");
+    fprintf(stderr, "  --split         write each cut into its own file, the number of the cut is appended to <output>\n");
+    fprintf(stderr, "  --quick-open    only index keyframes of the source files\n");
+    fprintf(stderr, "  --read-ahead    MiB the kernel is asked to read ahead of the demuxer (default: %d)\n", INPUT_IO_DEFAULT_WINDOW >> 20);
+    fprintf(stderr, "  --stats         write counters and histograms of the index size, I/O, seeks, decoded frames and stage times as JSON\n");
+    fprintf(stderr, "  --trace         write the time spent in seek, demux, decode, encode, mux and I/O as Chrome trace JSON\n");
+}
+
+/**
+ * Check whether MCut should run without a window
+ * @param argc The number of arguments
+ * @param argv The arguments
+ * @return True if a command line action is requested
+ */
+bool is_cli_mode(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--export") == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Export a saved project without a window
+ * @param argc The number of arguments
+ * @param argv The arguments
+ * @return The exit code
+ */
+int run_cli(int argc, char* argv[])
+{
+    // parse arguments
+    std::string project_filename;
+    std::vector<export_target_t> targets;
+    int flags = 0;
+    bool split = false;
+    size_t read_ahead = 0;
+    std::string trace_filename;
+    std::string statistics_filename;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--export") == 0 && i + 2 < argc && project_filename.empty()) {
+            project_filename = argv[++i];
+            targets.insert(targets.begin(), export_target_t { argv[++i], "" });
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            targets.push_back(export_target_t { argv[++i], "" });
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc && !targets.empty()) {
+            targets.back().format = argv[++i];
+        } else if (strcmp(argv[i], "--segment-time") == 0 && i + 1 < argc && !targets.empty() && atoi(argv[i + 1]) > 0) {
+            targets.back().segment_duration = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--segment-type") == 0 && i + 1 < argc && !targets.empty() && (strcmp(argv[i + 1], "ts") == 0 || strcmp(argv[i + 1], "fmp4") == 0)) {
+            targets.back().segment_format = strcmp(argv[++i], "ts") == 0 ? "mpegts" : "fmp4";
+        } else if (strcmp(argv[i], "--fast-start") == 0 && !targets.empty()) {
+            targets.back().fast_start = true;
+        } else if (strcmp(argv[i], "--split") == 0) {
+            split = true;
+        } else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            statistics_filename = argv[++i];
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_filename = argv[++i];
+        } else if (strcmp(argv[i], "--quick-open") == 0) {
+            flags |= MEDIAFILE_QUICK_OPEN;
+        } else if (strcmp(argv[i], "--read-ahead") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            read_ahead = (size_t) atoi(argv[++i]) << 20;
+        } else {
+            print_usage(argv[0]);
+            return 2;
+        }
+    }
+    if (project_filename.empty()) {
+        print_usage(argv[0]);
+        return 2;
+    }
+    if (split && (targets.size() > 1 || Exporter::is_stream_target(targets[0].target))) {
+        fprintf(stderr, "--split needs a single file output\n");
+        return 2;
+    }
+
+    // keep the log out of the stream, when writing to stdout
+    int stdout_fd = -1;
+    for (export_target_t& target : targets) {
+        if (target.target == "-" || target.target == "pipe:" || target.target == "pipe:1") {
+            if (stdout_fd != -1) {
+                fprintf(stderr, "stdout can only be used for one output\n");
+                return 2;
+            }
+            fflush(stdout);
+            stdout_fd = dup(STDOUT_FILENO);
+            dup2(STDERR_FILENO, STDOUT_FILENO);
+            target.target = "pipe:" + std::to_string(stdout_fd);
+        }
+    }
+
+    // report a closed pipe as write error instead of terminating
+    signal(SIGPIPE, SIG_IGN);
+
+    if (!trace_filename.empty()) {
+        Tracing::set_enabled(true);
+    }
+
+    // open json file
+    QFile file(QString::fromStdString(project_filename));
+    if (!file.open(QIODevice::ReadOnly)) {
+        fprintf(stderr, "failed to open %s\n", project_filename.c_str());
+        return 1;
+    }
+    const QJsonObject project = QJsonDocument::fromJson(file.readAll()).object();
+
+    // open all files concurrently
+    std::vector<std::string> file_names;
+    if (const QJsonValue v = project["files"]; v.isArray()) {
+        for (const QJsonValue &file : v.toArray()) {
+            file_names.push_back(file.isString() ? file.toString().toStdString() : "");
+        }
+    }
+    MediaFileLoader loader(file_names, flags);
+    loader.start();
+    loader.wait();
+    std::vector<MediaFile*> media_files(file_names.size(), NULL);
+    for (size_t i = 0; i < file_names.size(); i++) {
+        media_files[i] = loader.take(i);
+        if (media_files[i] == NULL) {
+            printf("failed to open %s: %s\n", loader.get_filename(i).c_str(), loader.get_error(i).c_str());
+        } else if (read_ahead > 0) {
+            media_files[i]->set_read_ahead(read_ahead);
+        }
+    }
+
+    // collect cuts
+    // skip last "cut", since it stores the cut that was composed when saving
+    std::vector<cut_t> cuts;
+    if (const QJsonValue v = project["cuts"]; v.isArray()) {
+        QJsonArray cut_array = v.toArray();
+        for (int i = 0; i + 1 < cut_array.size(); i++) {
+            const QJsonObject cut_object = cut_array.at(i).toObject();
+            const QJsonValue media_file = cut_object.value("media_file");
+            if (!media_file.isDouble() || media_file.toInteger() < 0 || (size_t) media_file.toInteger() >= media_files.size() || media_files[media_file.toInteger()] == NULL) {
+                continue;
+            }
+            cut_t cut;
+            cut.media_file = media_files[media_file.toInteger()];
+            cut.cut_in = cut_object.value("cut_in").toInteger();
+            cut.cut_out = cut_object.value("cut_out").toInteger();
+            // prefer the pts, the indices of quick opened files may have moved since saving
+            if (cut_object.value("cut_in_pts").isDouble() && cut_object.value("cut_out_pts").isDouble()) {
+                cut.first_pts = cut_object.value("cut_in_pts").toInteger();
+                cut.last_pts = cut_object.value("cut_out_pts").toInteger();
+                cut.cut_in = cut.media_file->find_frame(cut.first_pts);
+                cut.cut_out = cut.media_file->find_last_frame(cut.last_pts);
+            }
+            if (cut.cut_in < 0 || cut.cut_in > cut.cut_out || cut.cut_out >= cut.media_file->get_frame_count()) {
+                printf("skipping invalid cut %d\n", i);
+                continue;
+            }
+            cuts.push_back(cut);
+        }
+    }
+
+    // export each cut concurrently with progress on stderr
+    bool success;
+    if (split) {
+        SplitExporter exporter(cuts, targets[0].target, targets[0].format);
+        exporter.start();
+        int reported_percent = -1;
+        while (!exporter.is_finished()) {
+            size_t total = exporter.get_total();
+            int percent = total ? exporter.get_position() * 100 / total : 100;
+            if (percent != reported_percent) {
+                reported_percent = percent;
+                fprintf(stderr, "\rExporting: %3d%%", percent);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(CLI_PROGRESS_INTERVAL));
+        }
+        exporter.wait();
+        fprintf(stderr, "\rExporting: 100%%\n");
+        success = exporter.is_successful();
+    } else {
+        // export with progress on stderr
+        int reported_percent = -1;
+        Exporter exporter(cuts, [&reported_percent](size_t position, size_t total) {
+            int percent = total ? position * 100 / total : 100;
+            if (percent != reported_percent) {
+                reported_percent = percent;
+                fprintf(stderr, "\rExporting: %3d%%", percent);
+            }
+        });
+        success = exporter.run(targets);
+        fprintf(stderr, "\n");
+    }
+    if (!trace_filename.empty()) {
+        Tracing::dump(trace_filename);
+    }
+    if (!statistics_filename.empty()) {
+        FILE* statistics_file = fopen(statistics_filename.c_str(), "w");
+        if (statistics_file == NULL) {
+            perror("failed to write statistics");
+        } else {
+            fputs(Statistics::to_json().c_str(), statistics_file);
+            fclose(statistics_file);
+        }
+    }
+
+    // cleanup
+    for (MediaFile* media_file : media_files) {
+        delete media_file;
+    }
+    return success ? 0 : 1;
+}
@@ -0,0 +1,13 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2026 Minei3oat
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef CLI_H
+#define CLI_H
+
+bool is_cli_mode(int argc, char* argv[]);
+int run_cli(int argc, char* argv[]);
+
+#endif // CLI_H
@@ -0,0 +1,186 @@
+// SPDX-FileCopyrightText: 2023-2026 Minei3oat
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "decoderpool.h"
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+typedef struct decoder_key {
+    AVCodecID codec_id;
+    int profile;
+    int width;
+    int height;
+    int format;
+    int has_b_frames;
+    bool fast;
+    std::string extradata;
+
+    bool operator<(const decoder_key& other) const {
+        return std::tie(codec_id, profile, width, height, format, has_b_frames, fast, extradata) < std::tie(other.codec_id, other.profile, other.width, other.height, other.format, other.has_b_frames, other.fast, other.extradata);
+    }
+} decoder_key_t;
+
+static std::mutex pool_mutex;
+static std::map<decoder_key_t, std::vector<AVCodecContext*>> idle_decoders;
+static std::map<AVCodecContext*, decoder_key_t> decoder_keys;
+static std::map<AVHWDeviceType, bool> usable_hw_devices;
+static std::map<std::pair<AVCodecID, int>, int> hw_config_indices;
+
+/**
+ * Build the pool key for the given codec parameters
+ * @param codecpar The codec parameters of the stream to decode
+ * @param has_b_frames The reorder buffer length of the decoder
+ * @param fast Whether the decoder trades quality for speed
+ * @return The key
+ */
+static decoder_key_t make_key(const AVCodecParameters* codecpar, int has_b_frames, bool fast)
+{
+    decoder_key_t key;
+    key.codec_id = codecpar->codec_id;
+    key.profile = codecpar->profile;
+    key.width = codecpar->width;
+    key.height = codecpar->height;
+    key.format = codecpar->format;
+    key.has_b_frames = has_b_frames;
+    key.fast = fast;
+    if (codecpar->extradata) {
+        key.extradata.assign((const char*) codecpar->extradata, codecpar->extradata_size);
+    }
+    return key;
+}
+
+/**
+ * Get an opened software decoder for the given codec parameters, either from the pool or newly created
+ * @param codecpar The codec parameters of the stream to decode
+ * @param has_b_frames The reorder buffer length of the decoder
+ * @param fast True for a decoder producing rough frames quickly, it skips the loop filter and the IDCT of non-reference frames and reduces the resolution if possible
+ * @return The decoder, which must be returned with release
+ */
+AVCodecContext* DecoderPool::acquire(const AVCodecParameters* codecpar, int has_b_frames, bool fast)
+{
+    decoder_key_t key = make_key(codecpar, has_b_frames, fast);
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        auto idle = idle_decoders.find(key);
+        if (idle != idle_decoders.end() && !idle->second.empty()) {
+            AVCodecContext* decode_context = idle->second.back();
+            idle->second.pop_back();
+            return decode_context;
+        }
+    }
+
+    // create new decoder
+    const AVCodec *decoder = avcodec_find_decoder(codecpar->codec_id);
+    AVCodecContext *decode_context = avcodec_alloc_context3(decoder);
+    avcodec_parameters_to_context(decode_context, codecpar);
+
+    // set reorder buffer length
+    // this is needed, frames that cause an automatic resizing are lost (at least for h264)
+    decode_context->has_b_frames = has_b_frames;
+
+    if (fast) {
+        decode_context->lowres = std::min<int>(FAST_DECODER_LOWRES, decoder->max_lowres);
+        decode_context->skip_loop_filter = AVDISCARD_ALL;
+        decode_context->skip_idct = AVDISCARD_NONREF;
+    }
+
+    avcodec_open2(decode_context, decoder, NULL);
+
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    decoder_keys[decode_context] = key;
+    return decode_context;
+}
+
+/**
+ * Flush a decoder and return it to the pool
+ * @param decode_context The decoder to return
+ */
+void DecoderPool::release(AVCodecContext* decode_context)
+{
+    if (decode_context == NULL) {
+        return;
+    }
+    avcodec_flush_buffers(decode_context);
+
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    auto key = decoder_keys.find(decode_context);
+    if (key == decoder_keys.end()) {
+        avcodec_free_context(&decode_context);
+        return;
+    }
+
+    std::vector<AVCodecContext*>& idle = idle_decoders[key->second];
+    if (idle.size() >= MAX_POOLED_DECODERS) {
+        decoder_keys.erase(key);
+        avcodec_free_context(&decode_context);
+        return;
+    }
+    idle.push_back(decode_context);
+}
+
+/**
+ * Free all idle decoders
+ */
+void DecoderPool::clear()
+{
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    for (auto& [key, idle] : idle_decoders) {
+        for (AVCodecContext* decode_context : idle) {
+            decoder_keys.erase(decode_context);
+            avcodec_free_context(&decode_context);
+        }
+    }
+    idle_decoders.clear();
+}
+
+/**
+ * Check whether a hardware device type may be usable
+ * @param device_type The type of the hardware device
+ * @return False if creating a device of that type failed before
+ */
+bool DecoderPool::is_hw_device_usable(AVHWDeviceType device_type)
+{
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    auto usable = usable_hw_devices.find(device_type);
+    return usable == usable_hw_devices.end() || usable->second;
+}
+
+/**
+ * Remember whether a hardware device type is usable
+ * @param device_type The type of the hardware device
+ * @param usable Whether a device of that type could be created
+ */
+void DecoderPool::set_hw_device_usable(AVHWDeviceType device_type, bool usable)
+{
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    usable_hw_devices[device_type] = usable;
+}
+
+/**
+ * Get the index of the hardware configuration found for a codec before
+ * @param codecpar The codec parameters of the stream to decode
+ * @return The index for avcodec_get_hw_config, -1 if no hardware decoder works or HW_CONFIG_UNKNOWN if not probed yet
+ */
+int DecoderPool::get_hw_config_index(const AVCodecParameters* codecpar)
+{
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    auto index = hw_config_indices.find(std::make_pair(codecpar->codec_id, codecpar->profile));
+    return index == hw_config_indices.end() ? HW_CONFIG_UNKNOWN : index->second;
+}
+
+/**
+ * Remember the hardware configuration found for a codec
+ * @param codecpar The codec parameters of the decoded stream
+ * @param index The index for avcodec_get_hw_config or -1 if no hardware decoder works
+ */
+void DecoderPool::set_hw_config_index(const AVCodecParameters* codecpar, int index)
+{
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    hw_config_indices[std::make_pair(codecpar->codec_id, codecpar->profile)] = index;
+}
@@ -0,0 +1,39 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2026 Minei3oat
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef DECODERPOOL_H
+#define DECODERPOOL_H
+
+extern "C" {
+    #include <libavcodec/avcodec.h>
+}
+
+// maximum number of idle decoders kept per set of codec parameters
+#define MAX_POOLED_DECODERS 4
+// hardware configuration of a codec that was not probed yet
+#define HW_CONFIG_UNKNOWN -2
+// resolution reduction (power of two) of fast decoders, only applied if the codec supports it
+#define FAST_DECODER_LOWRES 1
+
+/**
+ * Process wide pool of opened software decoders and cache of the usable hardware decoders.
+ * Decoders are keyed by their codec parameters and flushed when returned, so they can be reused across segments and files.
+ * All functions are thread safe.
+ */
+class DecoderPool
+{
+public:
+    static AVCodecContext* acquire(const AVCodecParameters* codecpar, int has_b_frames, bool fast = false);
+    static void release(AVCodecContext* decode_context);
+    static void clear();
+
+    static bool is_hw_device_usable(AVHWDeviceType device_type);
+    static void set_hw_device_usable(AVHWDeviceType device_type, bool usable);
+    static int get_hw_config_index(const AVCodecParameters* codecpar);
+    static void set_hw_config_index(const AVCodecParameters* codecpar, int index);
+};
+
+#endif // DECODERPOOL_H
@@ -0,0 +1,1020 @@
+// SPDX-FileCopyrightText: 2023-2026 Minei3oat
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "exporter.h"
+#include "decoderpool.h"
+#include "logger.h"
+#include "statistics.h"
+#include "tracing.h"
+
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+extern "C" {
+    #include <libavutil/opt.h>
+}
+
+// upper bounds for reserving the mp4 index, every sample may get its own entry in stts, stsz, ctts, stsc, co64 and sdtp
+#define MOOV_FIXED_SIZE (16 << 10)
+#define MOOV_TRACK_SIZE (4 << 10)
+#define MOOV_SAMPLE_SIZE 48
+#define MOOV_KEYFRAME_SIZE 4
+// upper bounds for reserving the matroska cues, one cue point per video keyframe
+#define CUES_FIXED_SIZE (1 << 10)
+#define CUE_POINT_SIZE 48
+// audio and subtitle packets per cut and stream that may be written in addition to the ones within the cut
+#define INDEX_PACKET_SLACK 16
+// bytes read past the packets of a cut while waiting for its last packets, which complete late in interleaved containers
+#define REMUX_MAX_OVERREAD (16 << 20)
+
+/**
+ * Create an exporter
+ * @param cuts The cuts to export in output order
+ * @param progress_callback Called with the number of written video frames
+ */
+Exporter::Exporter(const std::vector<cut_t>& cuts, export_progress_t progress_callback) : cuts(cuts), progress_callback(progress_callback)
+{
+    time_base = cuts.empty() ? AVRational { 1, 1 } : cuts[0].media_file->get_video_stream()->time_base;
+    set_cut_pts(this->cuts);
+}
+
+/**
+ * Take the pts of cuts, that only have indices, from their frames
+ * @param cuts The cuts to complete
+ */
+void Exporter::set_cut_pts(std::vector<cut_t>& cuts)
+{
+    for (cut_t& cut : cuts) {
+        if (cut.media_file == NULL) {
+            continue;
+        }
+        if (const packet_info_t* info = cut.media_file->get_frame_info(cut.cut_in); cut.first_pts == AV_NOPTS_VALUE && info != NULL) {
+            cut.first_pts = info->pts;
+        }
+        if (const packet_info_t* info = cut.media_file->get_frame_info(cut.cut_out); cut.last_pts == AV_NOPTS_VALUE && info != NULL) {
+            cut.last_pts = info->pts;
+        }
+    }
+}
+
+/**
+ * Index the groups of pictures around the cut points of quick opened files and resolve the indices of the cuts from their pts.
+ * The indices are only resolved after all cuts are refined, since refining moves the following frames of the file.
+ * @param cuts The cuts to resolve
+ * @return False if a cut is empty or outside of its file
+ */
+bool Exporter::resolve_cuts(std::vector<cut_t>& cuts)
+{
+    set_cut_pts(cuts);
+    for (const cut_t& cut : cuts) {
+        if (cut.media_file == NULL || cut.first_pts == AV_NOPTS_VALUE || cut.last_pts == AV_NOPTS_VALUE) {
+            return false;
+        }
+        cut.media_file->refine_range(cut.first_pts, cut.last_pts);
+    }
+
+    for (cut_t& cut : cuts) {
+        cut.cut_in = cut.media_file->find_frame(cut.first_pts);
+        cut.cut_out = cut.media_file->find_last_frame(cut.last_pts);
+        if (cut.cut_in < 0 || cut.cut_in > cut.cut_out) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Check whether a target is a pipe instead of a regular file
+ * @param target The output file name, "-" or "pipe:" for stdout
+ * @return True if the output cannot seek
+ */
+bool Exporter::is_stream_target(const std::string& target)
+{
+    if (target == "-" || target.rfind("pipe:", 0) == 0) {
+        return true;
+    }
+    struct stat info;
+    return stat(target.c_str(), &info) == 0 && (S_ISFIFO(info.st_mode) || S_ISCHR(info.st_mode) || S_ISSOCK(info.st_mode));
+}
+
+/**
+ * Open the output
+ * @param target The output file name, "-" or "pipe:" for stdout or "pipe:N" for file descriptor N
+ * @param size_estimate The expected size of the output in bytes
+ * @return The output or NULL on failure
+ */
+OutputIO* Exporter::open_output(const std::string& target, int64_t size_estimate)
+{
+    try {
+        if (target == "-" || target.rfind("pipe:", 0) == 0) {
+            int fd = STDOUT_FILENO;
+            if (target.size() > 5) {
+                fd = atoi(target.c_str() + 5);
+            }
+            int output_fd = dup(fd);
+            if (output_fd < 0) {
+                throw std::runtime_error(strerror(errno));
+            }
+
+            // keep the log out of the stream
+            if (fd == STDOUT_FILENO) {
+                fflush(stdout);
+                dup2(STDERR_FILENO, STDOUT_FILENO);
+            }
+            return new OutputIO(output_fd);
+        } else if (is_stream_target(target)) {
+            int output_fd = open(target.c_str(), O_WRONLY | O_CLOEXEC);
+            if (output_fd < 0) {
+                throw std::runtime_error(strerror(errno));
+            }
+            return new OutputIO(output_fd);
+        }
+        return new OutputIO(target, size_estimate, size_estimate >= OUTPUT_IO_DIRECT_THRESHOLD);
+    } catch(const std::runtime_error& error) {
+        log_error(LOG_CATEGORY_EXPORT, "failed to open %s: %s", target.c_str(), error.what());
+        return NULL;
+    }
+}
+
+/**
+ * Write a packet to all outputs containing its stream
+ * @param packet The packet to write, its stream index is the index of the exported stream
+ * @return The first error from av_interleaved_write_frame or 0
+ */
+int Exporter::write_packet(AVPacket* packet) {
+    int stream_index = packet->stream_index;
+    if (streams[stream_index]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+        written_frames++;
+        if (progress_callback) {
+            progress_callback(written_frames, frame_count);
+        }
+    }
+
+    TraceSpan span("mux");
+    static Counter& packets_written = Statistics::counter("export.packets_written");
+    int result = 0;
+    AVPacket* output_packet = av_packet_alloc();
+    for (export_output_t& output : outputs) {
+        if (output.stream_map[stream_index] == -1) {
+            continue;
+        }
+        av_packet_ref(output_packet, packet);
+        output_packet->stream_index = output.stream_map[stream_index];
+        av_packet_rescale_ts(output_packet, time_base, output.format_context->streams[0]->time_base);
+        log_trace(LOG_CATEGORY_EXPORT, "Writing output packet for stream %d with dts %ld, pts %ld and duration %ld", output_packet->stream_index, output_packet->dts, output_packet->pts, output_packet->duration);
+        int error = av_interleaved_write_frame(output.format_context, output_packet);
+        packets_written.add();
+        if (error < 0 && result == 0) {
+            result = error;
+        }
+    }
+    av_packet_free(&output_packet);
+    av_packet_unref(packet);
+    return result;
+}
+
+/**
+ * Get the bitrate to encode the video of a media file with
+ * @param media_file The media file to get the bitrate for
+ * @param codecpar The parameters of the exported video stream
+ * @return The bitrate of the exported stream, or the average video bitrate of the media file if it is unknown
+ */
+int64_t Exporter::get_video_bitrate(const MediaFile* media_file, const AVCodecParameters* codecpar) {
+    if (codecpar->bit_rate != 0) {
+        return codecpar->bit_rate;
+    }
+    const AVStream* video_stream = media_file->get_video_stream();
+    const packet_info_t* frame_infos = media_file->get_frame_info(0);
+    ssize_t offset_diff = frame_infos[media_file->get_frame_count()-1].offset - frame_infos[0].offset;
+    return offset_diff * 8 * video_stream->avg_frame_rate.num / video_stream->avg_frame_rate.den / media_file->get_frame_count();
+}
+
+/**
+ * Check whether an encode context configured for one media file also fits the frames of another one
+ * @param configured The media file the encode context was configured for
+ * @param media_file The media file to transcode frames of
+ * @param codecpar The parameters of the exported video stream
+ * @return True if the encode context would be configured the same way for both media files
+ */
+bool Exporter::has_encode_parameters(const MediaFile* configured, const MediaFile* media_file, const AVCodecParameters* codecpar) {
+    if (configured == media_file) {
+        return true;
+    }
+    return av_cmp_q(configured->get_video_stream()->avg_frame_rate, media_file->get_video_stream()->avg_frame_rate) == 0 &&
+           configured->get_max_bframes() == media_file->get_max_bframes() &&
+           configured->get_gop_size() == media_file->get_gop_size() &&
+           get_video_bitrate(configured, codecpar) == get_video_bitrate(media_file, codecpar);
+}
+
+/**
+ * Create an encode context for the given medie file and output stream. The returned codec context must be freed manually
+ * @param media_file The media file to get the video encode context for
+ * @param codecpar The parameters of the exported video stream
+ * @return The codec context for encoding the video stream
+ */
+AVCodecContext* Exporter::get_video_encode_context(MediaFile* media_file, const AVCodecParameters* codecpar) {
+    const AVStream* video_stream = media_file->get_video_stream();
+
+    // get encoder
+    const AVCodec* encoder = avcodec_find_encoder(codecpar->codec_id);
+    AVCodecContext* encode_context = avcodec_alloc_context3(encoder);
+    avcodec_parameters_to_context(encode_context, codecpar);
+    encode_context->time_base.den = video_stream->avg_frame_rate.num;
+    encode_context->time_base.num = video_stream->avg_frame_rate.den;
+    encode_context->max_b_frames = media_file->get_max_bframes();
+    encode_context->gop_size = media_file->get_gop_size();
+    encode_context->keyint_min = media_file->get_gop_size();
+    log_debug(LOG_CATEGORY_EXPORT, "gop_size: %d, keyint_min: %d", encode_context->gop_size, encode_context->keyint_min);
+
+    // calculate bitrate
+    encode_context->bit_rate = get_video_bitrate(media_file, codecpar);
+    log_debug(LOG_CATEGORY_EXPORT, "encoder: bitrate: %ld; global_quality: %d", encode_context->bit_rate, encode_context->global_quality);
+
+    // make forced key frames IDR frames, so copied content can follow them (libx264/libx265)
+    av_opt_set(encode_context->priv_data, "forced-idr", "1", 0);
+
+    avcodec_open2(encode_context, encoder, NULL);
+
+    return encode_context;
+}
+
+/**
+ * Flush all frames from the encode context into the output context and free the encode context
+ * @param encode_context Pointer to the encode context to flush
+ * @param stream_id The index of the exported video stream
+ * @param dts The dts value of the first frame that will be flushed
+ * @param frame_duration The duration of a frame
+ * @param keep_open Keep the encode context open for further frames, if the encoder supports it
+ * @return The dts value of the next frame after flushing
+ */
+int64_t Exporter::flush_encode_context(AVCodecContext** encode_context, int stream_id, int64_t dts, int64_t frame_duration, bool keep_open) {
+    // preparations
+    AVPacket* packet = av_packet_alloc();
+
+    // retrieve remaining encoded packets
+    {
+        TraceSpan span("encode");
+        avcodec_send_frame(*encode_context, NULL);
+    }
+    while (avcodec_receive_packet(*encode_context, packet) == 0) {
+        packet->duration = frame_duration;
+        packet->dts = dts;
+        dts += frame_duration;
+        log_trace(LOG_CATEGORY_EXPORT, "Writing transcoded packet for stream %d with dts %ld, pts %ld and duration %ld", packet->stream_index, packet->dts, packet->pts, packet->duration);
+        packet->stream_index = stream_id;
+        write_packet(packet);
+    }
+
+    // cleanup
+    av_packet_free(&packet);
+    if (keep_open && ((*encode_context)->codec->capabilities & AV_CODEC_CAP_ENCODER_FLUSH)) {
+        // reset the drained encoder instead of opening a new one for the next span
+        avcodec_flush_buffers(*encode_context);
+    } else {
+        avcodec_free_context(encode_context);
+    }
+
+    return dts;
+}
+
+/**
+ * Provide an encode context configured for the given media file, an encode context configured for a media file with
+ * other parameters is flushed and replaced
+ * @param encode_context Pointer to the encode context, NULL if there is none yet
+ * @param encode_source Pointer to the media file the encode context was configured for
+ * @param encoder_drained Pointer to the flag whether the encode context holds no frames
+ * @param media_file The media file to transcode frames of
+ * @param stream_id The index of the exported video stream
+ * @param dts The dts value of the next written video frame
+ * @return The dts value of the next video frame after flushing a replaced encode context
+ */
+int64_t Exporter::prepare_encode_context(AVCodecContext** encode_context, MediaFile** encode_source, bool* encoder_drained, MediaFile* media_file, int stream_id, int64_t dts) {
+    const AVCodecParameters* codecpar = streams[stream_id]->codecpar;
+    if (*encode_context != NULL && !has_encode_parameters(*encode_source, media_file, codecpar)) {
+        log_debug(LOG_CATEGORY_EXPORT, "encoder parameters changed, opening a new encoder");
+        if (*encoder_drained) {
+            avcodec_free_context(encode_context);
+        } else {
+            dts = flush_encode_context(encode_context, stream_id, dts, (*encode_source)->get_frame_info(0)->duration);
+        }
+        *encoder_drained = true;
+    }
+    if (*encode_context == NULL) {
+        *encode_context = get_video_encode_context(media_file, codecpar);
+        *encode_source = media_file;
+    }
+    return dts;
+}
+
+/**
+ * Transcode video frames
+ * @param media_file The source to transcode
+ * @param cut_in The first frame to transcode
+ * @param cut_out The last frame to transcode
+ * @param stream_id The index of the exported video stream
+ * @param start_dts The dts of the first frame
+ * @param pts_offset The difference between the pts in the input and the output
+ * @param encode_context The encoder to use
+ * @param force_keyframe Encode the first frame as key frame
+ * @return The dts of the next frame
+ */
+int64_t Exporter::transcode_video_frames(MediaFile* media_file, ssize_t cut_in, ssize_t cut_out, int stream_id, int64_t start_dts, int64_t pts_offset, AVCodecContext* encode_context, bool force_keyframe) {
+    const AVStream* video_stream = media_file->get_video_stream();
+    const packet_info_t * frame_infos = media_file->get_frame_info(0);
+
+    AVCodecContext* decode_context = media_file->get_video_decode_context();
+
+    ssize_t current = media_file->find_iframe_before(cut_in);
+
+    // preparations
+    AVPacket* packet = av_packet_alloc();
+    AVFrame* frame = av_frame_alloc();
+
+    // dts correction
+    int64_t dts = start_dts;
+    int64_t duration = frame_infos[cut_in+1].pts - frame_infos[cut_in].pts;
+    log_debug(LOG_CATEGORY_EXPORT, "packet duration: %ld", duration);
+
+    // transcode video packets
+    if (media_file->seek(current) < 0) {
+        return AV_NOPTS_VALUE;
+    }
+    int64_t end_pts = frame_infos[cut_out].pts + duration;
+    int64_t start_pts = frame_infos[cut_in].pts;
+    log_debug(LOG_CATEGORY_EXPORT, "start_pts: %ld; end_pts = %ld", start_pts, end_pts);
+    int64_t last_pts = start_pts;
+    while (last_pts < end_pts) {
+        if (media_file->next_packet(packet)) {
+            log_error(LOG_CATEGORY_EXPORT, "failed to read packet");
+            break;
+        }
+
+        // printf("Found packet from stream %d with dts %ld and pts %ld\n", packet->stream_index, packet->dts, packet->pts);
+        if (packet->stream_index == video_stream->index) {
+            {
+                TraceSpan span("decode");
+                avcodec_send_packet(decode_context, packet);
+            }
+            while (avcodec_receive_frame(decode_context, frame) == 0) {
+                last_pts = frame->pts;
+                // skip frames just needed for decoding
+                if (frame->pts < start_pts || frame->pts >= end_pts) {
+                    log_trace(LOG_CATEGORY_EXPORT, "skipped frame %zd with dts %ld and pts %ld", current, frame->pkt_dts, frame->pts);
+                    current++;
+                    continue;
+                }
+
+                // send frame to encoder
+                // printf("got frame %zd with dts %ld and pts %ld\n", current, frame->pkt_dts, frame->pts);
+                frame->pict_type = force_keyframe ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+                force_keyframe = false;
+                frame->pts -= pts_offset;
+                // printf("frame duration: %ld\n", frame->duration);
+                {
+                    TraceSpan span("encode");
+                    avcodec_send_frame(encode_context, frame);
+                }
+                static Counter& frames_encoded = Statistics::counter("export.frames_encoded");
+                frames_encoded.add();
+
+                // retrieve encoded packets
+                while (avcodec_receive_packet(encode_context, packet) == 0) {
+                    packet->duration = duration;
+                    packet->dts = dts;
+                    dts += duration;
+                    log_trace(LOG_CATEGORY_EXPORT, "Writing transcoded packet for stream %d with dts %ld, pts %ld and duration %ld", packet->stream_index, packet->dts, packet->pts, packet->duration);
+                    packet->stream_index = stream_id;
+                    write_packet(packet);
+                }
+
+                current++;
+            }
+        }
+        av_packet_unref(packet);
+    }
+
+    // cleanup
+    av_frame_free(&frame);
+    av_packet_free(&packet);
+    DecoderPool::release(decode_context);
+
+    return dts;
+}
+
+/**
+ * Export the cuts
+ * @param target The output file name, a named pipe, "-" or "pipe:" for stdout
+ * @param format The name of the output format or empty to guess it from the file name
+ * @return True on success
+ */
+bool Exporter::run(const std::string& target, const std::string& format)
+{
+    return run(std::vector<export_target_t> { { target, format } });
+}
+
+/**
+ * Map the streams of a media file to the exported streams by their codec, the n-th stream of a codec is mapped to the n-th exported one
+ * @param media_file The media file to map the streams of
+ * @return The index of the exported stream for each stream of the media file or -1 if it is not exported
+ */
+std::vector<int> Exporter::map_streams(const MediaFile* media_file) const
+{
+    std::vector<int> stream_map(media_file->get_stream_count(), -1);
+    for (int j = 0; j < media_file->get_stream_count(); j++) {
+        int skip = 0;
+        for (int k = 0; k < j; k++) {
+            if (media_file->get_stream(j)->codecpar->codec_id == media_file->get_stream(k)->codecpar->codec_id) {
+                skip += 1;
+            }
+        }
+        for (size_t k = 0; k < streams.size(); k++) {
+            if (streams[k]->codecpar->codec_id == media_file->get_stream(j)->codecpar->codec_id) {
+                if (skip == 0) {
+                    stream_map[j] = k;
+                    log_debug(LOG_CATEGORY_EXPORT, "found matching stream: %d -> %zu", j, k);
+                    break;
+                } else {
+                    skip -= 1;
+                }
+            }
+        }
+    }
+    return stream_map;
+}
+
+/**
+ * Count the packets written for each exported stream and the video keyframes, so the index of the outputs can be reserved in advance.
+ * The counts are upper bounds, the frames around the cut points may all become keyframes.
+ */
+void Exporter::count_output_packets()
+{
+    packet_counts.assign(streams.size(), 0);
+    keyframe_count = 0;
+    for (const cut_t& cut : cuts) {
+        const packet_info_t* frame_infos = cut.media_file->get_frame_info(0);
+        ssize_t remux_start = cut.media_file->find_iframe_after(cut.cut_in);
+        ssize_t remux_end = cut.media_file->find_pframe_before(cut.cut_out);
+        if (remux_start > cut.cut_out || remux_start == -1) {
+            remux_start = cut.cut_out + 1;
+            remux_end = cut.cut_out;
+        }
+
+        // copied keyframes and re-encoded frames
+        packet_counts[0] += cut.cut_out - cut.cut_in + 1;
+        for (ssize_t j = cut.cut_in; j <= cut.cut_out; j++) {
+            if (frame_infos[j].is_keyframe || j < remux_start || j > remux_end) {
+                keyframe_count++;
+            }
+        }
+
+        // audio and subtitle packets, a few more may be taken to avoid gaps at the cut points
+        int64_t start_pts = frame_infos[cut.cut_in].pts;
+        int64_t end_pts = frame_infos[cut.cut_out].pts + frame_infos[cut.cut_out].duration;
+        std::vector<int> stream_map = map_streams(cut.media_file);
+        for (int j = 0; j < cut.media_file->get_stream_count(); j++) {
+            if (stream_map[j] > 0) {
+                packet_counts[stream_map[j]] += cut.media_file->count_packets(j, start_pts, end_pts) + INDEX_PACKET_SLACK;
+            }
+        }
+    }
+}
+
+/**
+ * Get the options reserving the index at the start of the output, so it is written in place instead of moving the whole file afterwards
+ * @param output The output to reserve the index for, its streams must be added already
+ * @param options The options to add the reservation to
+ */
+void Exporter::reserve_index(const export_output_t* output, AVDictionary** options) const
+{
+    const char* name = output->format_context->oformat->name;
+    if (strcmp(name, "mp4") == 0 || strcmp(name, "mov") == 0) {
+        int64_t moov_size = MOOV_FIXED_SIZE + keyframe_count * MOOV_KEYFRAME_SIZE;
+        for (size_t i = 0; i < streams.size(); i++) {
+            if (output->stream_map[i] != -1) {
+                moov_size += MOOV_TRACK_SIZE + packet_counts[i] * MOOV_SAMPLE_SIZE;
+            }
+        }
+        log_debug(LOG_CATEGORY_EXPORT, "reserving %ld bytes for moov", moov_size);
+        av_dict_set_int(options, "moov_size", moov_size, 0);
+    } else if (strcmp(name, "matroska") == 0 || strcmp(name, "webm") == 0) {
+        int64_t cues_size = CUES_FIXED_SIZE + keyframe_count * CUE_POINT_SIZE;
+        log_debug(LOG_CATEGORY_EXPORT, "reserving %ld bytes for cues", cues_size);
+        av_dict_set_int(options, "reserve_index_space", cues_size, 0);
+    }
+}
+
+/**
+ * Open an output and write its header
+ * @param target The output to open
+ * @param size_estimate The expected size of the output in bytes
+ * @param max_interleave_delta The maximum interleave delta of the muxer
+ * @param output The opened output
+ * @return True on success
+ */
+bool Exporter::open_target(const export_target_t& target, int64_t size_estimate, int64_t max_interleave_delta, export_output_t* output)
+{
+    // find muxer, pipes have no file name to guess the format from
+    bool streaming = is_stream_target(target.target);
+    const char* format_name = target.format.empty() ? NULL : target.format.c_str();
+    if (streaming && format_name == NULL) {
+        format_name = STREAM_DEFAULT_FORMAT;
+    }
+    const AVOutputFormat* output_format = av_guess_format(format_name, streaming ? NULL : target.target.c_str(), NULL);
+    if (output_format == NULL) {
+        log_error(LOG_CATEGORY_EXPORT, "No output format found for %s", target.target.c_str());
+        return false;
+    }
+
+    // open output file, segmenting muxers open their files on their own
+    bool segmented = output_format->flags & AVFMT_NOFILE;
+    if (segmented && streaming) {
+        log_error(LOG_CATEGORY_EXPORT, "%s cannot be written to a pipe", output_format->name);
+        return false;
+    }
+    if (!segmented) {
+        output->io = open_output(target.target, size_estimate);
+        if (output->io == NULL) {
+            return false;
+        }
+    }
+
+    // create muxer
+    AVFormatContext *output_context = NULL;
+    avformat_alloc_output_context2(&output_context, output_format, NULL, target.target.c_str());
+    if (output_context == NULL) {
+        log_error(LOG_CATEGORY_EXPORT, "Failed creating muxer for %s", target.target.c_str());
+        delete output->io;
+        output->io = NULL;
+        return false;
+    }
+    output->format_context = output_context;
+
+    // add video stream
+    const AVStream* video_stream = streams[0];
+    AVStream *output_video_stream = avformat_new_stream(output_context, NULL);
+    avcodec_parameters_copy(output_video_stream->codecpar, video_stream->codecpar);
+    output_video_stream->codecpar->codec_tag = 0;
+    output_video_stream->avg_frame_rate = video_stream->avg_frame_rate;
+    output_video_stream->time_base = video_stream->time_base;
+    log_debug(LOG_CATEGORY_EXPORT, "video: %d/%d, codec: %d/%d", video_stream->sample_aspect_ratio.num, video_stream->sample_aspect_ratio.den, video_stream->codecpar->sample_aspect_ratio.num, video_stream->codecpar->sample_aspect_ratio.den);
+    if (output_video_stream->sample_aspect_ratio.num == 0) {
+        output_video_stream->sample_aspect_ratio = output_video_stream->codecpar->sample_aspect_ratio;
+    }
+    log_debug(LOG_CATEGORY_EXPORT, "video: %d/%d, codec: %d/%d", output_video_stream->sample_aspect_ratio.num, output_video_stream->sample_aspect_ratio.den, output_video_stream->codecpar->sample_aspect_ratio.num, output_video_stream->codecpar->sample_aspect_ratio.den);
+    output_video_stream->disposition = video_stream->disposition;
+    av_dict_copy(&output_video_stream->metadata, video_stream->metadata, 0);
+    output->stream_map.assign(streams.size(), -1);
+    output->stream_map[0] = output_video_stream->index;
+
+    // add audio and subtitle streams
+    for (size_t i = 1; i < streams.size(); i++) {
+        const AVStream* input_stream = streams[i];
+
+        // check if codec is compatible with container
+        if (!avformat_query_codec(output_context->oformat, input_stream->codecpar->codec_id, FF_COMPLIANCE_NORMAL)) {
+            log_warning(LOG_CATEGORY_EXPORT, "Skipping incompatible stream %zu for %s", i, target.target.c_str());
+            continue;
+        }
+
+        // copy stream
+        AVStream* output_stream = avformat_new_stream(output_context, NULL);
+        avcodec_parameters_copy(output_stream->codecpar, input_stream->codecpar);
+        output_stream->codecpar->codec_tag = 0;
+        output_stream->disposition = input_stream->disposition;
+        av_dict_copy(&output_stream->metadata, input_stream->metadata, 0);
+        output->stream_map[i] = output_stream->index;
+    }
+
+    // set max interleave delta
+    output_context->max_interleave_delta = max_interleave_delta;
+
+    // write to the opened output
+    if (output->io != NULL) {
+        output_context->pb = output->io->get_context();
+        output_context->flags |= AVFMT_FLAG_CUSTOM_IO;
+    }
+
+    // pipes cannot seek back, so the muxer must not depend on it
+    AVDictionary* options = NULL;
+    if (streaming) {
+        if (strcmp(output_context->oformat->name, "mp4") == 0 || strcmp(output_context->oformat->name, "mov") == 0) {
+            av_dict_set(&options, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+        } else if (strcmp(output_context->oformat->name, "matroska") == 0 || strcmp(output_context->oformat->name, "webm") == 0) {
+            av_dict_set(&options, "live", "1", 0);
+        }
+    }
+
+    // write the index in front of the packets without rewriting the file
+    if (target.fast_start && !streaming && !segmented) {
+        reserve_index(output, &options);
+    }
+
+    // segments start at the next keyframe after the target duration, the copied keyframes or the ones forced after a cut
+    if (strcmp(output_context->oformat->name, "hls") == 0) {
+        if (target.segment_duration > 0) {
+            av_dict_set_int(&options, "hls_time", target.segment_duration, 0);
+        }
+        av_dict_set(&options, "hls_segment_type", target.segment_format.empty() ? "mpegts" : target.segment_format.c_str(), 0);
+        av_dict_set(&options, "hls_playlist_type", "vod", 0);
+        av_dict_set(&options, "hls_flags", "independent_segments", 0);
+    } else if (strcmp(output_context->oformat->name, "segment") == 0) {
+        if (target.segment_duration > 0) {
+            av_dict_set_int(&options, "segment_time", target.segment_duration, 0);
+        }
+        if (!target.segment_format.empty()) {
+            av_dict_set(&options, "segment_format", target.segment_format.c_str(), 0);
+        }
+    }
+
+    // write header
+    int error = avformat_write_header(output_context, &options);
+    av_dict_free(&options);
+    if (error < 0) {
+        log_error(LOG_CATEGORY_EXPORT, "Failed writing header for %s", target.target.c_str());
+        return false;
+    }
+    output_context->avoid_negative_ts = AVFMT_AVOID_NEG_TS_MAKE_NON_NEGATIVE;
+
+    log_debug(LOG_CATEGORY_EXPORT, "original - frame rate: %d/%d; time_base: %d/%d", video_stream->avg_frame_rate.num, video_stream->avg_frame_rate.den, video_stream->time_base.num, video_stream->time_base.den);
+    log_debug(LOG_CATEGORY_EXPORT, "output   - frame rate: %d/%d; time_base: %d/%d", output_video_stream->avg_frame_rate.num, output_video_stream->avg_frame_rate.den, output_video_stream->time_base.num, output_video_stream->time_base.den);
+    return true;
+}
+
+/**
+ * Close all outputs
+ * @param write_trailer Finish the outputs, otherwise they are just closed
+ * @return True if all outputs were written successfully
+ */
+bool Exporter::close_outputs(bool write_trailer)
+{
+    bool success = true;
+    for (export_output_t& output : outputs) {
+        if (output.format_context != NULL) {
+            if (write_trailer && av_write_trailer(output.format_context) < 0) {
+                success = false;
+            }
+            avformat_free_context(output.format_context);
+        }
+        if (output.io != NULL) {
+            if (output.io->close() < 0) {
+                log_error(LOG_CATEGORY_EXPORT, "Failed writing output");
+                success = false;
+            }
+            log_info(LOG_CATEGORY_EXPORT, "output: %ld bytes written, muxer stalled for %ld ms", output.io->get_bytes_written(), output.io->get_stall_time() / 1000);
+            delete output.io;
+        }
+    }
+    outputs.clear();
+    return success;
+}
+
+/**
+ * Export the cuts into several outputs at once, the sources are read and re-encoded only once
+ * @param targets The outputs to write
+ * @return True on success
+ */
+bool Exporter::run(const std::vector<export_target_t>& targets)
+{
+    int num_cuts = cuts.size();
+    if (!num_cuts) {
+        log_error(LOG_CATEGORY_EXPORT, "cuts missing");
+        return false;
+    }
+    if (targets.empty()) {
+        log_error(LOG_CATEGORY_EXPORT, "outputs missing");
+        return false;
+    }
+
+    // index the groups of pictures around the cut points of quick opened files
+    if (!resolve_cuts(cuts)) {
+        log_error(LOG_CATEGORY_EXPORT, "invalid cuts");
+        return false;
+    }
+
+    // get infos
+    const packet_info_t * frame_infos = cuts[0].media_file->get_frame_info(0);
+
+    // exported streams: the video stream followed by all audio and subtitle streams of the first cut
+    streams.clear();
+    streams.push_back(cuts[0].media_file->get_video_stream());
+    for (int i = 0; i < cuts[0].media_file->get_stream_count(); i++) {
+        const AVStream* input_stream = cuts[0].media_file->get_stream(i);
+        if (input_stream && (input_stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO || input_stream->codecpar->codec_type == AVMEDIA_TYPE_SUBTITLE)) {
+            streams.push_back(input_stream);
+        }
+    }
+    const int video_stream_index = 0;
+    count_output_packets();
+
+    // estimate the output size from the input bytes of all cuts
+    int64_t size_estimate = 0;
+    for (int i = 0; i < num_cuts; i++) {
+        const packet_info_t* infos = cuts[i].media_file->get_frame_info(0);
+        size_estimate += cuts[i].media_file->offset_after_pts(infos[cuts[i].cut_out].pts) - cuts[i].media_file->offset_before_pts(infos[cuts[i].cut_in].pts);
+    }
+
+    // determine max interleave delta
+    int64_t max_interleave_delta = 0;
+    for (ssize_t i = 0; i < cuts[0].media_file->get_frame_count(); i++) {
+        if (frame_infos[i].pts - frame_infos[i].dts > max_interleave_delta) {
+            max_interleave_delta = frame_infos[i].pts - frame_infos[i].dts;
+        }
+    }
+
+    // open outputs
+    for (const export_target_t& target : targets) {
+        outputs.emplace_back();
+        if (!open_target(target, size_estimate, max_interleave_delta, &outputs.back())) {
+            close_outputs(false);
+            return false;
+        }
+    }
+
+    // report progress from the start
+    frame_count = 0;
+    written_frames = 0;
+    for (int i = 0; i < num_cuts; i++) {
+        frame_count += cuts[i].cut_out - cuts[i].cut_in + 1;
+    }
+    if (progress_callback) {
+        progress_callback(0, frame_count);
+    }
+
+    // preparations
+    int64_t* next_pts = (int64_t*) calloc(streams.size(), sizeof(int64_t));
+    int64_t* audio_desync = (int64_t*) calloc(streams.size(), sizeof(int64_t));
+    int64_t next_video_dts = 0;
+    AVCodecContext* encode_context = NULL;
+    MediaFile* encode_source = NULL;
+    bool encoder_drained = true;
+
+    // determine max GOP size and needed difference between dts and pts
+    int64_t max_gop_size = 0;
+    for (int i = 0; i < num_cuts; i++) {
+        if (cuts[i].media_file->get_max_difference() > next_pts[video_stream_index]) {
+            next_pts[video_stream_index] = cuts[i].media_file->get_max_difference();
+        }
+        if (max_gop_size < cuts[i].media_file->get_gop_size()) {
+            max_gop_size = cuts[i].media_file->get_gop_size();
+        }
+    }
+    log_debug(LOG_CATEGORY_EXPORT, "max GOP size: %ld", max_gop_size);
+    for (export_output_t& output : outputs) {
+        output.format_context->max_interleave_delta += 2*max_gop_size*cuts[0].media_file->get_frame_info(0)->duration;
+    }
+
+    // read each source in a single forward pass as far as the cut order allows
+    for (int i = 0; i < num_cuts; i++) {
+        cuts[i].media_file->begin_sequential_read();
+    }
+
+    // announce the byte ranges of all cuts, so they are read ahead
+    for (int i = 0; i < num_cuts; i++) {
+        const packet_info_t* frame_infos = cuts[i].media_file->get_frame_info(0);
+        cuts[i].media_file->plan_read(cuts[i].media_file->offset_before_pts(frame_infos[cuts[i].cut_in].pts), cuts[i].media_file->offset_after_pts(frame_infos[cuts[i].cut_out].pts));
+    }
+
+    // iterate over all cuts
+    for (int i = 0; i < num_cuts; i++) {
+        log_debug(LOG_CATEGORY_EXPORT, "exporting cut %d of %d", i + 1, num_cuts);
+        // get infos
+        const AVStream* video_stream = cuts[i].media_file->get_video_stream();
+        const packet_info_t * frame_infos = cuts[i].media_file->get_frame_info(0);
+
+        // create local stream map
+        std::vector<int> stream_map = map_streams(cuts[i].media_file);
+
+        // get timings
+        ssize_t remux_start = cuts[i].media_file->find_iframe_after(cuts[i].cut_in);
+        ssize_t remux_end = cuts[i].media_file->find_pframe_before(cuts[i].cut_out);
+        int64_t pts_offset = cuts[i].media_file->get_frame_info(cuts[i].cut_in)->pts - next_pts[video_stream_index];
+        log_trace(LOG_CATEGORY_EXPORT, "computed offset: %ld", pts_offset);
+        log_trace(LOG_CATEGORY_EXPORT, "computed remux values: %ld/%ld", remux_start, remux_end);
+
+        // fix small cuts / cuts at end of file
+        if (remux_start > cuts[i].cut_out || remux_start == -1) {
+            remux_start = cuts[i].cut_out + 1;
+            remux_end = cuts[i].cut_out;
+            log_debug(LOG_CATEGORY_EXPORT, "fixed small cut");
+        }
+
+        int64_t unused_dts = 0;
+        for (int j = remux_start - 1; j >= 0 && !frame_infos[j].is_keyframe; j--) {
+            if (frame_infos[j].dts > frame_infos[remux_start].dts) {
+                unused_dts += frame_infos[j].duration;
+            }
+        }
+        log_debug(LOG_CATEGORY_EXPORT, "unused dts: %ld", unused_dts);
+
+        // calculate first pts
+        if (i == 0) {
+            next_pts[video_stream_index] -= unused_dts;
+            pts_offset += unused_dts;
+            for (size_t j = 0; j < streams.size(); j++) {
+                next_pts[j] = next_pts[video_stream_index];
+            }
+            log_debug(LOG_CATEGORY_EXPORT, "first pts: %ld", next_pts[video_stream_index]);
+        }
+
+        // transcode frames before first i-frame
+        if (cuts[i].cut_in < remux_start) {
+            next_video_dts = prepare_encode_context(&encode_context, &encode_source, &encoder_drained, cuts[i].media_file, video_stream_index, next_video_dts);
+            next_video_dts = transcode_video_frames(cuts[i].media_file, cuts[i].cut_in, remux_start-1, video_stream_index, next_video_dts, pts_offset, encode_context, encoder_drained);
+            encoder_drained = false;
+        }
+
+        // log cut operation
+        int64_t packet_length_dts = frame_infos[cuts[i].cut_in].duration;
+        long start_pts = frame_infos[cuts[i].cut_in].pts;
+        long end_pts = frame_infos[cuts[i].cut_out].pts + packet_length_dts;
+        long remux_start_pts = remux_start < cuts[i].media_file->get_frame_count() ? frame_infos[remux_start].pts : -1;
+        long remux_end_pts = frame_infos[remux_end].pts + packet_length_dts;
+        log_debug(LOG_CATEGORY_EXPORT, "cut_in: %zd (%ld); remux_start: %zd (%ld)", cuts[i].cut_in, start_pts, remux_start, remux_start_pts);
+        log_debug(LOG_CATEGORY_EXPORT, "cut_out: %zd (%ld); remux_end: %zd (%ld)", cuts[i].cut_out, end_pts, remux_end, remux_end_pts);
+
+        if (remux_start <= remux_end) {
+            // flush encode context, but keep it for the next transcoded span
+            if (encode_context != NULL && !encoder_drained) {
+                next_video_dts = flush_encode_context(&encode_context, video_stream_index, next_video_dts, frame_infos[remux_end].duration, true);
+                encoder_drained = true;
+            }
+
+            // calculate audio desync
+            int64_t margin = packet_length_dts;
+            if (i > 0) {
+                for (int j = 0; j < cuts[i].media_file->get_stream_count(); j++) {
+                    if (cuts[i].media_file->is_audio_stream(j)) {
+                        const packet_info_t* info = cuts[i].media_file->get_packet_info(j, start_pts);
+                        if (info == NULL || stream_map[j] == -1) {
+                            continue;
+                        }
+                        audio_desync[stream_map[j]] = next_pts[stream_map[j]] - (info->pts - pts_offset);
+                        if (audio_desync[stream_map[j]] < info->duration / -2) {
+                            audio_desync[stream_map[j]] += info->duration;
+                        }
+                        if (audio_desync[stream_map[j]] > info->duration / 2) {
+                            audio_desync[stream_map[j]] -= info->duration;
+                        }
+                        log_debug(LOG_CATEGORY_EXPORT, "audio_desync for stream %d: %ld", stream_map[j], audio_desync[stream_map[j]]);
+                        if (info->duration > margin) {
+                            margin = info->duration;
+                        }
+                    }
+                }
+            }
+
+            for (size_t j = 0; j < streams.size(); j++) {
+                log_debug(LOG_CATEGORY_EXPORT, "next pts (stream %zu): %ld", j, next_pts[j]);
+            }
+
+            // compute the bytes containing all packets that are written
+            int64_t range_start = INT64_MAX;
+            int64_t range_end = -1;
+            cuts[i].media_file->extend_offset_range(video_stream->index, remux_start_pts, remux_end_pts, &range_start, &range_end);
+            for (int j = 0; j < cuts[i].media_file->get_stream_count(); j++) {
+                if (j != video_stream->index && stream_map[j] != -1) {
+                    cuts[i].media_file->extend_offset_range(j, start_pts - margin, end_pts + margin, &range_start, &range_end);
+                }
+            }
+
+            // seek to start
+            if (cuts[i].media_file->seek_offset(range_start) < 0) {
+                for (int j = 0; j < num_cuts; j++) {
+                    cuts[j].media_file->end_sequential_read();
+                    cuts[j].media_file->clear_read_plan();
+                }
+                if (encode_context != NULL) {
+                    avcodec_free_context(&encode_context);
+                }
+                free(next_pts);
+                free(audio_desync);
+                close_outputs(false);
+                return false;
+            }
+
+            // packets are returned once they are complete, e.g. a video PES in MPEG-TS only when the next one starts,
+            // so packets positioned after the range may come before the last needed ones. Read until the video and audio streams
+            // delivered their last needed packet or a packet positioned after the range; sparse streams are not waited for
+            int64_t range_after = cuts[i].media_file->offset_after_range(start_pts - margin, range_end);
+            int64_t last_video_dts = INT64_MIN;
+            for (ssize_t j = std::max(remux_start, cuts[i].media_file->find_iframe_before(remux_end)); j <= remux_end; j++) {
+                last_video_dts = std::max(last_video_dts, frame_infos[j].dts);
+            }
+            std::vector<bool> stream_done(cuts[i].media_file->get_stream_count(), true);
+            int pending_streams = 0;
+            for (int j = 0; j < cuts[i].media_file->get_stream_count(); j++) {
+                if (stream_map[j] != -1 && (j == video_stream->index || cuts[i].media_file->is_audio_stream(j))) {
+                    stream_done[j] = false;
+                    pending_streams++;
+                }
+            }
+
+            // remux frames between first i-frame and last p-frame
+            AVPacket *packet = av_packet_alloc();
+            log_debug(LOG_CATEGORY_EXPORT, "Looping from %ld to %ld", range_start, range_after);
+            log_debug(LOG_CATEGORY_EXPORT, "new pts: %ld to %ld", remux_start_pts, remux_end_pts);
+            while (pending_streams > 0) {
+                av_packet_unref(packet);
+                if (cuts[i].media_file->next_packet(packet)) {
+                    log_error(LOG_CATEGORY_EXPORT, "failed to read packet");
+                    break;
+                }
+                log_trace(LOG_CATEGORY_EXPORT, "Read packet for stream %d with dts %ld, pts %ld and duration %ld", packet->stream_index, packet->dts, packet->pts, packet->duration);
+                if (packet->pos > range_after + REMUX_MAX_OVERREAD) {
+                    log_warning(LOG_CATEGORY_EXPORT, "stopped waiting for %d streams of cut %d", pending_streams, i + 1);
+                    break;
+                }
+
+                if (stream_map[packet->stream_index] == -1) {
+                    continue;
+                }
+                if (packet->pos >= range_after) {
+                    if (!stream_done[packet->stream_index]) {
+                        stream_done[packet->stream_index] = true;
+                        pending_streams--;
+                    }
+                    continue;
+                }
+                if (packet->pts == AV_NOPTS_VALUE || packet->dts == AV_NOPTS_VALUE) {
+                    log_warning(LOG_CATEGORY_EXPORT, "Read packet for stream %d without dts/pts (next pts: %ld)", packet->stream_index, next_pts[stream_map[packet->stream_index]] + pts_offset);
+                    continue;
+                }
+
+                if (cuts[i].media_file->is_audio_stream(packet->stream_index)) {
+                    packet->pts += audio_desync[stream_map[packet->stream_index]];
+                    packet->dts += audio_desync[stream_map[packet->stream_index]];
+                }
+                bool is_last = packet->stream_index == video_stream->index ? packet->dts >= last_video_dts : packet->pts >= end_pts;
+                if (is_last && !stream_done[packet->stream_index]) {
+                    stream_done[packet->stream_index] = true;
+                    pending_streams--;
+                }
+                bool do_write_packet = false;
+                if (packet->stream_index == video_stream->index) {
+                    do_write_packet = packet->pts >= remux_start_pts && packet->pts + packet->duration <= remux_end_pts;
+                    if (packet->pts == remux_start_pts) {
+                        packet->dts += unused_dts;
+                    }
+                } else if (packet->pts - pts_offset >= next_pts[stream_map[packet->stream_index]]) {
+                    do_write_packet = packet->pts + packet->duration <= end_pts;
+                    if (!do_write_packet && cuts[i].media_file->is_audio_stream(packet->stream_index) && i < num_cuts - 1) {
+                        do_write_packet = packet->pts + packet->duration / 2 < end_pts;
+                    }
+                }
+                if (!do_write_packet) {
+                    continue;
+                }
+
+                packet->pts -= pts_offset;
+                packet->dts -= pts_offset;
+                next_pts[stream_map[packet->stream_index]] = packet->pts + packet->duration;
+                if (packet->stream_index == video_stream->index) {
+                    next_video_dts = packet->dts + packet_length_dts;
+                }
+                log_trace(LOG_CATEGORY_EXPORT, "Writing packet for stream %d with dts %ld, pts %ld and duration %ld", stream_map[packet->stream_index], packet->dts, packet->pts, packet->duration);
+                packet->stream_index = stream_map[packet->stream_index];
+                write_packet(packet);
+            }
+            av_packet_free(&packet);
+        }
+
+        if (remux_end < cuts[i].cut_out) {
+            // transcode frames after last p-frame
+            next_video_dts = prepare_encode_context(&encode_context, &encode_source, &encoder_drained, cuts[i].media_file, video_stream_index, next_video_dts);
+            next_video_dts = transcode_video_frames(cuts[i].media_file, remux_end+1, cuts[i].cut_out, video_stream_index, next_video_dts, pts_offset, encode_context, encoder_drained);
+            encoder_drained = false;
+        }
+        next_pts[video_stream_index] = end_pts - pts_offset;
+
+    }
+    for (int i = 0; i < num_cuts; i++) {
+        cuts[i].media_file->end_sequential_read();
+        cuts[i].media_file->clear_read_plan();
+    }
+
+    // flush encode context
+    if (encode_context != NULL) {
+        if (!encoder_drained) {
+            flush_encode_context(&encode_context, video_stream_index, next_video_dts, frame_infos[0].duration);
+        } else {
+            avcodec_free_context(&encode_context);
+        }
+    }
+
+    log_info(LOG_CATEGORY_EXPORT, "transcoded");
+
+    // write trailer and cleanup
+    bool success = close_outputs(true);
+    free(next_pts);
+    free(audio_desync);
+    if (progress_callback) {
+        progress_callback(frame_count, frame_count);
+    }
+    return success;
+}
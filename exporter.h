@@ -0,0 +1,97 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2026 Minei3oat
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef EXPORTER_H
+#define EXPORTER_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "mediafile.h"
+#include "outputio.h"
+
+extern "C" {
+    #include <libavcodec/avcodec.h>
+    #include <libavformat/avformat.h>
+}
+
+// container used for pipes if no format is given
+#define STREAM_DEFAULT_FORMAT "mpegts"
+
+// the pts are authoritative, refining a quick opened file may move the frames, so the indices are resolved from the pts before exporting
+typedef struct cut {
+    MediaFile* media_file = NULL;
+    int64_t first_pts = AV_NOPTS_VALUE;     // taken from cut_in if not set
+    int64_t last_pts = AV_NOPTS_VALUE;      // taken from cut_out if not set
+    ssize_t cut_in = -1;
+    ssize_t cut_out = -1;
+} cut_t;
+
+// segment duration in seconds used by segmenting muxers if none is given
+#define SEGMENT_DEFAULT_DURATION 6
+
+typedef struct export_target {
+    std::string target;
+    std::string format;
+    int segment_duration = SEGMENT_DEFAULT_DURATION;   // target duration of segments in seconds, e.g. for hls
+    std::string segment_format;                         // container of the segments: mpegts or fmp4 for hls
+    bool fast_start = false;                            // reserve the index at the start of mp4 and matroska files
+} export_target_t;
+
+typedef struct export_output {
+    AVFormatContext* format_context = NULL;
+    OutputIO* io = NULL;
+    std::vector<int> stream_map; // exported stream -> output stream or -1 if not compatible
+} export_output_t;
+
+// called after each written video frame with the number of written frames and the total number of frames
+typedef std::function<void(size_t position, size_t total)> export_progress_t;
+
+/**
+ * Exports a list of cuts, copying as much as possible and re-encoding the frames around the cut points.
+ * The sources are read once and every packet is written to all outputs, each output can be a file, a named pipe or stdout ("-" or "pipe:").
+ * Segmenting muxers like hls write their segments and the playlist directly.
+ */
+class Exporter
+{
+public:
+    Exporter(const std::vector<cut_t>& cuts, export_progress_t progress_callback = NULL);
+
+    bool run(const std::string& target, const std::string& format = "");
+    bool run(const std::vector<export_target_t>& targets);
+
+    static bool is_stream_target(const std::string& target);
+    static void set_cut_pts(std::vector<cut_t>& cuts);
+    static bool resolve_cuts(std::vector<cut_t>& cuts);
+
+private:
+    OutputIO* open_output(const std::string& target, int64_t size_estimate);
+    std::vector<int> map_streams(const MediaFile* media_file) const;
+    void count_output_packets();
+    void reserve_index(const export_output_t* output, AVDictionary** options) const;
+    bool open_target(const export_target_t& target, int64_t size_estimate, int64_t max_interleave_delta, export_output_t* output);
+    bool close_outputs(bool write_trailer);
+    int write_packet(AVPacket* packet);
+    static int64_t get_video_bitrate(const MediaFile* media_file, const AVCodecParameters* codecpar);
+    static bool has_encode_parameters(const MediaFile* configured, const MediaFile* media_file, const AVCodecParameters* codecpar);
+    AVCodecContext* get_video_encode_context(MediaFile* media_file, const AVCodecParameters* codecpar);
+    int64_t prepare_encode_context(AVCodecContext** encode_context, MediaFile** encode_source, bool* encoder_drained, MediaFile* media_file, int stream_id, int64_t dts);
+    int64_t flush_encode_context(AVCodecContext** encode_context, int stream_id, int64_t dts, int64_t frame_duration, bool keep_open = false);
+    int64_t transcode_video_frames(MediaFile* media_file, ssize_t cut_in, ssize_t cut_out, int stream_id, int64_t start_dts, int64_t pts_offset, AVCodecContext* encode_context, bool force_keyframe);
+
+    std::vector<cut_t> cuts;
+    export_progress_t progress_callback;
+    std::vector<const AVStream*> streams;
+    std::vector<export_output_t> outputs;
+    std::vector<int64_t> packet_counts;
+    int64_t keyframe_count = 0;
+    AVRational time_base;
+    size_t frame_count = 0;
+    size_t written_frames = 0;
+};
+
+#endif // EXPORTER_H
@@ -0,0 +1,175 @@
+// SPDX-FileCopyrightText: 2023-2026 Minei3oat
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "inputio.h"
+#include "statistics.h"
+#include "tracing.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Open a media file for reading
+ * @param filename The file to open
+ * @param window The number of bytes to read ahead
+ */
+InputIO::InputIO(const std::string& filename, size_t window) : window(window)
+{
+    fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error(strerror(errno));
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    unsigned char* buffer = (unsigned char*) av_malloc(INPUT_IO_BUFFER_SIZE);
+    context = avio_alloc_context(buffer, INPUT_IO_BUFFER_SIZE, 0, this, &InputIO::read, NULL, &InputIO::seek);
+    if (context == NULL) {
+        av_free(buffer);
+        close(fd);
+        throw std::runtime_error("Failed to allocate IO context");
+    }
+}
+
+InputIO::~InputIO()
+{
+    av_freep(&context->buffer);
+    avio_context_free(&context);
+    close(fd);
+}
+
+/**
+ * Add a byte range that will be read, so it is read ahead once the read position gets near
+ * @param start The first byte of the range
+ * @param end The last byte of the range
+ */
+void InputIO::plan(int64_t start, int64_t end)
+{
+    if (end < start) {
+        return;
+    }
+    planned_ranges.emplace_back(start, end + 1);
+    std::sort(planned_ranges.begin(), planned_ranges.end());
+    advised_end = std::min(advised_end, start);
+}
+
+/**
+ * Remove all planned ranges and read ahead sequentially again
+ */
+void InputIO::clear_plan()
+{
+    planned_ranges.clear();
+}
+
+/**
+ * Read callback of the IO context
+ */
+int InputIO::read(void* opaque, uint8_t* buffer, int size)
+{
+    TraceSpan span("read");
+    InputIO* io = (InputIO*) opaque;
+    io->read_ahead();
+
+    ssize_t result;
+    do {
+        result = pread(io->fd, buffer, size, io->position);
+    } while (result < 0 && errno == EINTR);
+    if (result < 0) {
+        return AVERROR(errno);
+    } else if (result == 0) {
+        return AVERROR_EOF;
+    }
+    io->position += result;
+    io->bytes_read += result;
+    static Counter& bytes_read = Statistics::counter("io.bytes_read");
+    bytes_read.add(result);
+    return result;
+}
+
+/**
+ * Seek callback of the IO context
+ */
+int64_t InputIO::seek(void* opaque, int64_t offset, int whence)
+{
+    InputIO* io = (InputIO*) opaque;
+
+    // the file may still grow, so always ask for the current size
+    struct stat info;
+    if (fstat(io->fd, &info) < 0) {
+        return AVERROR(errno);
+    }
+
+    switch (whence & ~AVSEEK_FORCE) {
+        case AVSEEK_SIZE:
+            return info.st_size;
+        case SEEK_SET:
+            break;
+        case SEEK_CUR:
+            offset += io->position;
+            break;
+        case SEEK_END:
+            offset += info.st_size;
+            break;
+        default:
+            return AVERROR(EINVAL);
+    }
+    if (offset < 0) {
+        return AVERROR(EINVAL);
+    }
+
+    // start reading ahead from the new position
+    if (offset < io->position || offset > io->advised_end) {
+        io->advised_end = offset;
+    }
+    io->position = offset;
+    return offset;
+}
+
+/**
+ * Ask the kernel to read the window after the current position, limited to the planned ranges if there are any
+ */
+void InputIO::read_ahead()
+{
+    int64_t window_end = position + window;
+    if (advised_end >= window_end) {
+        return;
+    }
+    int64_t start = std::max(advised_end, position);
+
+    // issue large requests only
+    if (window_end - start < (int64_t) window / 4) {
+        return;
+    }
+
+    if (planned_ranges.empty()) {
+        advise(start, window_end);
+    } else {
+        for (const auto& [range_start, range_end] : planned_ranges) {
+            if (range_end <= start) {
+                continue;
+            } else if (range_start >= window_end) {
+                break;
+            }
+            advise(std::max(range_start, start), std::min(range_end, window_end));
+        }
+    }
+    advised_end = window_end;
+}
+
+/**
+ * Start reading a byte range into the page cache without waiting for it
+ * @param start The first byte to read
+ * @param end The first byte not to read
+ */
+void InputIO::advise(int64_t start, int64_t end)
+{
+    if (posix_fadvise(fd, start, end - start, POSIX_FADV_WILLNEED) != 0) {
+        readahead(fd, start, end - start);
+    }
+}
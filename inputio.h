@@ -0,0 +1,57 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2026 Minei3oat
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef INPUTIO_H
+#define INPUTIO_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+extern "C" {
+    #include <libavformat/avio.h>
+}
+
+// size of the buffer the demuxer reads from
+#define INPUT_IO_BUFFER_SIZE (1 << 20)
+// default number of bytes requested from the kernel ahead of the read position
+#define INPUT_IO_DEFAULT_WINDOW (32 << 20)
+
+/**
+ * Reads a media file for the demuxer with large reads and asks the kernel to read ahead of the demuxer.
+ * If a read plan is set, only the planned byte ranges within the window are read ahead, otherwise the window after the read position.
+ */
+class InputIO
+{
+public:
+    InputIO(const std::string& filename, size_t window = INPUT_IO_DEFAULT_WINDOW);
+    ~InputIO();
+
+    AVIOContext* get_context() const { return context; }
+
+    void set_window(size_t window) { this->window = window; }
+    size_t get_window() const { return window; }
+    int64_t get_bytes_read() const { return bytes_read; }
+    void plan(int64_t start, int64_t end);
+    void clear_plan();
+
+private:
+    static int read(void* opaque, uint8_t* buffer, int size);
+    static int64_t seek(void* opaque, int64_t offset, int whence);
+
+    void read_ahead();
+    void advise(int64_t start, int64_t end);
+
+    int fd = -1;
+    AVIOContext* context = NULL;
+    size_t window;
+    int64_t position = 0;
+    int64_t bytes_read = 0;
+    int64_t advised_end = 0;
+    std::vector<std::pair<int64_t, int64_t>> planned_ranges;
+};
+
+#endif // INPUTIO_H
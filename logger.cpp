@@ -0,0 +1,228 @@
+// SPDX-FileCopyrightText: 2023-2026 Minei3oat
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+// time the writer thread sleeps if the queue is empty
+#define LOG_IDLE_INTERVAL std::chrono::milliseconds(5)
+
+typedef struct log_slot {
+    std::atomic<uint64_t> sequence;
+    char text[LOG_MESSAGE_SIZE];
+} log_slot_t;
+
+static const char* level_names[] = { "trace", "debug", "info", "warning", "error", "off" };
+static const char* category_names[] = { "mediafile", "index", "analysis", "export", "gui" };
+
+std::atomic<log_level_t> Logger::levels[LOG_CATEGORY_COUNT] = { LOG_LEVEL_INFO, LOG_LEVEL_INFO, LOG_LEVEL_INFO, LOG_LEVEL_INFO, LOG_LEVEL_INFO };
+
+// bounded multi-producer single-consumer queue, a slot is free for position p if its sequence is p and filled if it is p + 1
+static log_slot_t slots[LOG_QUEUE_SIZE];
+static std::atomic<uint64_t> enqueue_position { 0 };
+static std::atomic<uint64_t> dequeue_position { 0 };
+static std::atomic<uint64_t> dropped { 0 };
+
+static std::once_flag writer_started;
+static std::thread* writer = NULL;
+static std::atomic<bool> running { false };
+
+/**
+ * Parse a level name
+ * @param name The name of the level
+ * @param level Set to the level if the name is known
+ * @return True if the name is known
+ */
+static bool parse_level(const char* name, log_level_t* level)
+{
+    for (int i = LOG_LEVEL_TRACE; i <= LOG_LEVEL_OFF; i++) {
+        if (strcasecmp(name, level_names[i]) == 0) {
+            *level = (log_level_t) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Read the levels from the environment, MCUT_LOG_LEVEL for all categories and MCUT_LOG_LEVEL_<CATEGORY> to override single ones
+ * @return Always true
+ */
+static bool load_levels()
+{
+    log_level_t level;
+    const char* value = getenv(LOG_LEVEL_ENV);
+    if (value != NULL && parse_level(value, &level)) {
+        for (int i = 0; i < LOG_CATEGORY_COUNT; i++) {
+            Logger::set_level((log_category_t) i, level);
+        }
+    }
+    for (int i = 0; i < LOG_CATEGORY_COUNT; i++) {
+        std::string name = std::string(LOG_LEVEL_ENV) + "_" + category_names[i];
+        for (char& c : name) {
+            c = toupper(c);
+        }
+        value = getenv(name.c_str());
+        if (value != NULL && parse_level(value, &level)) {
+            Logger::set_level((log_category_t) i, level);
+        }
+    }
+    return true;
+}
+
+static const bool levels_loaded = load_levels();
+
+/**
+ * Start the writer thread on the first message
+ */
+void Logger::init()
+{
+    std::call_once(writer_started, []() {
+        for (uint64_t i = 0; i < LOG_QUEUE_SIZE; i++) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        running = true;
+        writer = new std::thread(run);
+        atexit(shutdown);
+    });
+}
+
+/**
+ * Queue a message, it is dropped if the queue is full or the call site exceeded its rate limit
+ * @param category The category of the message
+ * @param level The level of the message
+ * @param site The state of the call site
+ * @param format The printf format of the message, a line break is appended
+ */
+void Logger::write(log_category_t category, log_level_t level, log_site_t* site, const char* format, ...)
+{
+    init();
+
+    // rate limit the call site, trace messages are requested explicitly and only limited by the queue
+    if (level != LOG_LEVEL_TRACE) {
+        int64_t second = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        int64_t previous = site->second.load(std::memory_order_relaxed);
+        if (previous != second && site->second.compare_exchange_strong(previous, second, std::memory_order_relaxed)) {
+            site->count.store(0, std::memory_order_relaxed);
+        }
+        if (site->count.fetch_add(1, std::memory_order_relaxed) >= LOG_RATE_LIMIT) {
+            site->suppressed.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+    int suppressed = site->suppressed.exchange(0, std::memory_order_relaxed);
+
+    // format before claiming a slot, so the writer never waits for a producer
+    char text[LOG_MESSAGE_SIZE];
+    int length = snprintf(text, sizeof(text), "[%s] %s: ", level_names[level], category_names[category]);
+    va_list arguments;
+    va_start(arguments, format);
+    int written = vsnprintf(text + length, sizeof(text) - length, format, arguments);
+    va_end(arguments);
+    length = written < 0 ? length : std::min<int>(length + written, sizeof(text) - 1);
+    if (suppressed > 0) {
+        written = snprintf(text + length, sizeof(text) - length, " (%d similar messages suppressed)", suppressed);
+        length = written < 0 ? length : std::min<int>(length + written, sizeof(text) - 1);
+    }
+
+    // claim a slot
+    uint64_t position = enqueue_position.load(std::memory_order_relaxed);
+    log_slot_t* slot;
+    while (true) {
+        slot = slots + position % LOG_QUEUE_SIZE;
+        uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+        if (sequence == position) {
+            if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (sequence < position) {
+            // the writer has not consumed this slot yet
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            position = enqueue_position.load(std::memory_order_relaxed);
+        }
+    }
+    memcpy(slot->text, text, length + 1);
+    slot->sequence.store(position + 1, std::memory_order_release);
+}
+
+/**
+ * Write the queued messages until the logger is shut down
+ */
+void Logger::run()
+{
+    uint64_t reported_dropped = 0;
+    while (true) {
+        // read running before draining, so nothing queued before shutdown is lost
+        bool stop = !running.load(std::memory_order_acquire);
+        bool wrote = false;
+        uint64_t position = dequeue_position.load(std::memory_order_relaxed);
+        while (true) {
+            log_slot_t* slot = slots + position % LOG_QUEUE_SIZE;
+            if (slot->sequence.load(std::memory_order_acquire) != position + 1) {
+                break;
+            }
+            fputs(slot->text, stdout);
+            fputc('\n', stdout);
+            slot->sequence.store(position + LOG_QUEUE_SIZE, std::memory_order_release);
+            position++;
+            dequeue_position.store(position, std::memory_order_release);
+            wrote = true;
+        }
+        uint64_t current_dropped = dropped.load(std::memory_order_relaxed);
+        if (current_dropped != reported_dropped) {
+            printf("[warning] logger: dropped %lu messages\n", current_dropped - reported_dropped);
+            reported_dropped = current_dropped;
+            wrote = true;
+        }
+        if (wrote) {
+            fflush(stdout);
+        }
+        if (stop) {
+            return;
+        }
+        if (!wrote) {
+            std::this_thread::sleep_for(LOG_IDLE_INTERVAL);
+        }
+    }
+}
+
+/**
+ * Wait until all messages queued so far are written
+ */
+void Logger::flush()
+{
+    if (writer == NULL) {
+        return;
+    }
+    uint64_t position = enqueue_position.load(std::memory_order_relaxed);
+    while (running && dequeue_position.load(std::memory_order_acquire) < position) {
+        // a producer may have claimed a slot without filling it yet, the writer picks it up on its next round
+        std::this_thread::sleep_for(LOG_IDLE_INTERVAL);
+    }
+}
+
+/**
+ * Write the remaining messages and stop the writer thread
+ */
+void Logger::shutdown()
+{
+    flush();
+    running.store(false, std::memory_order_release);
+    writer->join();
+    delete writer;
+    writer = NULL;
+}
@@ -0,0 +1,82 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2026 Minei3oat
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+
+#include <stdint.h>
+
+// environment variables selecting the minimum level (error, warning, info, debug or trace), globally or per category, e.g. MCUT_LOG_LEVEL_INDEX=trace
+#define LOG_LEVEL_ENV "MCUT_LOG_LEVEL"
+// number of messages waiting for the writer thread, further messages are dropped
+#define LOG_QUEUE_SIZE 4096
+// maximum length of a message, longer ones are cut
+#define LOG_MESSAGE_SIZE 256
+// messages per second and call site, further ones are counted and reported with the next message of the site
+#define LOG_RATE_LIMIT 10
+
+typedef enum {
+    LOG_LEVEL_TRACE,
+    LOG_LEVEL_DEBUG,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_WARNING,
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_OFF,
+} log_level_t;
+
+typedef enum {
+    LOG_CATEGORY_MEDIAFILE,     // opening files and decoding frames
+    LOG_CATEGORY_INDEX,         // building and refining the index
+    LOG_CATEGORY_ANALYSIS,      // detecting cut points in the background
+    LOG_CATEGORY_EXPORT,        // remuxing and re-encoding cuts
+    LOG_CATEGORY_GUI,
+    LOG_CATEGORY_COUNT,
+} log_category_t;
+
+// state of a call site for rate limiting
+typedef struct log_site {
+    std::atomic<int64_t> second { -1 };
+    std::atomic<int> count { 0 };
+    std::atomic<int> suppressed { 0 };
+} log_site_t;
+
+/**
+ * Leveled logger with categories. Messages are formatted by the caller and handed to a writer thread through a lock-free queue,
+ * so logging never waits for the terminal. If the queue is full, messages are dropped instead of blocking.
+ * Use the log_* macros, they skip formatting the arguments if the level is disabled.
+ */
+class Logger
+{
+public:
+    static bool is_enabled(log_category_t category, log_level_t level) { return level >= levels[category].load(std::memory_order_relaxed); }
+    static void set_level(log_category_t category, log_level_t level) { levels[category].store(level, std::memory_order_relaxed); }
+    static void write(log_category_t category, log_level_t level, log_site_t* site, const char* format, ...) __attribute__((format(printf, 4, 5)));
+    static void flush();
+
+private:
+    static void init();
+    static void run();
+    static void shutdown();
+
+    static std::atomic<log_level_t> levels[LOG_CATEGORY_COUNT];
+};
+
+#define log_message(category, level, ...) do { \
+    if (Logger::is_enabled(category, level)) { \
+        static log_site_t log_site; \
+        Logger::write(category, level, &log_site, __VA_ARGS__); \
+    } \
+} while (0)
+
+#define log_error(category, ...) log_message(category, LOG_LEVEL_ERROR, __VA_ARGS__)
+#define log_warning(category, ...) log_message(category, LOG_LEVEL_WARNING, __VA_ARGS__)
+#define log_info(category, ...) log_message(category, LOG_LEVEL_INFO, __VA_ARGS__)
+#define log_debug(category, ...) log_message(category, LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define log_trace(category, ...) log_message(category, LOG_LEVEL_TRACE, __VA_ARGS__)
+
+#endif // LOGGER_H
@@ -1,11 +1,32 @@
 #include "mainwindow.h"
+#include "cli.h"
+#include "tracing.h"
+
+#include <stdlib.h>
 
 #include <QApplication>
 
 int main(int argc, char *argv[])
 {
-    QApplication a(argc, argv);
-    MainWindow w;
-    w.show();
-    return a.exec();
+    // record spans of the hot paths and write them on exit
+    const char* trace_filename = getenv(TRACING_ENV);
+    if (trace_filename != NULL && *trace_filename) {
+        Tracing::set_enabled(true);
+    }
+
+    // export without a window
+    int result;
+    if (is_cli_mode(argc, argv)) {
+        result = run_cli(argc, argv);
+    } else {
+        QApplication a(argc, argv);
+        MainWindow w;
+        w.show();
+        result = a.exec();
+    }
+
+    if (trace_filename != NULL && *trace_filename) {
+        Tracing::dump(trace_filename);
+    }
+    return result;
 }
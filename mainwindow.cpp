@@ -4,9 +4,20 @@
 
 #include "mainwindow.h"
 #include "./ui_mainwindow.h"
+#include "logger.h"
+#include "mediafileloader.h"
+#include "splitexporter.h"
+#include "statistics.h"
+#include "tracing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
 
 #include <stdio.h>
-#include <sys/time.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 #include <QFileDialog>
 #include <QJsonArray>
@@ -23,6 +34,7 @@ MainWindow::MainWindow(QWidget *parent)
 {
     ui->setupUi(this);
     ui->statusbar->addWidget(&total_length_label, 1);
+    ui->statusbar->addPermanentWidget(&analysis_label);
     refresh_total_length();
 
     // prepare export progress dialog
@@ -30,10 +42,46 @@ MainWindow::MainWindow(QWidget *parent)
     export_progress.setCancelButton(NULL);
     export_progress.setWindowModality(Qt::ApplicationModal);
     export_progress.reset();
+
+    // poll recordings that are still being written
+    follow_timer.setInterval(FOLLOW_INTERVAL);
+    connect(&follow_timer, &QTimer::timeout, this, &MainWindow::update_followed_files);
+
+    // show the progress of the background analysis
+    analysis_timer.setInterval(ANALYSIS_INTERVAL);
+    connect(&analysis_timer, &QTimer::timeout, this, &MainWindow::update_analysis_progress);
+
+    // previews are replaced by the full quality frame once the position stops changing
+    idle_timer.setInterval(PREVIEW_IDLE_DELAY);
+    idle_timer.setSingleShot(true);
+    connect(&idle_timer, &QTimer::timeout, this, &MainWindow::render_full_quality);
+
+    // show the frames of the playback when they are due
+    playback_timer.setInterval(PLAYBACK_INTERVAL);
+    connect(&playback_timer, &QTimer::timeout, this, &MainWindow::update_playback);
+
+    // traces can only be saved if spans are recorded
+    ui->actionSave_Trace->setEnabled(Tracing::is_enabled());
+
+    // record the navigation for replaying it with mcut_replay
+    if (const char* trace_filename = getenv(NAVIGATION_TRACE_ENV); trace_filename != NULL && *trace_filename) {
+        navigation_trace = new NavigationTrace(trace_filename);
+    }
 }
 
 MainWindow::~MainWindow()
 {
+    delete player;
+    for (SceneAnalyzer* scene_analyzer : scene_analyzers) {
+        delete scene_analyzer;
+    }
+    for (AudioAnalyzer* audio_analyzer : audio_analyzers) {
+        delete audio_analyzer;
+    }
+    for (ProxyGenerator* proxy_generator : proxy_generators) {
+        delete proxy_generator;
+    }
+    delete navigation_trace;
     delete ui;
 }
 
@@ -60,16 +108,37 @@ void MainWindow::change_media_file() {
     // enable/disable buttons
     ui->prev_media_file->setEnabled(current_media_file > 0);
     ui->next_media_file->setEnabled(current_media_file < num_media_files - 1);
-    ui->add_cut->setEnabled(num_cuts < MAX_CUTS - 1 && cut_in <= cut_out && cut_out < media_file->get_frame_count());
+    ui->add_cut->setEnabled(can_add_cut());
     ui->close_video->setEnabled(!in_use);
+    enable_analysis_actions();
 
-    render_frame();
+    render_frame(NAVIGATION_FILE);
+    update_analysis_progress();
 }
 
 void MainWindow::on_actionOpen_Video_triggered()
+{
+    open_video(0);
+}
+
+void MainWindow::on_actionQuick_Open_Video_triggered()
+{
+    open_video(MEDIAFILE_QUICK_OPEN);
+}
+
+void MainWindow::on_actionOpen_Recording_triggered()
+{
+    open_video(MEDIAFILE_FOLLOW);
+}
+
+/**
+ * Select a video file and open it
+ * @param flags The flags to open the media file with
+ */
+void MainWindow::open_video(int flags)
 {
     if (num_media_files >= MAX_MEDIA_FILES) {
-        puts("Maximum number of media files open!");
+        log_warning(LOG_CATEGORY_GUI, "maximum number of media files open");
         return;
     }
 
@@ -79,13 +148,29 @@ void MainWindow::on_actionOpen_Video_triggered()
         return;
     }
 
+    // prepare progress dialog
+    QProgressDialog progress(this);
+    progress.setWindowTitle("Open Video");
+    progress.setMinimumDuration(0);
+    progress.setWindowModality(Qt::ApplicationModal);
+    progress.setValue(0);
+    progress.setLabelText("Building Cache");
+    progress.setCancelButton(NULL);
+    progress.show();
+    QApplication::processEvents();
+
     // load media file
     try {
-        media_files[num_media_files] = new MediaFile(filename);
+        media_files[num_media_files] = new MediaFile(filename, flags, [&progress](int64_t position, int64_t total) {
+            progress.setRange(0, total >> 20);
+            progress.setValue(position >> 20);
+            QApplication::processEvents();
+        });
     } catch(const std::runtime_error& error) {
-        printf("failed to open %s: %s\n", filename.c_str(), error.what());
+        log_error(LOG_CATEGORY_GUI, "failed to open %s: %s", filename.c_str(), error.what());
         return;
     }
+    progress.reset();
 
     // enable all relevant components
     ui->position_slider->setEnabled(true);
@@ -98,9 +183,52 @@ void MainWindow::on_actionOpen_Video_triggered()
     current_media_file = num_media_files;
     num_media_files++;
 
+    if (media_files[current_media_file]->is_following()) {
+        follow_timer.start();
+    }
+    start_analysis(current_media_file);
+    load_proxy(current_media_file);
+
     change_media_file();
 }
 
+/**
+ * Extend the index of all followed media files and update the UI for the current one
+ */
+void MainWindow::update_followed_files()
+{
+    // the export reads from the media files and holds pointers into their caches
+    if (exporting) {
+        return;
+    }
+
+    bool following = false;
+    for (int i = 0; i < num_media_files; i++) {
+        if (!media_files[i]->is_following()) {
+            continue;
+        }
+        following = true;
+
+        ssize_t new_frames = media_files[i]->update_cache();
+        if (new_frames <= 0 || i != current_media_file) {
+            continue;
+        }
+
+        // update UI
+        MediaFile* media_file = media_files[i];
+        ui->position_slider->setMaximum(media_file->get_frame_count() - 1);
+        ui->jump_to_frame->setMaximum(media_file->get_frame_count() - 1);
+        ui->next_frame->setEnabled(media_file->current_frame < media_file->get_frame_count() - 1);
+        ui->next_frame_3->setEnabled(media_file->current_frame < media_file->get_frame_count() - 12);
+        ui->next_frame_2->setEnabled(media_file->current_frame < media_file->get_frame_count() - 48);
+        ui->add_cut->setEnabled(can_add_cut());
+    }
+
+    if (!following) {
+        follow_timer.stop();
+    }
+}
+
 void MainWindow::on_prev_media_file_clicked()
 {
     if (current_media_file <= 0) {
@@ -130,7 +258,7 @@ void MainWindow::on_prev_frame_clicked()
     MediaFile* media_file = media_files[current_media_file];
     if (media_file->current_frame > 0) {
         media_file->current_frame--;
-        render_frame();
+        render_frame(NAVIGATION_STEP);
     }
 }
 
@@ -143,7 +271,7 @@ void MainWindow::on_next_frame_clicked()
     MediaFile* media_file = media_files[current_media_file];
     if (media_file->current_frame < media_file->get_frame_count()-1) {
         media_file->current_frame++;
-        render_frame();
+        render_frame(NAVIGATION_STEP);
     }
 }
 
@@ -158,7 +286,7 @@ void MainWindow::on_prev_frame_2_clicked()
     if (media_file->current_frame < 0) {
         media_file->current_frame = 0;
     }
-    render_frame();
+    render_frame(NAVIGATION_JUMP48);
 }
 
 void MainWindow::on_next_frame_2_clicked()
@@ -172,7 +300,7 @@ void MainWindow::on_next_frame_2_clicked()
     if (media_file->current_frame >= media_file->get_frame_count()) {
         media_file->current_frame = media_file->get_frame_count() - 1;
     }
-    render_frame();
+    render_frame(NAVIGATION_JUMP48);
 }
 
 void MainWindow::on_prev_frame_3_clicked()
@@ -186,7 +314,7 @@ void MainWindow::on_prev_frame_3_clicked()
     if (media_file->current_frame < 0) {
         media_file->current_frame = 0;
     }
-    render_frame();
+    render_frame(NAVIGATION_JUMP12);
 }
 
 void MainWindow::on_next_frame_3_clicked()
@@ -200,7 +328,7 @@ void MainWindow::on_next_frame_3_clicked()
     if (media_file->current_frame >= media_file->get_frame_count()) {
         media_file->current_frame = media_file->get_frame_count() - 1;
     }
-    render_frame();
+    render_frame(NAVIGATION_JUMP12);
 }
 
 void MainWindow::on_position_slider_sliderMoved(int position)
@@ -218,7 +346,7 @@ void MainWindow::on_position_slider_sliderMoved(int position)
     if (target != media_file->current_frame) {
         // printf("Sliding to frame %zd\n", target);
         media_file->current_frame = target;
-        render_frame();
+        render_frame(NAVIGATION_SEEK);
     }
 }
 
@@ -229,7 +357,7 @@ void MainWindow::on_jump_to_frame_returnPressed()
         return;
     }
     media_files[current_media_file]->current_frame = jump;
-    render_frame();
+    render_frame(NAVIGATION_SEEK);
 
     // move focus to next button to enable button shortcuts
     ui->next_frame->setFocus();
@@ -241,9 +369,9 @@ void MainWindow::on_set_cut_in_clicked()
         return;
     }
 
-    cut_in = media_files[current_media_file]->current_frame;
+    cut_in_pts = media_files[current_media_file]->get_frame_info(media_files[current_media_file]->current_frame)->pts;
     ui->cut_in_pos->setText(ui->current_pos->text());
-    ui->add_cut->setEnabled(num_cuts < MAX_CUTS - 1 && cut_in <= cut_out && cut_out < media_files[current_media_file]->get_frame_count());
+    ui->add_cut->setEnabled(can_add_cut());
 }
 
 void MainWindow::on_set_cut_out_clicked()
@@ -252,9 +380,9 @@ void MainWindow::on_set_cut_out_clicked()
         return;
     }
 
-    cut_out = media_files[current_media_file]->current_frame;
+    cut_out_pts = media_files[current_media_file]->get_frame_info(media_files[current_media_file]->current_frame)->pts;
     ui->cut_out_pos->setText(ui->current_pos->text());
-    ui->add_cut->setEnabled(num_cuts < MAX_CUTS - 1 && cut_in <= cut_out && cut_out < media_files[current_media_file]->get_frame_count());
+    ui->add_cut->setEnabled(can_add_cut());
 }
 
 void MainWindow::on_go_cut_in_clicked()
@@ -263,13 +391,13 @@ void MainWindow::on_go_cut_in_clicked()
         return;
     }
 
-    ssize_t frame_count = media_files[current_media_file]->get_frame_count();
-    if (cut_in < frame_count) {
-        media_files[current_media_file]->current_frame = cut_in;
+    ssize_t frame = media_files[current_media_file]->find_frame(cut_in_pts);
+    if (frame >= 0) {
+        media_files[current_media_file]->current_frame = frame;
     } else {
-        media_files[current_media_file]->current_frame = frame_count - 1;
+        media_files[current_media_file]->current_frame = media_files[current_media_file]->get_frame_count() - 1;
     }
-    render_frame();
+    render_frame(NAVIGATION_CUT);
 }
 
 void MainWindow::on_go_cut_out_clicked()
@@ -278,13 +406,13 @@ void MainWindow::on_go_cut_out_clicked()
         return;
     }
 
-    ssize_t frame_count = media_files[current_media_file]->get_frame_count();
-    if (cut_out < frame_count) {
-        media_files[current_media_file]->current_frame = cut_out;
+    ssize_t frame = media_files[current_media_file]->find_last_frame(cut_out_pts);
+    if (frame >= 0) {
+        media_files[current_media_file]->current_frame = frame;
     } else {
-        media_files[current_media_file]->current_frame = frame_count - 1;
+        media_files[current_media_file]->current_frame = 0;
     }
-    render_frame();
+    render_frame(NAVIGATION_CUT);
 }
 
 int MainWindow::sprint_frametime(char* buffer, ssize_t index) {
@@ -301,6 +429,9 @@ QString MainWindow::frame_to_string(MediaFile* media_file, ssize_t index) {
 
     int current = sprint_frametime(buffer, index);
     const packet_info_t* info = media_file->get_frame_info(index);
+    if (info == NULL) {
+        return QString();
+    }
     sprintf(buffer + current, " - %lu [%c] (%ld)", index, av_get_picture_type_char((AVPictureType) info->frame_type), info->pts);
 
     return QString(buffer);
@@ -311,14 +442,19 @@ QString MainWindow::cut_to_string(ssize_t index) {
 
     ssize_t total_frames_before = 0;
     for (int i = 0; i < index; i++) {
-        total_frames_before += cuts[i].cut_out - cuts[i].cut_in + 1;
+        total_frames_before += count_cut_frames(cuts[i]);
+    }
+    ssize_t total_frames_after = total_frames_before + count_cut_frames(cuts[index]);
+    const packet_info_t* first_info = cuts[index].media_file->get_frame_info(cuts[index].media_file->find_frame(cuts[index].first_pts));
+    const packet_info_t* last_info = cuts[index].media_file->get_frame_info(cuts[index].media_file->find_last_frame(cuts[index].last_pts));
+    if (first_info == NULL || last_info == NULL) {
+        return QString();
     }
-    ssize_t total_frames_after = total_frames_before + cuts[index].cut_out - cuts[index].cut_in + 1;
     int current = sprintf(buffer, "[%zd] ", index);
     current += sprint_frametime(buffer + current, total_frames_before);
-    current += sprintf(buffer + current, " (%lu) [%c] - ", total_frames_before, av_get_picture_type_char((AVPictureType) cuts[index].media_file->get_frame_info(cuts[index].cut_in)->frame_type));
+    current += sprintf(buffer + current, " (%lu) [%c] - ", total_frames_before, av_get_picture_type_char((AVPictureType) first_info->frame_type));
     current += sprint_frametime(buffer + current, total_frames_after);
-    current += sprintf(buffer + current, " (%lu) [%c]", total_frames_after, av_get_picture_type_char((AVPictureType) cuts[index].media_file->get_frame_info(cuts[index].cut_out)->frame_type));
+    current += sprintf(buffer + current, " (%lu) [%c]", total_frames_after, av_get_picture_type_char((AVPictureType) last_info->frame_type));
 
     return QString(buffer);
 }
@@ -327,7 +463,7 @@ void MainWindow::refresh_total_length() {
     char buffer[64] = "";
     ssize_t total_frames = 0;
     for (int i = 0; i < num_cuts - 1; i++) {
-        total_frames += cuts[i].cut_out - cuts[i].cut_in + 1;
+        total_frames += count_cut_frames(cuts[i]);
     }
     int current = sprintf(buffer, "%zd cuts - ", num_cuts - 1);
     current += sprint_frametime(buffer + current, total_frames);
@@ -335,6 +471,41 @@ void MainWindow::refresh_total_length() {
     total_length_label.setText(QString(buffer));
 }
 
+/**
+ * Check whether the composed cut can be added
+ * @return True if both cut points are set in order and there is room for another cut
+ */
+bool MainWindow::can_add_cut() const
+{
+    return num_cuts < MAX_CUTS - 1 && cut_in_pts != AV_NOPTS_VALUE && cut_out_pts != AV_NOPTS_VALUE && cut_in_pts <= cut_out_pts;
+}
+
+/**
+ * Count the frames of a cut, they are found by pts, since refining a quick opened file may move them
+ * @param cut The cut to count
+ * @return The number of frames
+ */
+ssize_t MainWindow::count_cut_frames(const cut_t& cut)
+{
+    return cut.media_file->find_last_frame(cut.last_pts) - cut.media_file->find_frame(cut.first_pts) + 1;
+}
+
+/**
+ * Read a cut point of a project. Projects without pts only store the index, which is converted right away
+ * @param cut The cut of the project
+ * @param key Either "cut_in" or "cut_out"
+ * @param media_file The media file of the cut
+ * @return The pts of the cut point or AV_NOPTS_VALUE if it is invalid
+ */
+int64_t MainWindow::read_cut_pts(const QJsonObject& cut, const QString& key, const MediaFile* media_file)
+{
+    if (const QJsonValue v = cut.value(key + "_pts"); v.isDouble()) {
+        return v.toInteger();
+    }
+    const packet_info_t* info = media_file->get_frame_info(cut.value(key).isDouble() ? cut.value(key).toInteger() : 0);
+    return info == NULL ? AV_NOPTS_VALUE : info->pts;
+}
+
 bool MainWindow::can_close()
 {
     while (unsaved) {
@@ -360,8 +531,16 @@ bool MainWindow::can_close()
 
 void MainWindow::close_project()
 {
+    stop_playback();
+
     // close media files
     for (int i = 0; i < num_media_files; i++) {
+        delete scene_analyzers[i];
+        scene_analyzers[i] = NULL;
+        delete audio_analyzers[i];
+        audio_analyzers[i] = NULL;
+        delete proxy_generators[i];
+        proxy_generators[i] = NULL;
         delete media_files[i];
         media_files[i] = NULL;
     }
@@ -397,6 +576,7 @@ void MainWindow::close_project()
     ui->next_cut->setEnabled(false);
     ui->add_cut->setEnabled(false);
     ui->delete_cut->setEnabled(false);
+    enable_analysis_actions();
     ui->video_frame->clear();
     ui->position_slider->setMaximum(1);
     ui->jump_to_frame->setMaximum(1);
@@ -407,6 +587,8 @@ void MainWindow::close_project()
     ui->cut_in_pos->setText("");
     ui->cut_out_pos->setText("");
     ui->current_pos->setText("");
+    analysis_label.setText("");
+    ui->loudness_overview->clear();
     refresh_total_length();
 }
 
@@ -427,8 +609,14 @@ void MainWindow::save_project(QString filename)
     QJsonArray cuts;
     for (int i = 0; i < num_cuts; i++) {
         QJsonObject cut;
-        cut["cut_in"] = (qint64) this->cuts[i].cut_in;
-        cut["cut_out"] = (qint64) this->cuts[i].cut_out;
+        // the indices are kept for older versions, the pts stay valid when refining a quick opened file moves the frames
+        const MediaFile* media_file = this->cuts[i].media_file;
+        cut["cut_in"] = (qint64) (media_file ? media_file->find_frame(this->cuts[i].first_pts) : -1);
+        cut["cut_out"] = (qint64) (media_file ? media_file->find_last_frame(this->cuts[i].last_pts) : -1);
+        if (this->cuts[i].first_pts != AV_NOPTS_VALUE && this->cuts[i].last_pts != AV_NOPTS_VALUE) {
+            cut["cut_in_pts"] = (qint64) this->cuts[i].first_pts;
+            cut["cut_out_pts"] = (qint64) this->cuts[i].last_pts;
+        }
         for (int j = 0; j < num_media_files; j++) {
             if (this->cuts[i].media_file == this->media_files[j]) {
                 cut["media_file"] = j;
@@ -454,20 +642,22 @@ void MainWindow::save_project(QString filename)
 }
 
 void MainWindow::on_add_cut_clicked() {
-    if (current_media_file < 0 || current_media_file >= num_media_files || num_cuts >= MAX_CUTS || cut_in > cut_out) {
+    if (current_media_file < 0 || current_media_file >= num_media_files || num_cuts >= MAX_CUTS || cut_in_pts == AV_NOPTS_VALUE || cut_out_pts == AV_NOPTS_VALUE || cut_in_pts > cut_out_pts) {
         return;
     }
 
-    ssize_t frame_count = media_files[current_media_file]->get_frame_count();
-    if (cut_in < 0 || cut_out < 0 || cut_in >= frame_count || cut_in >= frame_count) {
+    MediaFile* media_file = media_files[current_media_file];
+    ssize_t cut_in = media_file->find_frame(cut_in_pts);
+    ssize_t cut_out = media_file->find_last_frame(cut_out_pts);
+    if (cut_in < 0 || cut_in > cut_out) {
         return;
     }
 
-    printf("Cut %2zd: %8ld - %8ld --- %s\n", current_cut, cut_in, cut_out, media_files[current_media_file]->get_filename().c_str());
+    log_info(LOG_CATEGORY_GUI, "cut %2zd: %8ld - %8ld --- %s", current_cut, cut_in, cut_out, media_file->get_filename().c_str());
 
-    cuts[current_cut].media_file = media_files[current_media_file];
-    cuts[current_cut].cut_in = cut_in;
-    cuts[current_cut].cut_out = cut_out;
+    cuts[current_cut].media_file = media_file;
+    cuts[current_cut].first_pts = cut_in_pts;
+    cuts[current_cut].last_pts = cut_out_pts;
     current_cut++;
 
     // update unsaved
@@ -493,6 +683,7 @@ void MainWindow::on_close_video_clicked()
     if (current_media_file < 0 || current_media_file >= num_media_files) {
         return;
     }
+    stop_playback();
 
     // just close project if only one media file open
     if (num_media_files == 1 && num_cuts == 1) {
@@ -510,10 +701,19 @@ void MainWindow::on_close_video_clicked()
     }
 
     // delete media file
+    delete scene_analyzers[current_media_file];
+    delete audio_analyzers[current_media_file];
+    delete proxy_generators[current_media_file];
     delete media_file;
     memmove(media_files + current_media_file, media_files + current_media_file + 1, sizeof(*media_files) * (num_media_files - current_media_file - 1));
+    memmove(scene_analyzers + current_media_file, scene_analyzers + current_media_file + 1, sizeof(*scene_analyzers) * (num_media_files - current_media_file - 1));
+    memmove(audio_analyzers + current_media_file, audio_analyzers + current_media_file + 1, sizeof(*audio_analyzers) * (num_media_files - current_media_file - 1));
+    memmove(proxy_generators + current_media_file, proxy_generators + current_media_file + 1, sizeof(*proxy_generators) * (num_media_files - current_media_file - 1));
     num_media_files--;
     media_files[num_media_files] = NULL;
+    scene_analyzers[num_media_files] = NULL;
+    audio_analyzers[num_media_files] = NULL;
+    proxy_generators[num_media_files] = NULL;
     current_media_file--;
     if (current_media_file < 0 && num_media_files > 0) {
         current_media_file = 0;
@@ -554,20 +754,21 @@ void MainWindow::change_cut() {
             break;
         }
     }
-    cut_in = cuts[current_cut].cut_in;
-    cut_out = cuts[current_cut].cut_out;
+    cut_in_pts = cuts[current_cut].first_pts;
+    cut_out_pts = cuts[current_cut].last_pts;
 
     // enable/disable buttons
     ui->prev_cut->setEnabled(current_cut > 0);
     ui->next_cut->setEnabled(current_cut < num_cuts - 1);
     ui->delete_cut->setEnabled(current_cut < num_cuts - 1);
-    ui->add_cut->setEnabled(num_cuts < MAX_CUTS - 1 && cut_in <= cut_out && cut_out < cuts[current_cut].media_file->get_frame_count());
+    ui->add_cut->setEnabled(can_add_cut());
     ui->actionCut_Video->setEnabled(num_cuts > 1);
+    ui->actionCut_Separately->setEnabled(num_cuts > 1);
 
     // update resulting cut time
     ui->current_cut->setText(cut_to_string(current_cut));
-    ui->cut_in_pos->setText(frame_to_string(cuts[current_cut].media_file, cut_in));
-    ui->cut_out_pos->setText(frame_to_string(cuts[current_cut].media_file, cut_out));
+    ui->cut_in_pos->setText(frame_to_string(cuts[current_cut].media_file, cuts[current_cut].media_file->find_frame(cut_in_pts)));
+    ui->cut_out_pos->setText(frame_to_string(cuts[current_cut].media_file, cuts[current_cut].media_file->find_last_frame(cut_out_pts)));
 }
 
 void MainWindow::on_prev_cut_clicked() {
@@ -578,10 +779,9 @@ void MainWindow::on_prev_cut_clicked() {
     // save current working cut
     if (current_cut == num_cuts - 1) {
         // only update cut if data is consistent
-        ssize_t frame_count = media_files[current_media_file]->get_frame_count();
-        if (cut_in < frame_count && cut_out < frame_count) {
-            cuts[current_cut].cut_in = cut_in;
-            cuts[current_cut].cut_out = cut_out;
+        if (cut_in_pts != AV_NOPTS_VALUE && cut_out_pts != AV_NOPTS_VALUE) {
+            cuts[current_cut].first_pts = cut_in_pts;
+            cuts[current_cut].last_pts = cut_out_pts;
             cuts[current_cut].media_file = media_files[current_media_file];
         }
     }
@@ -604,44 +804,70 @@ void MainWindow::on_next_cut_clicked() {
 }
 
 /**
- * Render the currently selected frame
+ * Render the currently selected frame. While scrubbing or stepping rapidly, and whenever there is a proxy, a cheaper preview is shown first
+ * @param action The navigation that selected the frame, recorded to the navigation trace
+ * @param full_quality True to always decode the frame from the original file in full quality, this is not recorded
  */
-void MainWindow::render_frame()
+void MainWindow::render_frame(navigation_action_t action, bool full_quality)
 {
     if (current_media_file < 0 || current_media_file >= num_media_files) {
         return;
     }
 
-    struct timeval start, end;
-    gettimeofday(&start, NULL);
+    // the exporter reads the media files, events processed during the export must not seek them
+    if (exporting) {
+        return;
+    }
 
-    MediaFile* media_file = media_files[current_media_file];
+    TraceSpan span("render");
+    stop_playback();
 
-    ui->position_slider->setSliderPosition(media_file->current_frame);
+    MediaFile* media_file = media_files[current_media_file];
+    if (navigation_trace != NULL && !full_quality) {
+        navigation_trace->record(media_file->get_filename(), media_file->current_frame, action);
+    }
 
     // get frame
-    AVFrame* frame = media_file->get_frame(media_file->current_frame);
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    bool interacting = ui->position_slider->isSliderDown() || now - last_render < std::chrono::milliseconds(PREVIEW_IDLE_DELAY);
+    bool preview = !full_quality && (interacting || media_file->has_proxy());
+    if (!full_quality) {
+        last_render = now;
+    }
+    AVFrame* frame = preview ? media_file->get_preview_frame(media_file->current_frame) : media_file->get_frame(media_file->current_frame);
     if (!frame) {
-        puts("frame not found");
+        log_warning(LOG_CATEGORY_GUI, "frame not found");
         return;
     }
 
+    // decoding refines the group of pictures of a quick opened file, which may move the current frame
+    ui->position_slider->setMaximum(media_file->get_frame_count() - 1);
+    ui->jump_to_frame->setMaximum(media_file->get_frame_count() - 1);
+    ui->position_slider->setSliderPosition(media_file->current_frame);
+
     // convert frame to RGB and mind aspect ratio
-    AVFrame *rgb = av_frame_alloc();
-    rgb->format = AV_PIX_FMT_RGB24;
-    if (frame->sample_aspect_ratio.num == 0 || frame->sample_aspect_ratio.den == 0) {
-        rgb->width = frame->width;
-        rgb->height = frame->height;
-    } else if (frame->sample_aspect_ratio.num > frame->sample_aspect_ratio.den) {
-        rgb->width = frame->width * frame->sample_aspect_ratio.num / frame->sample_aspect_ratio.den;
-        rgb->height = frame->height;
+    AVFrame *rgb = MediaFile::convert_to_rgb(frame, preview);
+    display_frame(rgb);
+
+    // show the original once the position settles
+    if (preview) {
+        idle_timer.start();
     } else {
-        rgb->width = frame->width;
-        rgb->height = frame->height * frame->sample_aspect_ratio.den / frame->sample_aspect_ratio.num;
+        idle_timer.stop();
     }
-    av_frame_get_buffer(rgb, 4);
-    struct SwsContext *sws_context = sws_getContext(frame->width, frame->height, (AVPixelFormat)frame->format, rgb->width, rgb->height, (AVPixelFormat)rgb->format, SWS_BILINEAR, NULL, NULL, NULL);
-    sws_scale_frame(sws_context, rgb, frame);
+
+    // cleanup
+    av_frame_free(&frame);
+    av_frame_free(&rgb);
+}
+
+/**
+ * Display a converted frame as the current frame of the current media file
+ * @param rgb The frame converted to RGB
+ */
+void MainWindow::display_frame(const AVFrame* rgb)
+{
+    MediaFile* media_file = media_files[current_media_file];
 
     // render frame
     QImage image(rgb->data[0], rgb->width, rgb->height, QImage::Format_RGB888);
@@ -659,193 +885,119 @@ void MainWindow::render_frame()
     ui->prev_frame->setEnabled(media_file->current_frame > 0);
     ui->prev_frame_3->setEnabled(media_file->current_frame > 11);
     ui->prev_frame_2->setEnabled(media_file->current_frame > 47);
-
-    // cleanup
-    sws_freeContext(sws_context);
-    av_frame_free(&frame);
-    av_frame_free(&rgb);
-
-    gettimeofday(&end, NULL);
-    // printf("rendered frame in %lu us\n", end.tv_usec-start.tv_usec);
 }
 
 /**
- * Write a packet to the output stream
- * @param output_context The format context to write the packet to
- * @param packet The packet to write
- * @return The result from av_interleaved_write_frame
+ * Replace the preview by the frame of the original file in full quality
  */
-int MainWindow::write_packet(AVFormatContext* output_context, AVPacket* packet) {
-    av_packet_rescale_ts(packet, media_files[0]->get_video_stream()->time_base, output_context->streams[0]->time_base);
-#ifdef TRACE
-    printf("Writing output packet for stream %d with dts %ld, pts %ld and duration %ld\n", packet->stream_index, packet->dts, packet->pts, packet->duration);
-#endif
-    if (output_context->streams[packet->stream_index]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-        export_progress.setValue(export_progress.value() + 1);
-        QApplication::processEvents();
+void MainWindow::render_full_quality()
+{
+    if (exporting) {
+        return;
     }
-    return av_interleaved_write_frame(output_context, packet);
+    render_frame(NAVIGATION_SEEK, true);
 }
 
 /**
- * Create an encode context for the given medie file and output stream. The returned codec context must be freed manually
- * @param media_file The media file to get the video encode context for
- * @param output_stream The output stream to encode the video for
- * @return The codec context for encoding the video stream
+ * Start playing the current media file from the current frame, replacing a running playback
+ * @param speed Multiple of real time, negative to play backwards
  */
-AVCodecContext* MainWindow::get_video_encode_context(MediaFile* media_file, AVStream* output_stream) {
-    const AVStream* video_stream = media_file->get_video_stream();
-    const packet_info_t* frame_infos = media_file->get_frame_info(0);
-
-    // get encoder
-    const AVCodec* encoder = avcodec_find_encoder(output_stream->codecpar->codec_id);
-    AVCodecContext* encode_context = avcodec_alloc_context3(encoder);
-    avcodec_parameters_to_context(encode_context, output_stream->codecpar);
-    encode_context->time_base.den = video_stream->avg_frame_rate.num;
-    encode_context->time_base.num = video_stream->avg_frame_rate.den;
-    encode_context->max_b_frames = media_file->get_max_bframes();
-    encode_context->gop_size = media_file->get_gop_size();
-    encode_context->keyint_min = media_file->get_gop_size();
-    printf("gop_size: %d, keyint_min: %d\n", encode_context->gop_size, encode_context->keyint_min);
+void MainWindow::start_playback(int speed)
+{
+    if (exporting || current_media_file < 0 || current_media_file >= num_media_files) {
+        return;
+    }
+    stop_playback();
 
-    // calculate bitrate
-    if (encode_context->bit_rate == 0) {
-        puts("calculating bitrate");
-        ssize_t offset_diff = frame_infos[media_file->get_frame_count()-1].offset - frame_infos[0].offset;
-        encode_context->bit_rate = offset_diff * 8 * video_stream->avg_frame_rate.num / video_stream->avg_frame_rate.den / media_file->get_frame_count();
+    MediaFile* media_file = media_files[current_media_file];
+    const packet_info_t* info = media_file->get_frame_info(media_file->current_frame);
+    if (info == NULL) {
+        return;
+    }
+    try {
+        player = new Player(media_file, info->pts, speed);
+    } catch (const std::runtime_error& error) {
+        log_warning(LOG_CATEGORY_GUI, "failed to play %s: %s", media_file->get_filename().c_str(), error.what());
+        return;
     }
-    printf("encoder: bitrate: %ld; global_quality: %d\n", encode_context->bit_rate, encode_context->global_quality);
-    avcodec_open2(encode_context, encoder, NULL);
 
-    return encode_context;
+    // the full quality frame of the start position is not needed anymore
+    idle_timer.stop();
+    player->start();
+    playback_timer.start();
 }
 
 /**
- * Flush all frames from the encode context into the output context and free the encode context
- * @param encode_context Pointer to the encode context to flush
- * @param output_context The context to write the flushed frames to
- * @param stream_id The stream id of the output stream
- * @param dts The dts value of the first frame that will be flushed
- * @param frame_duration The duration of a frame
- * @return The dts value of the next frame after flushing
+ * Stop playing, the last displayed frame stays the current frame
  */
-int64_t MainWindow::flush_encode_context(AVCodecContext** encode_context, AVFormatContext* output_context, int stream_id, int64_t dts, int64_t frame_duration) {
-    // preparations
-    AVPacket* packet = av_packet_alloc();
-
-    // retrieve remaining encoded packets
-    avcodec_send_frame(*encode_context, NULL);
-    while (avcodec_receive_packet(*encode_context, packet) == 0) {
-        packet->duration = frame_duration;
-        packet->dts = dts;
-        dts += frame_duration;
-#ifdef TRACE
-        printf("Writing transcoded packet for stream %d with dts %ld, pts %ld and duration %ld\n", packet->stream_index, packet->dts, packet->pts, packet->duration);
-#endif
-        packet->stream_index = stream_id;
-        write_packet(output_context, packet);
+void MainWindow::stop_playback()
+{
+    if (player == NULL) {
+        return;
     }
-
-    // cleanup
-    av_packet_free(&packet);
-    avcodec_free_context(encode_context);
-
-    return dts;
+    playback_timer.stop();
+    log_debug(LOG_CATEGORY_GUI, "playback stopped, %zu frames dropped", player->get_dropped_frames());
+    delete player;
+    player = NULL;
 }
 
 /**
- * Transcode video frames
- * @param media_file The source to transcode
- * @param cut_in The first frame to transcode
- * @param cut_out The last frame to transcode
- * @param output_context The AVFormatContext of the output
- * @param output_stream The video stream of the output
- * @param start_dts The dts of the first frame
- * @param pts_offset The difference between the pts in the input and the output
- * @return The dts of the next frame
+ * Display the frame of the playback that is due, the playback stops at the end of the video
  */
-int64_t MainWindow::transcode_video_frames(MediaFile* media_file, ssize_t cut_in, ssize_t cut_out, AVFormatContext* output_context, AVStream* output_stream, int64_t start_dts, int64_t pts_offset, AVCodecContext* encode_context) {
-    const AVStream* video_stream = media_file->get_video_stream();
-    const packet_info_t * frame_infos = media_file->get_frame_info(0);
-
-    AVCodecContext* decode_context = media_file->get_video_decode_context();
-
-    ssize_t current = media_file->find_iframe_before(cut_in);
-
-    // preparations
-    AVPacket* packet = av_packet_alloc();
-    AVFrame* frame = av_frame_alloc();
-
-    // dts correction
-    int64_t dts = start_dts;
-    int64_t duration = frame_infos[cut_in+1].pts - frame_infos[cut_in].pts;
-    printf("packet duration: %ld\n", duration);
-
-    // transcode video packets
-    if (media_file->seek(current) < 0) {
-        return AV_NOPTS_VALUE;
-    }
-    int64_t end_pts = frame_infos[cut_out].pts + duration;
-    int64_t start_pts = frame_infos[cut_in].pts;
-    printf("start_pts: %ld; end_pts = %ld\n", start_pts, end_pts);
-    int64_t last_pts = start_pts;
-    while (last_pts < end_pts) {
-        if (media_file->next_packet(packet)) {
-            puts("failed to read packet");
-            break;
-        }
-
-        // printf("Found packet from stream %d with dts %ld and pts %ld\n", packet->stream_index, packet->dts, packet->pts);
-        if (packet->stream_index == video_stream->index) {
-            avcodec_send_packet(decode_context, packet);
-            while (avcodec_receive_frame(decode_context, frame) == 0) {
-                last_pts = frame->pts;
-                // skip frames just needed for decoding
-                if (frame->pts < start_pts || frame->pts >= end_pts) {
-#ifdef TRACE
-                    printf("skipped frame %zd with dts %ld and pts %ld\n", current, frame->pkt_dts, frame->pts);
-#endif
-                    current++;
-                    continue;
-                }
-
-                // send frame to encoder
-                // printf("got frame %zd with dts %ld and pts %ld\n", current, frame->pkt_dts, frame->pts);
-                frame->pict_type = AV_PICTURE_TYPE_NONE;
-                frame->pts -= pts_offset;
-                // printf("frame duration: %ld\n", frame->duration);
-                avcodec_send_frame(encode_context, frame);
-
-                // retrieve encoded packets
-                while (avcodec_receive_packet(encode_context, packet) == 0) {
-                    packet->duration = duration;
-                    packet->dts = dts;
-                    dts += duration;
-#ifdef TRACE
-                    printf("Writing transcoded packet for stream %d with dts %ld, pts %ld and duration %ld\n", packet->stream_index, packet->dts, packet->pts, packet->duration);
-#endif
-                    packet->stream_index = output_stream->index;
-                    write_packet(output_context, packet);
-                }
+void MainWindow::update_playback()
+{
+    if (player == NULL || current_media_file < 0 || current_media_file >= num_media_files) {
+        return;
+    }
 
-                current++;
-            }
+    MediaFile* media_file = media_files[current_media_file];
+    int64_t pts;
+    AVFrame* rgb = player->take_frame(&pts);
+    if (rgb != NULL) {
+        TraceSpan span("playback");
+        ssize_t frame_index = media_file->find_frame(pts);
+        if (frame_index >= 0) {
+            media_file->current_frame = frame_index;
+            ui->position_slider->setSliderPosition(frame_index);
         }
-        av_packet_unref(packet);
+        display_frame(rgb);
+        av_frame_free(&rgb);
+    } else if (player->is_finished()) {
+        render_full_quality();
     }
+}
 
-    // cleanup
-    av_frame_free(&frame);
-    av_packet_free(&packet);
-    avcodec_free_context(&decode_context);
+void MainWindow::on_actionPlay_Pause_triggered()
+{
+    // rendering stops the playback and shows the current frame in full quality
+    if (player != NULL) {
+        render_full_quality();
+    } else {
+        start_playback(1);
+    }
+}
+
+void MainWindow::on_actionPlay_Forward_triggered()
+{
+    start_playback(player != NULL && player->get_speed() > 0 ? std::min(player->get_speed() * 2, PLAYBACK_MAX_SPEED) : 1);
+}
 
-    return dts;
+void MainWindow::on_actionPlay_Reverse_triggered()
+{
+    start_playback(player != NULL && player->get_speed() < 0 ? std::max(player->get_speed() * 2, -PLAYBACK_MAX_SPEED) : -1);
+}
+
+void MainWindow::on_actionPause_triggered()
+{
+    if (player != NULL) {
+        render_full_quality();
+    }
 }
 
 void MainWindow::on_actionCut_Video_triggered()
 {
     if (!num_cuts) {
-        puts("cuts missing");
+        log_warning(LOG_CATEGORY_GUI, "cuts missing");
         return;
     }
 
@@ -855,312 +1007,62 @@ void MainWindow::on_actionCut_Video_triggered()
         return;
     }
 
-    // open output file
-    AVFormatContext *output_context;
-    avformat_alloc_output_context2(&output_context, NULL, NULL, filename.c_str());
-
-    // get infos
-    const AVStream* video_stream = cuts[0].media_file->get_video_stream();
-    const packet_info_t * frame_infos = cuts[0].media_file->get_frame_info(0);
-
-    // add streams
-    AVStream *output_video_stream = avformat_new_stream(output_context, NULL);
-    avcodec_parameters_copy(output_video_stream->codecpar, video_stream->codecpar);
-    output_video_stream->codecpar->codec_tag = 0;
-    output_video_stream->avg_frame_rate = video_stream->avg_frame_rate;
-    output_video_stream->time_base = video_stream->time_base;
-    printf("video: %d/%d, codec: %d/%d\n", video_stream->sample_aspect_ratio.num, video_stream->sample_aspect_ratio.den, video_stream->codecpar->sample_aspect_ratio.num, video_stream->codecpar->sample_aspect_ratio.den);
-    if (output_video_stream->sample_aspect_ratio.num == 0) {
-        output_video_stream->sample_aspect_ratio = output_video_stream->codecpar->sample_aspect_ratio;
-    }
-    printf("video: %d/%d, codec: %d/%d\n", output_video_stream->sample_aspect_ratio.num, output_video_stream->sample_aspect_ratio.den, output_video_stream->codecpar->sample_aspect_ratio.num, output_video_stream->codecpar->sample_aspect_ratio.den);
-    output_video_stream->disposition = video_stream->disposition;
-    av_dict_copy(&output_video_stream->metadata, video_stream->metadata, 0);
-
-    // analyze streams
-    for (int i = 0; i < cuts[0].media_file->get_stream_count(); i++)
-    {
-        const AVStream* input_stream = cuts[0].media_file->get_stream(i);
-        if (!input_stream) {
-            continue;
-        }
-
-        // only copy audio and subtitle streams
-        if (input_stream->codecpar->codec_type != AVMEDIA_TYPE_AUDIO && input_stream->codecpar->codec_type != AVMEDIA_TYPE_SUBTITLE) {
-            continue;
-        }
-
-        // check if codec is compatible with container
-        if (!avformat_query_codec(output_context->oformat, input_stream->codecpar->codec_id, FF_COMPLIANCE_NORMAL)) {
-            printf("Skipping incompatible stream %d\n", i);
-            continue;
+    // skip last "cut", since we use it to store the cut that is currently composed
+    std::vector<cut_t> export_cuts(cuts, cuts + num_cuts - 1);
+
+    // export with progress dialog, nothing may read the media files meanwhile
+    stop_playback();
+    idle_timer.stop();
+    exporting = true;
+    Exporter exporter(export_cuts, [this](size_t position, size_t total) {
+        if (position == 0) {
+            export_progress.setRange(0, total);
+            export_progress.show();
         }
+        export_progress.setValue(position);
+        QApplication::processEvents();
+    });
+    exporter.run(filename);
+    exporting = false;
+}
 
-        // copy stream
-        AVStream* output_stream = avformat_new_stream(output_context, NULL);
-        avcodec_parameters_copy(output_stream->codecpar, input_stream->codecpar);
-        output_stream->codecpar->codec_tag = 0;
-        output_stream->disposition = input_stream->disposition;
-        av_dict_copy(&output_stream->metadata, input_stream->metadata, 0);
-    }
-
-    // set max interleave delta
-    output_context->max_interleave_delta = 0;
-    for (ssize_t i = 0; i < cuts[0].media_file->get_frame_count(); i++) {
-        if (frame_infos[i].pts - frame_infos[i].dts > output_context->max_interleave_delta) {
-            output_context->max_interleave_delta = frame_infos[i].pts - frame_infos[i].dts;
-        }
+void MainWindow::on_actionCut_Separately_triggered()
+{
+    if (!num_cuts) {
+        log_warning(LOG_CATEGORY_GUI, "cuts missing");
+        return;
     }
 
-    // write header
-    avio_open(&output_context->pb, filename.c_str(), AVIO_FLAG_WRITE);
-    if (avformat_write_header(output_context, NULL) < 0) {
-        puts("Failed writing header");
-        avio_closep(&output_context->pb);
-        avformat_free_context(output_context);
+    // select file, the number of the cut is appended to it
+    std::string filename = QFileDialog::getSaveFileName(this, "Cut Separately").toStdString();
+    if (filename.empty()) {
         return;
     }
 
-    printf("original - frame rate: %d/%d; time_base: %d/%d\n", video_stream->avg_frame_rate.num, video_stream->avg_frame_rate.den, video_stream->time_base.num, video_stream->time_base.den);
-    printf("output   - frame rate: %d/%d; time_base: %d/%d\n", output_video_stream->avg_frame_rate.num, output_video_stream->avg_frame_rate.den, output_video_stream->time_base.num, output_video_stream->time_base.den);
-
-    // prepare progress dialog
-    size_t frame_count = 0;
-    for (int i = 0; i < num_cuts-1; i++) {
-        frame_count += cuts[i].cut_out - cuts[i].cut_in + 1;
-    }
+    // skip last "cut", since we use it to store the cut that is currently composed
+    std::vector<cut_t> export_cuts(cuts, cuts + num_cuts - 1);
+
+    // export concurrently with progress dialog, nothing may read the media files meanwhile
+    stop_playback();
+    idle_timer.stop();
+    exporting = true;
+    SplitExporter exporter(export_cuts, filename);
+    exporter.start();
+    export_progress.setRange(0, exporter.get_total());
     export_progress.setValue(0);
-    export_progress.setRange(0, frame_count);
     export_progress.show();
-    QApplication::processEvents();
-
-    // preparations
-    int64_t* next_pts = (int64_t*) calloc(output_context->nb_streams, sizeof(int64_t));
-    int64_t* audio_desync = (int64_t*) calloc(output_context->nb_streams, sizeof(int64_t));
-    int64_t next_video_dts = 0;
-    AVCodecContext* encode_context = NULL;
-    output_context->avoid_negative_ts = AVFMT_AVOID_NEG_TS_MAKE_NON_NEGATIVE;
-
-    // determine max GOP size and needed difference between dts and pts
-    int64_t max_gop_size = 0;
-    for (int i = 0; i < num_cuts - 1; i++) {
-        if (cuts[i].media_file->get_max_difference() > next_pts[output_video_stream->index]) {
-            next_pts[output_video_stream->index] = cuts[i].media_file->get_max_difference();
-        }
-        if (max_gop_size < cuts[i].media_file->get_gop_size()) {
-            max_gop_size = cuts[i].media_file->get_gop_size();
-        }
-    }
-    printf("max GOP size: %ld\n", max_gop_size);
-    output_context->max_interleave_delta += 2*max_gop_size*cuts[0].media_file->get_frame_info(0)->duration;
-
-    // iterate over all cuts
-    // skip last "cut", since we use it to store the cut that is currently composed
-    for (int i = 0; i < num_cuts - 1; i++) {
-        puts("================================");
-        // get infos
-        const AVStream* video_stream = cuts[i].media_file->get_video_stream();
-        const packet_info_t * frame_infos = cuts[i].media_file->get_frame_info(0);
-
-        // create local stream map
-        int* stream_map = (int*)malloc(cuts[i].media_file->get_stream_count() * sizeof(int));
-        for (int j = 0; j < cuts[i].media_file->get_stream_count(); j++) {
-            int skip = 0;
-            for (int k = 0; k < j; k++) {
-                if (cuts[i].media_file->get_stream(j)->codecpar->codec_id == cuts[i].media_file->get_stream(k)->codecpar->codec_id) {
-                    skip += 1;
-                }
-            }
-            stream_map[j] = -1;
-            for (int k = 0; k < output_context->nb_streams; k++) {
-                if (output_context->streams[k]->codecpar->codec_id == cuts[i].media_file->get_stream(j)->codecpar->codec_id) {
-                    if (skip == 0) {
-                        stream_map[j] = k;
-                        printf("found matching stream: %d -> %d\n", j, k);
-                        break;
-                    } else {
-                        skip -= 1;
-                    }
-                }
-            }
-        }
-
-        // get timings
-        ssize_t remux_start = cuts[i].media_file->find_iframe_after(cuts[i].cut_in);
-        ssize_t remux_end = cuts[i].media_file->find_pframe_before(cuts[i].cut_out);
-        int64_t pts_offset = cuts[i].media_file->get_frame_info(cuts[i].cut_in)->pts - next_pts[output_video_stream->index];
-#ifdef TRACE
-        printf("computed offset: %ld\n", pts_offset);
-        printf("computed remux values: %ld/%ld\n", remux_start, remux_end);
-#endif
-
-        // fix small cuts / cuts at end of file
-        if (remux_start > cuts[i].cut_out || remux_start == -1) {
-            remux_start = cuts[i].cut_out + 1;
-            remux_end = cuts[i].cut_out;
-            puts("fixed small cut");
-        }
-
-        int64_t unused_dts = 0;
-        for (int j = remux_start - 1; j >= 0 && !frame_infos[j].is_keyframe; j--) {
-            if (frame_infos[j].dts > frame_infos[remux_start].dts) {
-                unused_dts += frame_infos[j].duration;
-            }
-        }
-        printf("unused dts: %ld\n", unused_dts);
-
-        // calculate first pts
-        if (i == 0) {
-            next_pts[output_video_stream->index] -= unused_dts;
-            pts_offset += unused_dts;
-            for (int j = 0; j < output_context->nb_streams; j++) {
-                next_pts[j] = next_pts[output_video_stream->index];
-            }
-            printf("first pts: %ld\n", next_pts[output_video_stream->index]);
-        }
-
-        // transcode frames before first i-frame
-        if (cuts[i].cut_in < remux_start) {
-            if (encode_context == NULL) {
-                encode_context = get_video_encode_context(cuts[i].media_file, output_video_stream);
-            }
-            next_video_dts = transcode_video_frames(cuts[i].media_file, cuts[i].cut_in, remux_start-1, output_context, output_video_stream, next_video_dts, pts_offset, encode_context);
-        }
-
-        // log cut operation
-        int64_t packet_length_dts = frame_infos[cuts[i].cut_in].duration;
-        long start_pts = frame_infos[cuts[i].cut_in].pts;
-        long end_pts = frame_infos[cuts[i].cut_out].pts + packet_length_dts;
-        long remux_start_pts = remux_start < cuts[i].media_file->get_frame_count() ? frame_infos[remux_start].pts : -1;
-        long remux_end_pts = frame_infos[remux_end].pts + packet_length_dts;
-        printf("cut_in: %zd (%ld); remux_start: %zd (%ld)\n", cuts[i].cut_in, start_pts, remux_start, remux_start_pts);
-        printf("cut_out: %zd (%ld); remux_end: %zd (%ld)\n", cuts[i].cut_out, end_pts, remux_end, remux_end_pts);
-
-        if (remux_start <= remux_end) {
-            // flush encode context
-            if (encode_context != NULL) {
-                next_video_dts = flush_encode_context(&encode_context, output_context, output_video_stream->index, next_video_dts, frame_infos[remux_end].duration);
-            }
-
-            // calculate audio desync
-            int64_t margin = packet_length_dts;
-            if (i > 0) {
-                for (int j = 0; j < cuts[i].media_file->get_stream_count(); j++) {
-                    if (cuts[i].media_file->is_audio_stream(j)) {
-                        const packet_info_t* info = cuts[i].media_file->get_packet_info(j, start_pts);
-                        if (info == NULL || stream_map[j] == -1) {
-                            continue;
-                        }
-                        audio_desync[stream_map[j]] = next_pts[stream_map[j]] - (info->pts - pts_offset);
-                        if (audio_desync[stream_map[j]] < info->duration / -2) {
-                            audio_desync[stream_map[j]] += info->duration;
-                        }
-                        if (audio_desync[stream_map[j]] > info->duration / 2) {
-                            audio_desync[stream_map[j]] -= info->duration;
-                        }
-                        printf("audio_desync for stream %d: %ld\n", stream_map[j], audio_desync[stream_map[j]]);
-                        if (info->duration > margin) {
-                            margin = info->duration;
-                        }
-                    }
-                }
-            }
-
-            for (int j = 0; j < output_context->nb_streams; j++) {
-                printf("next pts (stream %d): %ld\n", j, next_pts[j]);
-            }
-
-            // seek to start
-            if (cuts[i].media_file->seek(cuts[i].cut_in) < 0) {
-                return;
-            }
-
-            // remux frames between first i-frame and last p-frame
-            AVPacket *packet = av_packet_alloc();
-            int64_t last_offset = cuts[i].media_file->offset_before_pts(frame_infos[cuts[i].cut_in].pts - margin);
-            int64_t loop_end = cuts[i].media_file->offset_after_pts(end_pts + packet_length_dts * cuts[i].media_file->get_gop_size());
-            printf("Looping from %ld to %ld\n", last_offset, loop_end);
-            printf("new pts: %ld to %ld\n", remux_start_pts, remux_end_pts);
-            while (last_offset <= loop_end) {
-                av_packet_unref(packet);
-                if (cuts[i].media_file->next_packet(packet)) {
-                    puts("failed to read packet");
-                    break;
-                }
-#ifdef TRACE
-                printf("Read packet for stream %d with dts %ld, pts %ld and duration %ld\n", packet->stream_index, packet->dts, packet->pts, packet->duration);
-#endif
-                last_offset = packet->pos;
-
-                if (stream_map[packet->stream_index] == -1) {
-                    continue;
-                }
-                if (packet->pts == AV_NOPTS_VALUE || packet->dts == AV_NOPTS_VALUE) {
-                    printf("Read packet for stream %d without dts/pts (next pts: %ld)\n", packet->stream_index, next_pts[stream_map[packet->stream_index]] + pts_offset);
-                    continue;
-                }
-
-                if (cuts[i].media_file->is_audio_stream(packet->stream_index)) {
-                    packet->pts += audio_desync[stream_map[packet->stream_index]];
-                    packet->dts += audio_desync[stream_map[packet->stream_index]];
-                }
-                bool do_write_packet = false;
-                if (packet->stream_index == video_stream->index) {
-                    do_write_packet = packet->pts >= remux_start_pts && packet->pts + packet->duration <= remux_end_pts;
-                    if (packet->pts == remux_start_pts) {
-                        packet->dts += unused_dts;
-                    }
-                } else if (packet->pts - pts_offset >= next_pts[stream_map[packet->stream_index]]) {
-                    do_write_packet = packet->pts + packet->duration <= end_pts;
-                    if (!do_write_packet && cuts[i].media_file->is_audio_stream(packet->stream_index) && i < num_cuts - 2) {
-                        do_write_packet = packet->pts + packet->duration / 2 < end_pts;
-                    }
-                }
-                if (!do_write_packet) {
-                    continue;
-                }
-
-                packet->pts -= pts_offset;
-                packet->dts -= pts_offset;
-                next_pts[stream_map[packet->stream_index]] = packet->pts + packet->duration;
-                if (packet->stream_index == video_stream->index) {
-                    next_video_dts = packet->dts + packet_length_dts;
-                }
-#ifdef TRACE
-                printf("Writing packet for stream %d with dts %ld, pts %ld and duration %ld\n", stream_map[packet->stream_index], packet->dts, packet->pts, packet->duration);
-#endif
-                packet->stream_index = stream_map[packet->stream_index];
-                write_packet(output_context, packet);
-            }
-            av_packet_free(&packet);
-            printf("original - frame rate: %d/%d; time_base: %d/%d\n", video_stream->avg_frame_rate.num, video_stream->avg_frame_rate.den, video_stream->time_base.num, video_stream->time_base.den);
-            printf("output   - frame rate: %d/%d; time_base: %d/%d\n", output_video_stream->avg_frame_rate.num, output_video_stream->avg_frame_rate.den, output_video_stream->time_base.num, output_video_stream->time_base.den);
-        }
-
-        if (remux_end < cuts[i].cut_out) {
-            // transcode frames after last p-frame
-            encode_context = get_video_encode_context(cuts[i].media_file, output_video_stream);
-            next_video_dts = transcode_video_frames(cuts[i].media_file, remux_end+1, cuts[i].cut_out, output_context, output_video_stream, next_video_dts, pts_offset, encode_context);
-        }
-        next_pts[output_video_stream->index] = end_pts - pts_offset;
-
-        free(stream_map);
+    while (!exporter.is_finished()) {
+        export_progress.setValue(exporter.get_position());
+        QApplication::processEvents();
+        std::this_thread::sleep_for(std::chrono::milliseconds(PROGRESS_INTERVAL));
     }
+    exporter.wait();
+    export_progress.reset();
+    exporting = false;
 
-    // flush encode context
-    if (encode_context != NULL) {
-        flush_encode_context(&encode_context, output_context, output_video_stream->index, next_video_dts, frame_infos[0].duration);
+    if (!exporter.is_successful()) {
+        QMessageBox::warning(this, "Cut Separately", "Not all cuts could be exported.");
     }
-
-    puts("transcoded");
-
-    // write trailer
-    av_write_trailer(output_context);
-
-    // cleanup
-    avio_closep(&output_context->pb);
-    avformat_free_context(output_context);
-    export_progress.setValue(frame_count);
 }
 
 
@@ -1194,60 +1096,106 @@ void MainWindow::on_actionOpen_Project_triggered()
     // close current project
     close_project();
 
-    // import files
-    MediaFile** file_mapping = (MediaFile**) calloc(MAX_MEDIA_FILES, sizeof(MediaFile*));
-    size_t file_count = 0;
+    // collect files
+    std::vector<std::string> file_names;
     if (const QJsonValue v = project["files"]; v.isArray()) {
         QJsonArray files = v.toArray();
         for (const QJsonValue &file : files) {
-            if (!file.isString() || num_media_files >= MAX_MEDIA_FILES) {
+            if (!file.isString() || file_names.size() >= MAX_MEDIA_FILES) {
                 continue;
             }
-            std::string media_file_name = file.toString().toStdString();
-            try {
-                media_files[num_media_files] = new MediaFile(media_file_name);
-                file_mapping[file_count] = media_files[num_media_files];
-                num_media_files++;
-            } catch(const std::runtime_error& error) {
-                printf("failed to open %s: %s\n", media_file_name.c_str(), error.what());
-            }
-            file_count++;
+            file_names.push_back(file.toString().toStdString());
         }
     }
-    if (num_media_files == 0) {
-        free(file_mapping);
-        return;
-    }
 
-    // import cuts
+    // collect cuts
+    std::vector<QJsonObject> cut_objects;
     if (const QJsonValue v = project["cuts"]; v.isArray()) {
         QJsonArray cuts = v.toArray();
         for (const QJsonValue &cut : cuts) {
-            if (!cut.isObject() || num_cuts >= MAX_CUTS) {
+            if (!cut.isObject() || num_cuts + (ssize_t) cut_objects.size() >= MAX_CUTS) {
                 continue;
             }
-            QJsonObject cut_obj = cut.toObject();
-            this->cuts[num_cuts].cut_in = 0;
-            this->cuts[num_cuts].cut_out = 0;
-            this->cuts[num_cuts].media_file = media_files[0];
-            if (const QJsonValue v = cut_obj["cut_in"]; v.isDouble()) {
-                this->cuts[num_cuts].cut_in = v.toInteger();
+            cut_objects.push_back(cut.toObject());
+        }
+    }
+
+    // open all files concurrently
+    MediaFileLoader loader(file_names);
+    loader.start();
+
+    // prepare progress dialog
+    QProgressDialog progress(this);
+    progress.setWindowTitle("Open Project");
+    progress.setMinimumDuration(0);
+    progress.setWindowModality(Qt::ApplicationModal);
+    progress.setRange(0, loader.get_total() >> 20);
+    progress.setValue(0);
+    progress.setLabelText("Building Caches");
+    progress.setCancelButton(NULL);
+    progress.show();
+
+    // restore the cuts of each file as soon as it is ready
+    ssize_t first_cut = num_cuts;
+    std::vector<bool> restored(cut_objects.size(), false);
+    std::vector<MediaFile*> file_mapping(file_names.size(), NULL);
+    std::vector<bool> handled(file_names.size(), false);
+    size_t handled_count = 0;
+    while (handled_count < file_names.size()) {
+        for (size_t i = 0; i < file_names.size(); i++) {
+            if (handled[i] || !loader.is_done(i)) {
+                continue;
             }
-            if (const QJsonValue v = cut_obj["cut_out"]; v.isDouble()) {
-                this->cuts[num_cuts].cut_out = v.toInteger();
+            handled[i] = true;
+            handled_count++;
+
+            file_mapping[i] = loader.take(i);
+            if (file_mapping[i] == NULL) {
+                log_error(LOG_CATEGORY_GUI, "failed to open %s: %s", loader.get_filename(i).c_str(), loader.get_error(i).c_str());
+                continue;
             }
-            if (const QJsonValue v = cut_obj["media_file"]; v.isDouble()) {
-                size_t index = v.toInteger();
-                if (index >= 0 && index < file_count && file_mapping[index] != NULL) {
-                    this->cuts[num_cuts].media_file = file_mapping[index];
+
+            for (size_t j = 0; j < cut_objects.size(); j++) {
+                if (const QJsonValue v = cut_objects[j].value("media_file"); v.isDouble() && (size_t) v.toInteger() == i) {
+                    this->cuts[first_cut + j].media_file = file_mapping[i];
+                    this->cuts[first_cut + j].first_pts = read_cut_pts(cut_objects[j], "cut_in", file_mapping[i]);
+                    this->cuts[first_cut + j].last_pts = read_cut_pts(cut_objects[j], "cut_out", file_mapping[i]);
+                    restored[j] = true;
                 }
             }
-            num_cuts++;
+        }
+
+        progress.setValue(loader.get_position() >> 20);
+        QApplication::processEvents();
+        if (handled_count < file_names.size()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(PROGRESS_INTERVAL));
         }
     }
+    progress.reset();
 
-    // cleanup
-    free(file_mapping);
+    // keep the order of the project
+    for (MediaFile* media_file : file_mapping) {
+        if (media_file != NULL) {
+            media_files[num_media_files] = media_file;
+            start_analysis(num_media_files);
+            load_proxy(num_media_files);
+            num_media_files++;
+        }
+    }
+    if (num_media_files == 0) {
+        return;
+    }
+
+    // import cuts
+    // cuts with a missing file fall back to the first file
+    for (size_t j = 0; j < cut_objects.size(); j++) {
+        if (!restored[j]) {
+            this->cuts[num_cuts].media_file = media_files[0];
+            this->cuts[num_cuts].first_pts = read_cut_pts(cut_objects[j], "cut_in", media_files[0]);
+            this->cuts[num_cuts].last_pts = read_cut_pts(cut_objects[j], "cut_out", media_files[0]);
+        }
+        num_cuts++;
+    }
 
     // import current cut
     current_cut = num_cuts - 1;
@@ -1264,7 +1212,7 @@ void MainWindow::on_actionOpen_Project_triggered()
 
     // prepare UI
     change_cut();
-    render_frame();
+    render_frame(NAVIGATION_FILE);
 
     // enable all relevant components
     ui->position_slider->setEnabled(true);
@@ -1301,6 +1249,279 @@ void MainWindow::on_actionExit_triggered()
     close();
 }
 
+/**
+ * Start detecting black frames, scene changes and silence of an opened media file in the background
+ * @param index The index of the media file
+ */
+void MainWindow::start_analysis(ssize_t index)
+{
+    try {
+        scene_analyzers[index] = new SceneAnalyzer(media_files[index]);
+        scene_analyzers[index]->start();
+    } catch (const std::runtime_error& error) {
+        log_warning(LOG_CATEGORY_GUI, "failed to analyze the video of %s: %s", media_files[index]->get_filename().c_str(), error.what());
+    }
+    try {
+        audio_analyzers[index] = new AudioAnalyzer(media_files[index]);
+        audio_analyzers[index]->start();
+    } catch (const std::runtime_error& error) {
+        log_warning(LOG_CATEGORY_GUI, "failed to analyze the audio of %s: %s", media_files[index]->get_filename().c_str(), error.what());
+    }
+    analysis_timer.start();
+}
+
+/**
+ * Use the cached proxy of an opened media file for previews if it was generated before
+ * @param index The index of the media file
+ */
+void MainWindow::load_proxy(ssize_t index)
+{
+    std::string proxy_path = ProxyGenerator::get_proxy_path(media_files[index]->get_filename());
+    if (!proxy_path.empty() && access(proxy_path.c_str(), R_OK) == 0) {
+        media_files[index]->open_proxy(proxy_path);
+    }
+}
+
+/**
+ * Generate proxies for all open media files without one in the background.
+ * Recordings that are still being written are skipped, their proxy would be incomplete
+ */
+void MainWindow::on_actionGenerate_Proxies_triggered()
+{
+    for (int i = 0; i < num_media_files; i++) {
+        if (media_files[i]->has_proxy() || media_files[i]->is_following() || proxy_generators[i] != NULL) {
+            continue;
+        }
+        try {
+            proxy_generators[i] = new ProxyGenerator(media_files[i]);
+            proxy_generators[i]->start();
+        } catch (const std::runtime_error& error) {
+            log_warning(LOG_CATEGORY_GUI, "failed to generate a proxy for %s: %s", media_files[i]->get_filename().c_str(), error.what());
+        }
+    }
+    analysis_timer.start();
+    update_analysis_progress();
+}
+
+/**
+ * Show the analysis progress and loudness of the current media file, the timer is stopped once all analyses are finished
+ */
+void MainWindow::update_analysis_progress()
+{
+    bool analyzing = false;
+    for (int i = 0; i < num_media_files; i++) {
+        if ((scene_analyzers[i] != NULL && !scene_analyzers[i]->is_finished()) || (audio_analyzers[i] != NULL && !audio_analyzers[i]->is_finished())) {
+            analyzing = true;
+        }
+
+        // switch to a proxy as soon as it is complete
+        if (proxy_generators[i] != NULL && proxy_generators[i]->is_finished()) {
+            if (proxy_generators[i]->is_successful()) {
+                media_files[i]->open_proxy(proxy_generators[i]->get_proxy_path());
+            }
+            delete proxy_generators[i];
+            proxy_generators[i] = NULL;
+        } else if (proxy_generators[i] != NULL) {
+            analyzing = true;
+        }
+    }
+    if (!analyzing) {
+        analysis_timer.stop();
+    }
+
+    if (current_media_file < 0 || current_media_file >= num_media_files) {
+        analysis_label.setText("");
+        return;
+    }
+
+    QString text;
+    SceneAnalyzer* scene_analyzer = scene_analyzers[current_media_file];
+    AudioAnalyzer* audio_analyzer = audio_analyzers[current_media_file];
+    if (scene_analyzer != NULL && !scene_analyzer->is_finished()) {
+        text += QString("Analyzing video %1% ").arg((qint64) scene_analyzer->get_progress());
+    }
+    if (audio_analyzer != NULL && !audio_analyzer->is_finished()) {
+        text += QString("Analyzing audio %1% ").arg((qint64) audio_analyzer->get_progress());
+    }
+    if (ProxyGenerator* proxy_generator = proxy_generators[current_media_file]; proxy_generator != NULL) {
+        text += QString("Proxy %1%").arg((qint64) proxy_generator->get_progress());
+    }
+    analysis_label.setText(text);
+    render_loudness();
+}
+
+/**
+ * Draw the loudness of the current media file below the position slider
+ */
+void MainWindow::render_loudness()
+{
+    if (current_media_file < 0 || current_media_file >= num_media_files || audio_analyzers[current_media_file] == NULL) {
+        ui->loudness_overview->clear();
+        return;
+    }
+
+    int width = ui->loudness_overview->width();
+    int height = ui->loudness_overview->height();
+    std::vector<float> levels = audio_analyzers[current_media_file]->get_levels(media_files[current_media_file], width);
+    std::vector<uint8_t> pixels(width * height * 3, 0xff);
+    for (int x = 0; x < width; x++) {
+        if (std::isnan(levels[x])) {
+            continue;
+        }
+
+        // bars from SILENCE_LEVEL to full scale, silence is drawn as a red line
+        int bar = (levels[x] - SILENCE_LEVEL) * height / -SILENCE_LEVEL;
+        bool silent = levels[x] < SILENCE_THRESHOLD;
+        for (int y = height - std::max(bar, 1); y < height; y++) {
+            uint8_t* pixel = pixels.data() + (y * width + x) * 3;
+            pixel[0] = silent ? 0xd0 : 0x60;
+            pixel[1] = silent ? 0x20 : 0x60;
+            pixel[2] = silent ? 0x20 : 0x60;
+        }
+    }
+    QImage image(pixels.data(), width, height, width * 3, QImage::Format_RGB888);
+    ui->loudness_overview->setPixmap(QPixmap::fromImage(image));
+}
+
+/**
+ * Enable the playback and the navigation by the analysis results of the current media file
+ */
+void MainWindow::enable_analysis_actions()
+{
+    bool valid = current_media_file >= 0 && current_media_file < num_media_files;
+    bool scenes = valid && scene_analyzers[current_media_file] != NULL;
+    bool audio = valid && audio_analyzers[current_media_file] != NULL && audio_analyzers[current_media_file]->get_stream_index() >= 0;
+    ui->actionPrevious_Scene_Change->setEnabled(scenes);
+    ui->actionNext_Scene_Change->setEnabled(scenes);
+    ui->actionPrevious_Black_Frame->setEnabled(scenes);
+    ui->actionNext_Black_Frame->setEnabled(scenes);
+    ui->actionPrevious_Silence->setEnabled(audio);
+    ui->actionNext_Silence->setEnabled(audio);
+    ui->actionNext_Suggested_Cut->setEnabled(scenes);
+    ui->actionGenerate_Proxies->setEnabled(valid);
+    ui->actionPlay_Pause->setEnabled(valid);
+    ui->actionPlay_Forward->setEnabled(valid);
+    ui->actionPlay_Reverse->setEnabled(valid);
+    ui->actionPause->setEnabled(valid);
+}
+
+/**
+ * Go to a frame found by the analysis. Frames not analyzed yet are skipped
+ * @param find Searches the frame starting from the given frame of the media file, returns -1 if there is none
+ */
+void MainWindow::jump_to(const std::function<ssize_t(const MediaFile* media_file, ssize_t frame_index)>& find)
+{
+    if (current_media_file < 0 || current_media_file >= num_media_files) {
+        return;
+    }
+
+    MediaFile* media_file = media_files[current_media_file];
+    ssize_t found = find(media_file, media_file->current_frame);
+    if (found < 0) {
+        return;
+    }
+
+    // a quick opened file only needs the group of pictures of the found frame, which rendering refines anyway
+    // refining may move the frames, so search again with the exact index
+    if (media_file->is_quick_open()) {
+        media_file->refine_frame(found);
+        found = find(media_file, media_file->current_frame);
+        if (found < 0) {
+            return;
+        }
+    }
+
+    media_file->current_frame = found;
+    render_frame(NAVIGATION_EVENT);
+}
+
+void MainWindow::on_actionPrevious_Scene_Change_triggered()
+{
+    jump_to([this](const MediaFile* media_file, ssize_t frame_index) {
+        return scene_analyzers[current_media_file] ? scene_analyzers[current_media_file]->find_previous(media_file, frame_index, ANALYSIS_SCENE_CHANGE) : -1;
+    });
+}
+
+void MainWindow::on_actionNext_Scene_Change_triggered()
+{
+    jump_to([this](const MediaFile* media_file, ssize_t frame_index) {
+        return scene_analyzers[current_media_file] ? scene_analyzers[current_media_file]->find_next(media_file, frame_index, ANALYSIS_SCENE_CHANGE) : -1;
+    });
+}
+
+void MainWindow::on_actionPrevious_Black_Frame_triggered()
+{
+    jump_to([this](const MediaFile* media_file, ssize_t frame_index) {
+        return scene_analyzers[current_media_file] ? scene_analyzers[current_media_file]->find_previous(media_file, frame_index, ANALYSIS_BLACK) : -1;
+    });
+}
+
+void MainWindow::on_actionNext_Black_Frame_triggered()
+{
+    jump_to([this](const MediaFile* media_file, ssize_t frame_index) {
+        return scene_analyzers[current_media_file] ? scene_analyzers[current_media_file]->find_next(media_file, frame_index, ANALYSIS_BLACK) : -1;
+    });
+}
+
+void MainWindow::on_actionPrevious_Silence_triggered()
+{
+    jump_to([this](const MediaFile* media_file, ssize_t frame_index) {
+        return audio_analyzers[current_media_file] ? audio_analyzers[current_media_file]->find_previous_silence(media_file, frame_index) : -1;
+    });
+}
+
+void MainWindow::on_actionNext_Silence_triggered()
+{
+    jump_to([this](const MediaFile* media_file, ssize_t frame_index) {
+        return audio_analyzers[current_media_file] ? audio_analyzers[current_media_file]->find_next_silence(media_file, frame_index) : -1;
+    });
+}
+
+void MainWindow::on_actionNext_Suggested_Cut_triggered()
+{
+    if (current_media_file < 0 || current_media_file >= num_media_files || scene_analyzers[current_media_file] == NULL) {
+        return;
+    }
+
+    // take the first suggestion starting at the current frame, that is not already set
+    MediaFile* media_file = media_files[current_media_file];
+    // the cut points are kept as pts, only the group of pictures of the cut in is refined when it is rendered
+    for (const auto& [first_pts, last_pts] : scene_analyzers[current_media_file]->get_suggested_cuts(media_file)) {
+        ssize_t first = media_file->find_frame(first_pts);
+        if (first < media_file->current_frame || (first_pts == cut_in_pts && last_pts == cut_out_pts)) {
+            continue;
+        }
+
+        cut_in_pts = first_pts;
+        cut_out_pts = last_pts;
+        media_file->current_frame = first;
+        render_frame(NAVIGATION_EVENT);
+
+        ui->cut_in_pos->setText(frame_to_string(media_file, media_file->find_frame(cut_in_pts)));
+        ui->cut_out_pos->setText(frame_to_string(media_file, media_file->find_last_frame(cut_out_pts)));
+        ui->add_cut->setEnabled(can_add_cut());
+        return;
+    }
+}
+
+void MainWindow::on_actionStatistics_triggered()
+{
+    QMessageBox statistics(this);
+    statistics.setWindowTitle("Statistics");
+    statistics.setText(QString::fromStdString(Statistics::to_text()));
+    statistics.setStandardButtons(QMessageBox::Close);
+    statistics.exec();
+}
+
+void MainWindow::on_actionSave_Trace_triggered()
+{
+    QString filename = QFileDialog::getSaveFileName(this, "Save Trace", "", "Chrome Trace (*.json)");
+    if (filename.isEmpty()) {
+        return;
+    }
+    Tracing::dump(filename.toStdString());
+}
+
 void MainWindow::on_actionAbout_triggered()
 {
     QMessageBox about(this);
@@ -8,14 +8,29 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
+#include <QJsonObject>
 #include <QKeyEvent>
 #include <QLabel>
 #include <QProgressDialog>
+#include <QTimer>
 
+#include <chrono>
+
+#include "audioanalyzer.h"
+#include "exporter.h"
 #include "mediafile.h"
+#include "navigationtrace.h"
+#include "player.h"
+#include "proxygenerator.h"
+#include "sceneanalyzer.h"
 
 #define MAX_MEDIA_FILES 32
 #define MAX_CUTS 64
+#define FOLLOW_INTERVAL 2000
+#define PROGRESS_INTERVAL 50
+#define ANALYSIS_INTERVAL 1000
+#define PREVIEW_IDLE_DELAY 250
+#define PLAYBACK_INTERVAL 5
 
 extern "C" {
     #include <libavcodec/avcodec.h>
@@ -30,12 +45,6 @@ class MainWindow;
 }
 QT_END_NAMESPACE
 
-typedef struct cut {
-    MediaFile* media_file = NULL;
-    ssize_t cut_in = -1;
-    ssize_t cut_out = -1;
-} cut_t;
-
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
@@ -46,13 +55,32 @@ public:
 
 private slots:
     void on_actionOpen_Video_triggered();
+    void on_actionQuick_Open_Video_triggered();
+    void on_actionOpen_Recording_triggered();
     void on_actionCut_Video_triggered();
+    void on_actionCut_Separately_triggered();
+    void on_actionGenerate_Proxies_triggered();
     void on_actionNew_Project_triggered();
     void on_actionOpen_Project_triggered();
     void on_actionSave_Project_triggered();
     void on_actionSave_Project_As_triggered();
     void on_actionExit_triggered();
 
+    void on_actionPrevious_Scene_Change_triggered();
+    void on_actionNext_Scene_Change_triggered();
+    void on_actionPrevious_Black_Frame_triggered();
+    void on_actionNext_Black_Frame_triggered();
+    void on_actionPrevious_Silence_triggered();
+    void on_actionNext_Silence_triggered();
+    void on_actionNext_Suggested_Cut_triggered();
+
+    void on_actionPlay_Pause_triggered();
+    void on_actionPlay_Forward_triggered();
+    void on_actionPlay_Reverse_triggered();
+    void on_actionPause_triggered();
+
+    void on_actionStatistics_triggered();
+    void on_actionSave_Trace_triggered();
     void on_actionAbout_triggered();
 
     void on_prev_media_file_clicked();
@@ -81,43 +109,67 @@ private slots:
     void on_position_slider_sliderMoved(int position);
     void on_jump_to_frame_returnPressed();
 
+    void update_followed_files();
+    void update_analysis_progress();
+    void render_full_quality();
+    void update_playback();
+
 private:
-    void render_frame();
+    void open_video(int flags);
+    void render_frame(navigation_action_t action, bool full_quality = false);
+    void display_frame(const AVFrame* rgb);
+    void start_playback(int speed);
+    void stop_playback();
     void change_media_file();
     void change_cut();
     void refresh_total_length();
+    bool can_add_cut() const;
+    static ssize_t count_cut_frames(const cut_t& cut);
+    static int64_t read_cut_pts(const QJsonObject& cut, const QString& key, const MediaFile* media_file);
     bool can_close();
     void close_project();
     void save_project(QString filename);
+    void start_analysis(ssize_t index);
+    void load_proxy(ssize_t index);
+    void render_loudness();
+    void enable_analysis_actions();
+    void jump_to(const std::function<ssize_t(const MediaFile* media_file, ssize_t frame_index)>& find);
 
     int sprint_frametime(char* buffer, ssize_t index);
     QString frame_to_string(MediaFile* media_file, ssize_t index);
     QString cut_to_string(ssize_t index);
 
-    int write_packet(AVFormatContext* output_context, AVPacket* packet);
-    AVCodecContext* get_video_encode_context(MediaFile* media_file, AVStream* output_stream);
-    int64_t flush_encode_context(AVCodecContext** encode_context, AVFormatContext* output_context, int stream_id, int64_t dts, int64_t frame_duration);
-    int64_t transcode_video_frames(MediaFile* media_file, ssize_t cut_in, ssize_t cut_out, AVFormatContext* output_context, AVStream* output_stream, int64_t start_dts, int64_t pts_offset, AVCodecContext* encode_context);
-
     void keyReleaseEvent(QKeyEvent* event);
     void closeEvent(QCloseEvent* event);
 
     Ui::MainWindow *ui;
 
     MediaFile* media_files[MAX_MEDIA_FILES] = { };
+    SceneAnalyzer* scene_analyzers[MAX_MEDIA_FILES] = { };
+    AudioAnalyzer* audio_analyzers[MAX_MEDIA_FILES] = { };
+    ProxyGenerator* proxy_generators[MAX_MEDIA_FILES] = { };
     ssize_t current_media_file = -1;
     ssize_t num_media_files = 0;
 
     cut_t cuts[MAX_CUTS];
     ssize_t current_cut = 0;
     ssize_t num_cuts = 1;
-    ssize_t cut_in = 0;
-    ssize_t cut_out = 0;
+    int64_t cut_in_pts = AV_NOPTS_VALUE;
+    int64_t cut_out_pts = AV_NOPTS_VALUE;
     bool unsaved = false;
+    bool exporting = false;
 
     QString filename;
 
     QLabel total_length_label;
     QProgressDialog export_progress;
+    QTimer follow_timer;
+    QLabel analysis_label;
+    QTimer analysis_timer;
+    QTimer idle_timer;
+    std::chrono::steady_clock::time_point last_render;
+    Player* player = NULL;
+    QTimer playback_timer;
+    NavigationTrace* navigation_trace = NULL;
 };
 #endif // MAINWINDOW_H
@@ -3,43 +3,47 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 #include "mediafile.h"
+#include "decoderpool.h"
+#include "inputio.h"
+#include "logger.h"
+#include "statistics.h"
+#include "tracing.h"
 
 #include <algorithm>
+#include <atomic>
 #include <stdexcept>
-
-#include <QApplication>
-#include <QProgressDialog>
+#include <vector>
 
 #include <stdio.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 
 // #define TRACE
 
-MediaFile::MediaFile(const std::string& filename) : filename(filename)
+// number of byte positions probed for keyframes in quick open mode if there is no container index
+#define SPARSE_INDEX_SAMPLES 1024
+#define SPARSE_INDEX_MIN_STRIDE (8 << 20)
+// give up refining a group of pictures if its end keyframe is not found within this distance
+#define SPARSE_INDEX_MAX_OVERREAD (16 << 20)
+// bytes of already read packets kept for replaying in sequential read mode
+#define SEQUENTIAL_READ_BUFFER (64 << 20)
+// read through gaps up to this size instead of seeking in sequential read mode
+#define SEQUENTIAL_READ_MAX_GAP (8 << 20)
+
+// numbers the media files publishing statistics, so files opened twice or sharing a path prefix keep separate entries
+static std::atomic<int> statistics_instances { 0 };
+
+MediaFile::MediaFile(const std::string& filename, int flags, progress_callback_t progress_callback) : filename(filename), flags(flags), progress_callback(progress_callback)
 {
     // get filesize
     struct stat info;
     stat(filename.c_str(), &info);
     filesize = info.st_size;
 
-    // preparations
-    format_context = avformat_alloc_context();
-
     // open file
-    int error = avformat_open_input(&format_context, filename.c_str(), NULL, NULL);
-    if (error < 0) {
-        avformat_free_context(format_context);
-        throw std::runtime_error(av_err2str(error));
-    }
-    printf("Format %s, duration %ld us\n", format_context->iformat->long_name, format_context->duration);
-
-    // find streams
-    error = avformat_find_stream_info(format_context,  NULL);
-    if (error < 0) {
-        avformat_free_context(format_context);
-        throw std::runtime_error(av_err2str(error));
-    }
+    open_input();
+    log_info(LOG_CATEGORY_MEDIAFILE, "format %s, duration %ld us", format_context->iformat->long_name, format_context->duration);
 
     // analyze streams
     for (int i = 0; i < format_context->nb_streams; i++)
@@ -48,100 +52,237 @@ MediaFile::MediaFile(const std::string& filename) : filename(filename)
         AVCodecParameters *local_codec_parameters = stream->codecpar;
         const AVCodec *local_codec = avcodec_find_decoder(local_codec_parameters->codec_id);
         if (local_codec == NULL) {
-            printf("No codec found\n");
+            log_warning(LOG_CATEGORY_MEDIAFILE, "no codec found for stream %d", i);
             continue;
         }
 
         // print stream info
         switch (local_codec_parameters->codec_type) {
             case AVMEDIA_TYPE_VIDEO:
-                printf("Video Codec: resolution %d x %d\n", local_codec_parameters->width, local_codec_parameters->height);
+                log_info(LOG_CATEGORY_MEDIAFILE, "stream %d: video, resolution %d x %d", i, local_codec_parameters->width, local_codec_parameters->height);
                 video_stream = stream;
                 break;
             case AVMEDIA_TYPE_AUDIO:
-                printf("Audio Codec: %d channels, sample rate %d\n", local_codec_parameters->ch_layout.nb_channels, local_codec_parameters->sample_rate);
+                log_info(LOG_CATEGORY_MEDIAFILE, "stream %d: audio, %d channels, sample rate %d", i, local_codec_parameters->ch_layout.nb_channels, local_codec_parameters->sample_rate);
                 break;
             case AVMEDIA_TYPE_SUBTITLE:
-                printf("Subtitle Codec: %s\n", avcodec_get_name(local_codec_parameters->codec_id));
+                log_info(LOG_CATEGORY_MEDIAFILE, "stream %d: subtitle %s", i, avcodec_get_name(local_codec_parameters->codec_id));
                 break;
             default:
-                printf("Unknown Codec: %s\n", avcodec_get_name(local_codec_parameters->codec_id));
+                log_info(LOG_CATEGORY_MEDIAFILE, "stream %d: unknown codec %s", i, avcodec_get_name(local_codec_parameters->codec_id));
                 break;
         }
         // general
-        printf("\tCodec %s ID %d bit_rate %ld\n", local_codec->long_name, local_codec->id, local_codec_parameters->bit_rate);
-        printf("\tDuration %ld us; timebase: %d/%d\n", stream->duration,  stream->time_base.num, stream->time_base.den);
+        log_debug(LOG_CATEGORY_MEDIAFILE, "stream %d: codec %s ID %d bit_rate %ld", i, local_codec->long_name, local_codec->id, local_codec_parameters->bit_rate);
+        log_debug(LOG_CATEGORY_MEDIAFILE, "stream %d: duration %ld; timebase: %d/%d", i, stream->duration, stream->time_base.num, stream->time_base.den);
     }
 
-    // build cache
-    build_cache();
+    // build cache from the best available index source
+    if (build_container_cache(!(flags & MEDIAFILE_QUICK_OPEN))) {
+        index_source = INDEX_SOURCE_CONTAINER;
+        log_info(LOG_CATEGORY_INDEX, "using container index");
+    } else if (flags & MEDIAFILE_QUICK_OPEN && build_sparse_cache()) {
+        index_source = INDEX_SOURCE_SPARSE;
+    } else {
+        build_cache();
+        index_source = INDEX_SOURCE_SCAN;
+    }
+    if (index_source != INDEX_SOURCE_SCAN && flags & MEDIAFILE_FOLLOW) {
+        log_warning(LOG_CATEGORY_INDEX, "following is only supported for fully scanned files");
+        this->flags &= ~MEDIAFILE_FOLLOW;
+    }
 
     // detect hardware decoding
     detect_hardware_decoding();
+
+    statistics_prefix = "index." + std::to_string(statistics_instances++) + ":" + filename;
+    update_index_statistics();
+}
+
+/**
+ * Open another reader for the same file, which can be used from a different thread.
+ * The index is copied, so the source must not be modified while it is cloned.
+ * @param other The media file to clone
+ */
+MediaFile::MediaFile(const MediaFile& other) : filename(other.filename), flags(other.flags & ~MEDIAFILE_FOLLOW), index_source(other.index_source),
+    hw_config(other.hw_config), reorder_length(other.reorder_length), max_bframes(other.max_bframes), gop_size(other.gop_size), filesize(other.filesize),
+    first_pts(other.first_pts), max_difference(other.max_difference)
+{
+    open_input();
+    if (format_context->nb_streams != other.format_context->nb_streams) {
+        avformat_close_input(&format_context);
+        delete input_io;
+        throw std::runtime_error("streams changed");
+    }
+    video_stream = format_context->streams[other.video_stream->index];
+    set_read_ahead(other.input_io->get_window());
+
+    // copy index
+    allocate_cache();
+    for (int i = 0; i < format_context->nb_streams; i++) {
+        reserve_infos(i, other.stream_infos[i].num_infos);
+        memcpy(stream_infos[i].infos, other.stream_infos[i].infos, other.stream_infos[i].num_infos * sizeof(packet_info_t));
+        stream_infos[i].num_infos = other.stream_infos[i].num_infos;
+    }
 }
 
 MediaFile::~MediaFile()
 {
+    if (!statistics_prefix.empty()) {
+        Statistics::remove(statistics_prefix + ".");
+    }
     for (int i = 0; i < format_context->nb_streams; i++) {
         munmap(stream_infos[i].infos, (long)stream_infos[i].infos_end - (long)stream_infos[i].infos);
     }
     free(stream_infos);
+    discard_read_buffer();
+    delete proxy;
+    avcodec_free_context(&codec_context);
     avformat_close_input(&format_context);
+    delete input_io;
 }
 
 
 /**
- * Read all packets from file and extract relevant infos to cache them
+ * Open the file through an own IO context and read the stream infos
+ */
+void MediaFile::open_input()
+{
+    input_io = new InputIO(filename);
+    format_context = avformat_alloc_context();
+    format_context->pb = input_io->get_context();
+    format_context->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+    // open file
+    int error = avformat_open_input(&format_context, filename.c_str(), NULL, NULL);
+    if (error < 0) {
+        avformat_free_context(format_context);
+        delete input_io;
+        throw std::runtime_error(av_err2str(error));
+    }
+
+    // find streams
+    error = avformat_find_stream_info(format_context,  NULL);
+    if (error < 0) {
+        avformat_close_input(&format_context);
+        delete input_io;
+        throw std::runtime_error(av_err2str(error));
+    }
+}
+
+/**
+ * Allocate a minimalistic cache for all streams or empty the existing one
  */
-void MediaFile::build_cache()
+void MediaFile::allocate_cache()
 {
-    // allocate minimalistic cache for all streams
+    if (stream_infos != NULL) {
+        for (int i = 0; i < format_context->nb_streams; i++) {
+            stream_infos[i].num_infos = 0;
+        }
+        return;
+    }
+
     stream_infos = (stream_info_t*) malloc(sizeof(stream_info_t) * format_context->nb_streams);
     for (int i = 0; i < format_context->nb_streams; i++) {
         stream_infos[i].infos = (packet_info_t*) mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
         stream_infos[i].num_infos = 0;
         stream_infos[i].infos_end = (packet_info_t*) ((unsigned long) stream_infos[i].infos + 4096);
     }
+}
 
-    // get decoder
-    const AVCodec *decoder = avcodec_find_decoder(video_stream->codecpar->codec_id);
-    AVCodecContext *decode_context = avcodec_alloc_context3(decoder);
-    avcodec_parameters_to_context(decode_context, video_stream->codecpar);
-    avcodec_open2(decode_context, decoder, NULL);
+/**
+ * Extend the info area of a stream, so it can hold at least the given number of infos
+ * @param stream_index The index of the stream
+ * @param count The number of infos needed
+ */
+void MediaFile::reserve_infos(int stream_index, ssize_t count)
+{
+    stream_info_t* stream_info = stream_infos + stream_index;
+    if (stream_info->infos_end >= stream_info->infos + count) {
+        return;
+    }
+
+    long old_size = (unsigned long) stream_info->infos_end - (unsigned long) stream_info->infos;
+    long new_size = old_size + 4096;
+    if (new_size < (long) (count * sizeof(packet_info_t))) {
+        new_size = (count * sizeof(packet_info_t) + 4095) & ~4095L;
+    }
+    // printf("remap area for stream %d (old %#lx): %p\n", stream_index, old_size, stream_info->infos);
+    stream_info->infos = (packet_info_t*) mremap(stream_info->infos, old_size, new_size, MREMAP_MAYMOVE);
+    // printf("remap area for stream %d (new %#lx): %p\n", stream_index, new_size, stream_info->infos);
+    if (stream_info->infos == MAP_FAILED) {
+        perror("mremap failed");
+        exit(EXIT_FAILURE);
+    }
+    stream_info->infos_end = (packet_info_t*) ((unsigned long) stream_info->infos + new_size);
+}
+
+/**
+ * Read all packets from file and extract relevant infos to cache them
+ * @param video_only Only replace the cache of the video stream and keep the others
+ */
+void MediaFile::build_cache(bool video_only)
+{
+    if (video_only) {
+        stream_infos[video_stream->index].num_infos = 0;
+    } else {
+        allocate_cache();
+    }
 
     // preparations
     AVPacket *packet = av_packet_alloc();
 
-    // prepare progress dialog
-    QProgressDialog progress(NULL, Qt::WindowFlags(Qt::Dialog));
-    progress.setWindowTitle("Open Video");
-    progress.setMinimumDuration(0);
-    progress.setWindowModality(Qt::ApplicationModal);
-    progress.setValue(0);
-    progress.setRange(0, filesize >> 20);
-    progress.setLabelText("Building Cache");
-    progress.setCancelButton(NULL);
-    progress.show();
-    QApplication::processEvents();
+    // report progress from the start
+    reported_progress = -1;
+    report_progress(0);
 
     // find all frames
     reorder_length = 0;
-    int frame_count = 0;
-    packet_info_t *current = stream_infos[video_stream->index].infos;
-    long start_pts = LONG_MIN;
+    first_pts = LONG_MIN;
     while (av_read_frame(format_context, packet) == 0) {
-        if (packet->pos != -1 && packet->pos >> 20 > progress.value()) {
-            progress.setValue(packet->pos >> 20);
-            QApplication::processEvents();
+        report_progress(packet->pos);
+        if (video_only && packet->stream_index != video_stream->index) {
+            av_packet_unref(packet);
+            continue;
         }
-        if (packet->flags & AV_PKT_FLAG_CORRUPT && frame_count) {
-            printf("found corrupt packet in stream %d at pts %ld\n", packet->stream_index, packet->pts);
+        index_packet(packet);
+        av_packet_unref(packet);
+    }
+
+    // fix last packets
+    // skip this while following, since the last group of pictures is still incomplete
+    for (ssize_t i = stream_infos[video_stream->index].num_infos-1; i >= 0 && !(flags & MEDIAFILE_FOLLOW) && !stream_infos[video_stream->index].infos[i].is_keyframe; i--) {
+        packet_info_t *current = stream_infos[video_stream->index].infos + i;
+        if (current->frame_type == AV_PICTURE_TYPE_NONE) {
+            AVFrame* frame = get_frame(i);
+            if (frame) {
+                current->frame_type = frame->pict_type;
+                av_frame_free(&frame);
+            }
         }
+    }
+
+    analyze_cache();
+
+    // cleanup
+    av_packet_free(&packet);
+    report_progress(filesize);
+}
 
-        // logging
-#ifdef TRACE
+/**
+ * Add the info of a packet read in file order to the cache of its stream
+ * @param packet The packet to add
+ */
+void MediaFile::index_packet(const AVPacket* packet)
+{
+    if (packet->flags & AV_PKT_FLAG_CORRUPT && stream_infos[video_stream->index].num_infos) {
+        log_warning(LOG_CATEGORY_INDEX, "found corrupt packet in stream %d at pts %ld", packet->stream_index, packet->pts);
+    }
+
+    // logging, the per packet details are only prepared if they are written
+    if (Logger::is_enabled(LOG_CATEGORY_INDEX, LOG_LEVEL_TRACE)) {
         AVStream* stream = format_context->streams[packet->stream_index];
-        float timestamp = (packet->pts - start_pts) * stream->time_base.num * 1.0 / stream->time_base.den;
+        float timestamp = (packet->pts - first_pts) * stream->time_base.num * 1.0 / stream->time_base.den;
         std::string stream_type = "unknown";
         switch (stream->codecpar->codec_type) {
             case AVMEDIA_TYPE_VIDEO:
@@ -156,101 +297,138 @@ void MediaFile::build_cache()
             default:
                 break;
         }
-        printf("found %s packet of stream %d with duration %ld at %10lu with pts %ld (%.3f) and dts %ld; is key: %d; is corrupt: %d\n", stream_type.c_str(), packet->stream_index, packet->duration, packet->pos, packet->pts, timestamp, packet->dts, packet->flags & AV_PKT_FLAG_KEY, packet->flags & AV_PKT_FLAG_CORRUPT);
-#endif
-
-        // extend info area if needed
-        stream_info_t* stream_info = stream_infos + packet->stream_index;
-        if (stream_info->infos_end < stream_info->infos + stream_info->num_infos + 2) {
-            long old_size = (unsigned long) stream_info->infos_end - (unsigned long) stream_info->infos;
-            // printf("remap area for stream %d (old %#lx): %p\n", packet->stream_index, old_size, stream_info->infos);
-            stream_info->infos = (packet_info_t*) mremap(stream_info->infos, old_size, old_size + 4096, MREMAP_MAYMOVE);
-            // printf("remap area for stream %d (new %#lx): %p\n", packet->stream_index, old_size + 4096, stream_info->infos);
-            if (stream_info->infos == MAP_FAILED) {
-                perror("mremap failed");
-                exit(EXIT_FAILURE);
-            }
-            stream_info->infos_end = (packet_info_t*) ((unsigned long) stream_info->infos + old_size + 4096);
-        }
+        log_trace(LOG_CATEGORY_INDEX, "found %s packet of stream %d with duration %ld at %10lu with pts %ld (%.3f) and dts %ld; is key: %d; is corrupt: %d", stream_type.c_str(), packet->stream_index, packet->duration, packet->pos, packet->pts, timestamp, packet->dts, packet->flags & AV_PKT_FLAG_KEY, packet->flags & AV_PKT_FLAG_CORRUPT);
+    }
 
-        packet_info_t* destination = stream_info->infos + stream_info->num_infos;
-        if (packet->stream_index == video_stream->index) {
-            // skip to first key frame and ignore frames with a pts before first keyframe
-            if ((frame_count == 0 && !(packet->flags & AV_PKT_FLAG_KEY)) || packet->pts < start_pts) {
-                continue;
-            } else if (frame_count == 0) {
-                start_pts = packet->pts;
-            }
+    // extend info area if needed
+    stream_info_t* stream_info = stream_infos + packet->stream_index;
+    reserve_infos(packet->stream_index, stream_info->num_infos + 2);
+
+    packet_info_t* destination = stream_info->infos + stream_info->num_infos;
+    if (packet->stream_index == video_stream->index) {
+        // skip to first key frame and ignore frames with a pts before first keyframe
+        if ((stream_info->num_infos == 0 && !(packet->flags & AV_PKT_FLAG_KEY)) || packet->pts < first_pts) {
+            return;
+        } else if (stream_info->num_infos == 0) {
+            first_pts = packet->pts;
+        }
 
-            int bframes = 1;
-            while (destination > stream_info->infos && (destination-1)->pts > packet->pts) {
-                if ((destination-1)->frame_type != AV_PICTURE_TYPE_I && (destination-1)->frame_type != AV_PICTURE_TYPE_P) {
-                    bframes++;
-                }
-                memcpy(destination, destination-1, sizeof(*destination));
-                destination--;
+        int bframes = 1;
+        while (destination > stream_info->infos && (destination-1)->pts > packet->pts) {
+            if ((destination-1)->frame_type != AV_PICTURE_TYPE_I && (destination-1)->frame_type != AV_PICTURE_TYPE_P) {
+                bframes++;
             }
-            frame_count++;
+            memcpy(destination, destination-1, sizeof(*destination));
+            destination--;
+        }
 
-            // get frame type
-            AVCodecParserContext *parser_context = av_stream_get_parser(video_stream);
-            if (parser_context) {
-                destination->frame_type = (AVPictureType) parser_context->pict_type;
-            } else {
-                printf("parser context was null\n");
-                // this can produce an endless loop, duplicate frames, ... as it changes the file pointer
-                //AVFrame *frame = get_frame(frame_count-1);
-                //if (frame) {
-                //    destination->frame_type = frame->pict_type;
-                //} else {
-                    destination->frame_type = AV_PICTURE_TYPE_NONE;
-                //}
-            }
-            if (destination->frame_type != AV_PICTURE_TYPE_I && destination->frame_type != AV_PICTURE_TYPE_P && bframes > reorder_length) {
-                reorder_length = bframes;
-            }
-            destination->offset = packet->pos;
+        // get frame type
+        AVCodecParserContext *parser_context = av_stream_get_parser(video_stream);
+        if (parser_context) {
+            destination->frame_type = (AVPictureType) parser_context->pict_type;
         } else {
-            int64_t pos = packet->pos;
-            for (packet_info_t* current = destination - 1; pos == -1 && current >= stream_info->infos; current--) {
-                pos = current->offset;
-            }
-            if (pos == -1) {
-                pos = 0;
-            }
-            destination->offset = pos;
-            destination->frame_type = AV_PICTURE_TYPE_NONE;
+            log_warning(LOG_CATEGORY_INDEX, "parser context was null");
+            // this can produce an endless loop, duplicate frames, ... as it changes the file pointer
+            //AVFrame *frame = get_frame(stream_info->num_infos);
+            //if (frame) {
+            //    destination->frame_type = frame->pict_type;
+            //} else {
+                destination->frame_type = AV_PICTURE_TYPE_NONE;
+            //}
+        }
+        if (destination->frame_type != AV_PICTURE_TYPE_I && destination->frame_type != AV_PICTURE_TYPE_P && bframes > reorder_length) {
+            reorder_length = bframes;
         }
-        destination->pts = packet->pts;
-        destination->dts = packet->dts;
-        destination->duration = packet->duration;
-        destination->is_keyframe = packet->flags & AV_PKT_FLAG_KEY;
-        destination->is_corrupt  = packet->flags & AV_PKT_FLAG_CORRUPT;
-        stream_info->num_infos++;
+        destination->offset = packet->pos;
+    } else {
+        int64_t pos = packet->pos;
+        for (packet_info_t* current = destination - 1; pos == -1 && current >= stream_info->infos; current--) {
+            pos = current->offset;
+        }
+        if (pos == -1) {
+            pos = 0;
+        }
+        destination->offset = pos;
+        destination->frame_type = AV_PICTURE_TYPE_NONE;
+    }
+    destination->pts = packet->pts;
+    destination->dts = packet->dts;
+    destination->duration = packet->duration;
+    destination->is_keyframe = packet->flags & AV_PKT_FLAG_KEY;
+    destination->is_corrupt  = packet->flags & AV_PKT_FLAG_CORRUPT;
+    destination->is_estimated = false;
+    stream_info->num_infos++;
+}
 
-        av_packet_unref(packet);
+/**
+ * Index the packets appended to the file since the cache was built or last updated.
+ * The packets of all streams from the last indexed keyframe on are dropped and indexed again,
+ * since the packets at the previous end of the file may have been truncated and the parser needs complete groups of pictures.
+ * @return The number of new video frames
+ */
+ssize_t MediaFile::update_cache()
+{
+    if (!(flags & MEDIAFILE_FOLLOW)) {
+        return 0;
     }
 
-    // fix last packets
-    for (int i = frame_count-1; i >= 0 && !stream_infos[video_stream->index].infos[i].is_keyframe; i--) {
-        current = stream_infos[video_stream->index].infos + i;
-        if (current->frame_type == AV_PICTURE_TYPE_NONE) {
-            AVFrame* frame = get_frame(i);
-            if (frame) {
-                current->frame_type = frame->pict_type;
-                av_frame_free(&frame);
-            }
+    // check whether the file grew
+    struct stat info;
+    if (stat(filename.c_str(), &info) < 0 || info.st_size <= filesize) {
+        return 0;
+    }
+    filesize = info.st_size;
+
+    stream_info_t* video_info = stream_infos + video_stream->index;
+    ssize_t old_count = video_info->num_infos;
+    ssize_t keyframe = find_iframe_before(old_count - 1);
+    int64_t offset = keyframe >= 0 ? video_info->infos[keyframe].offset : 0;
+    if (seek_file(offset) < 0) {
+        return 0;
+    }
+
+    // drop the packets from the keyframe on, including the reordered frames displayed before it
+    for (int i = 0; i < format_context->nb_streams; i++) {
+        packet_info_t* end = std::remove_if(stream_infos[i].infos, stream_infos[i].infos + stream_infos[i].num_infos, [offset](const packet_info_t& info) { return info.offset >= offset; });
+        stream_infos[i].num_infos = end - stream_infos[i].infos;
+    }
+
+    // index them again, the seek may start slightly before the keyframe,
+    // packets without a position are only kept once a packet at or after the keyframe was read
+    AVPacket *packet = av_packet_alloc();
+    bool reached_offset = false;
+    while (av_read_frame(format_context, packet) == 0) {
+        if (packet->pos >= offset) {
+            reached_offset = true;
         }
+        if (reached_offset && (packet->pos == -1 || packet->pos >= offset)) {
+            index_packet(packet);
+        }
+        av_packet_unref(packet);
     }
+    av_packet_free(&packet);
+
+    analyze_cache(false);
+    update_index_statistics();
 
-    current = stream_infos[video_stream->index].infos;
+    return video_info->num_infos - old_count;
+}
+
+/**
+ * Derive the stream parameters from the cache and report gaps
+ * @param report_gaps Whether to print the found gaps
+ */
+void MediaFile::analyze_cache(bool report_gaps)
+{
+    packet_info_t *current = stream_infos[video_stream->index].infos;
+    ssize_t frame_count = stream_infos[video_stream->index].num_infos;
     max_bframes = 0;
     gop_size = 0;
     max_difference = 0;
     int bframe_count = 0;
     int gop_count = 0;
     int64_t next_pts = current->pts;
-    for (unsigned long i = 0; i < frame_count; next_pts = current->pts + current->duration, i++, current++) {
+    for (ssize_t i = 0; i < frame_count; next_pts = current->pts + current->duration, i++, current++) {
         // float timestamp = (current->pts - start_pts) * video_stream->time_base.num * 1.0 / video_stream->time_base.den;
         // printf("found frame %lu at %lu with pts %ld (%.3f) and dts %ld; is key: %d; is corrupt: %d; frame type: %c/%d\n", i, current->offset, current->pts, timestamp, current->dts, current->is_keyframe, current->is_corrupt, av_get_picture_type_char(current->frame_type), current->frame_type);
 
@@ -259,7 +437,9 @@ void MediaFile::build_cache()
         }
 
         if (next_pts != current->pts) {
-            printf("found pts gap: expected pts %ld while current has pts %ld\n", next_pts, current->pts);
+            if (report_gaps) {
+                log_warning(LOG_CATEGORY_INDEX, "found pts gap: expected pts %ld while current has pts %ld", next_pts, current->pts);
+            }
             bframe_count = 0;
             gop_count = 0;
             continue;
@@ -294,17 +474,464 @@ void MediaFile::build_cache()
         int64_t next_pts = current->pts;
         for (unsigned long j = 0; j < stream_infos[i].num_infos; next_pts = current->pts + current->duration, j++, current++) {
             if (next_pts != current->pts) {
-                printf("found pts gap for stream %d: expected pts %ld while current has pts %ld\n", i, next_pts, current->pts);
+                if (report_gaps) {
+                    log_warning(LOG_CATEGORY_INDEX, "found pts gap for stream %d: expected pts %ld while current has pts %ld", i, next_pts, current->pts);
+                }
                 bframe_count = 0;
                 gop_count = 0;
                 continue;
             }
         }
     }
+}
 
-    // cleanup
+/**
+ * Populate the cache from the index of the container (e.g. MP4 sample tables) if it has an entry for every packet.
+ * The index only carries dts, so a reordered video stream still needs to be read, but without all other streams.
+ * @param allow_scan Whether reading the video stream is acceptable
+ * @return True if the cache was built, False if the index is incomplete
+ */
+bool MediaFile::build_container_cache(bool allow_scan)
+{
+    // check whether the index is complete
+    for (int i = 0; i < format_context->nb_streams; i++) {
+        AVStream* stream = format_context->streams[i];
+        AVMediaType codec_type = stream->codecpar->codec_type;
+        if (codec_type != AVMEDIA_TYPE_VIDEO && codec_type != AVMEDIA_TYPE_AUDIO && codec_type != AVMEDIA_TYPE_SUBTITLE) {
+            continue;
+        }
+        if (stream->nb_frames <= 0 || avformat_index_get_entries_count(stream) < stream->nb_frames) {
+            return false;
+        }
+    }
+
+    bool reordered = video_stream->codecpar->video_delay > 0;
+    if (reordered && !allow_scan) {
+        return false;
+    }
+
+    allocate_cache();
+    for (int i = 0; i < format_context->nb_streams; i++) {
+        if (i == video_stream->index && reordered) {
+            continue;
+        }
+
+        AVStream* stream = format_context->streams[i];
+        stream_info_t* stream_info = stream_infos + i;
+        int entry_count = avformat_index_get_entries_count(stream);
+        reserve_infos(i, entry_count + 1);
+        for (int j = 0; j < entry_count; j++) {
+            const AVIndexEntry* entry = avformat_index_get_entry(stream, j);
+            if (entry->flags & AVINDEX_DISCARD_FRAME) {
+                continue;
+            }
+
+            packet_info_t* destination = stream_info->infos + stream_info->num_infos;
+            destination->offset = entry->pos;
+            destination->pts = entry->timestamp;
+            destination->dts = entry->timestamp;
+            destination->duration = 0;
+            if (stream_info->num_infos > 0) {
+                (destination-1)->duration = entry->timestamp - (destination-1)->pts;
+                destination->duration = (destination-1)->duration;
+            }
+            destination->is_keyframe = entry->flags & AVINDEX_KEYFRAME;
+            destination->is_corrupt = false;
+            destination->is_estimated = false;
+            if (i == video_stream->index) {
+                destination->frame_type = destination->is_keyframe ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_P;
+            } else {
+                destination->frame_type = AV_PICTURE_TYPE_NONE;
+            }
+            stream_info->num_infos++;
+        }
+    }
+
+    if (reordered) {
+        // get pts and frame types of the video stream
+        for (int i = 0; i < format_context->nb_streams; i++) {
+            if (i != video_stream->index) {
+                format_context->streams[i]->discard = AVDISCARD_ALL;
+            }
+        }
+        build_cache(true);
+        for (int i = 0; i < format_context->nb_streams; i++) {
+            format_context->streams[i]->discard = AVDISCARD_DEFAULT;
+        }
+    } else {
+        analyze_cache();
+    }
+
+    return true;
+}
+
+/**
+ * Index only the keyframes of the video stream, so the file can be navigated at keyframe granularity immediately.
+ * Keyframes are taken from the container index if present, otherwise the file is probed at sampled byte positions.
+ * The frames in between are estimated assuming a constant frame rate and refined by refine_gop on first use.
+ * @return True if the sparse cache was built, False if a full scan is needed
+ */
+bool MediaFile::build_sparse_cache()
+{
+    allocate_cache();
+
+    // get frame duration
+    AVRational frame_rate = video_stream->avg_frame_rate.num ? video_stream->avg_frame_rate : video_stream->r_frame_rate;
+    if (frame_rate.num == 0 || frame_rate.den == 0) {
+        log_info(LOG_CATEGORY_INDEX, "unknown frame rate, falling back to full scan");
+        return false;
+    }
+    int64_t frame_duration = av_rescale_q(1, av_inv_q(frame_rate), video_stream->time_base);
+    if (frame_duration <= 0) {
+        return false;
+    }
+
+    // collect keyframes from container index
+    std::vector<packet_info_t> keyframes;
+    int entry_count = avformat_index_get_entries_count(video_stream);
+    for (int i = 0; i < entry_count; i++) {
+        const AVIndexEntry* entry = avformat_index_get_entry(video_stream, i);
+        if (!(entry->flags & AVINDEX_KEYFRAME) || entry->pos < 0 || entry->timestamp == AV_NOPTS_VALUE) {
+            continue;
+        }
+        if (!keyframes.empty() && entry->timestamp <= keyframes.back().pts) {
+            continue;
+        }
+        packet_info_t keyframe = { };
+        keyframe.offset = entry->pos;
+        keyframe.pts = entry->timestamp;
+        keyframe.dts = entry->timestamp;
+        keyframes.push_back(keyframe);
+    }
+
+    // probe sampled byte positions if there is no usable index
+    if (keyframes.empty()) {
+        int64_t stride = filesize / SPARSE_INDEX_SAMPLES;
+        if (stride < SPARSE_INDEX_MIN_STRIDE) {
+            stride = SPARSE_INDEX_MIN_STRIDE;
+        }
+
+        reported_progress = -1;
+        report_progress(0);
+
+        AVPacket *packet = av_packet_alloc();
+        for (int64_t position = 0; position < filesize; position += stride) {
+            report_progress(position);
+
+            if (avformat_seek_file(format_context, video_stream->index, position, position, position, AVSEEK_FLAG_BYTE) < 0) {
+                log_error(LOG_CATEGORY_MEDIAFILE, "seek failed");
+                break;
+            }
+
+            // use the first keyframe after the sampled position
+            while (av_read_frame(format_context, packet) == 0) {
+                bool done = packet->pos > position + stride;
+                if (packet->stream_index == video_stream->index && packet->flags & AV_PKT_FLAG_KEY && packet->pts != AV_NOPTS_VALUE && packet->pos >= 0) {
+                    if (keyframes.empty() || packet->pts > keyframes.back().pts) {
+                        packet_info_t keyframe = { };
+                        keyframe.offset = packet->pos;
+                        keyframe.pts = packet->pts;
+                        keyframe.dts = packet->dts;
+                        keyframes.push_back(keyframe);
+                    }
+                    done = true;
+                }
+                av_packet_unref(packet);
+                if (done) {
+                    break;
+                }
+            }
+        }
+        av_packet_free(&packet);
+        report_progress(filesize);
+    }
+
+    if (keyframes.empty()) {
+        log_info(LOG_CATEGORY_INDEX, "no keyframes found, falling back to full scan");
+        return false;
+    }
+    log_info(LOG_CATEGORY_INDEX, "indexed %zu keyframes", keyframes.size());
+
+    // place keyframes by their pts and estimate the frames in between
+    stream_info_t* video_info = stream_infos + video_stream->index;
+    int64_t start_pts = keyframes[0].pts;
+    ssize_t previous_slot = -1;
+    for (const packet_info_t& keyframe : keyframes) {
+        ssize_t slot = (keyframe.pts - start_pts + frame_duration / 2) / frame_duration;
+        if (slot <= previous_slot) {
+            slot = previous_slot + 1;
+        }
+        reserve_infos(video_stream->index, slot + 1);
+
+        for (ssize_t i = previous_slot + 1; i < slot; i++) {
+            const packet_info_t* before = video_info->infos + previous_slot;
+            packet_info_t* estimated = video_info->infos + i;
+            estimated->offset = before->offset + (keyframe.offset - before->offset) * (i - previous_slot) / (slot - previous_slot);
+            estimated->pts = before->pts + (keyframe.pts - before->pts) * (i - previous_slot) / (slot - previous_slot);
+            estimated->dts = estimated->pts;
+            estimated->duration = frame_duration;
+            estimated->is_keyframe = false;
+            estimated->is_corrupt = false;
+            estimated->is_estimated = true;
+            estimated->frame_type = AV_PICTURE_TYPE_NONE;
+        }
+
+        packet_info_t* destination = video_info->infos + slot;
+        *destination = keyframe;
+        destination->duration = frame_duration;
+        destination->is_keyframe = true;
+        destination->is_estimated = true;
+        destination->frame_type = AV_PICTURE_TYPE_I;
+        previous_slot = slot;
+    }
+    video_info->num_infos = previous_slot + 1;
+
+    // refine the last group of pictures to find the end of the video and the first one for the stream parameters
+    refine_gop(find_iframe_before(video_info->num_infos - 1));
+    refine_gop(0);
+
+    return true;
+}
+
+/**
+ * Replace the estimated infos of a group of pictures by the infos of the actual packets.
+ * The number of frames may differ from the estimation, in which case all following frames are moved and the current frame is moved along.
+ * Audio and subtitle packets found on the way are added to the cache of their streams.
+ * @param keyframe_index The index of the keyframe starting the group of pictures
+ * @return The change of the number of frames
+ */
+ssize_t MediaFile::refine_gop(ssize_t keyframe_index)
+{
+    stream_info_t* video_info = stream_infos + video_stream->index;
+    if (keyframe_index < 0 || keyframe_index >= video_info->num_infos || !video_info->infos[keyframe_index].is_estimated) {
+        return 0;
+    }
+
+    // find end of group of pictures
+    ssize_t next_keyframe = keyframe_index + 1;
+    while (next_keyframe < video_info->num_infos && !video_info->infos[next_keyframe].is_keyframe) {
+        next_keyframe++;
+    }
+    int64_t start_offset = video_info->infos[keyframe_index].offset;
+    int64_t end_offset = next_keyframe < video_info->num_infos ? video_info->infos[next_keyframe].offset : INT64_MAX;
+
+    if (seek_file(start_offset) < 0) {
+        return 0;
+    }
+
+    // collect frames from the keyframe up to the next keyframe including the frames displayed before it
+    std::vector<packet_info_t> frames;
+    AVPacket *packet = av_packet_alloc();
+    int64_t start_pts = AV_NOPTS_VALUE;
+    int64_t end_pts = AV_NOPTS_VALUE;
+    while (av_read_frame(format_context, packet) == 0) {
+        if (end_offset != INT64_MAX && packet->pos > end_offset + SPARSE_INDEX_MAX_OVERREAD) {
+            av_packet_unref(packet);
+            break;
+        }
+
+        if (packet->stream_index != video_stream->index) {
+            if (end_pts == AV_NOPTS_VALUE && packet->pts != AV_NOPTS_VALUE) {
+                insert_packet_info(packet, start_offset);
+            }
+            av_packet_unref(packet);
+            continue;
+        }
+        if (packet->pts == AV_NOPTS_VALUE) {
+            av_packet_unref(packet);
+            continue;
+        }
+
+        if (start_pts == AV_NOPTS_VALUE) {
+            if (!(packet->flags & AV_PKT_FLAG_KEY)) {
+                av_packet_unref(packet);
+                continue;
+            }
+            start_pts = packet->pts;
+        } else if (end_pts == AV_NOPTS_VALUE && packet->pos >= end_offset && packet->flags & AV_PKT_FLAG_KEY) {
+            end_pts = packet->pts;
+        }
+        if (end_pts != AV_NOPTS_VALUE && packet->pts > end_pts) {
+            av_packet_unref(packet);
+            break;
+        }
+
+        if (packet->pts >= start_pts && (end_pts == AV_NOPTS_VALUE || packet->pts < end_pts)) {
+            packet_info_t info = { };
+            info.offset = packet->pos;
+            info.pts = packet->pts;
+            info.dts = packet->dts;
+            info.duration = packet->duration;
+            info.is_keyframe = packet->flags & AV_PKT_FLAG_KEY;
+            info.is_corrupt = packet->flags & AV_PKT_FLAG_CORRUPT;
+            info.is_estimated = false;
+            AVCodecParserContext *parser_context = av_stream_get_parser(video_stream);
+            info.frame_type = parser_context ? parser_context->pict_type : AV_PICTURE_TYPE_NONE;
+            frames.push_back(info);
+        }
+        av_packet_unref(packet);
+    }
     av_packet_free(&packet);
-    progress.setValue(filesize >> 20);
+
+    if (frames.empty()) {
+        video_info->infos[keyframe_index].is_estimated = false;
+        return 0;
+    }
+    std::sort(frames.begin(), frames.end(), [](const packet_info_t& a, const packet_info_t& b) { return a.pts < b.pts; });
+
+    // move following frames if the estimation was wrong
+    int64_t current_pts = current_frame >= keyframe_index && current_frame < next_keyframe ? video_info->infos[current_frame].pts : AV_NOPTS_VALUE;
+    ssize_t delta = frames.size() - (next_keyframe - keyframe_index);
+    if (delta != 0) {
+        log_debug(LOG_CATEGORY_INDEX, "refined group of pictures at frame %zd has %zu frames instead of %zd", keyframe_index, frames.size(), next_keyframe - keyframe_index);
+        reserve_infos(video_stream->index, video_info->num_infos + delta);
+        memmove(video_info->infos + next_keyframe + delta, video_info->infos + next_keyframe, (video_info->num_infos - next_keyframe) * sizeof(packet_info_t));
+        video_info->num_infos += delta;
+    }
+    memcpy(video_info->infos + keyframe_index, frames.data(), frames.size() * sizeof(packet_info_t));
+
+    // keep the current frame, a frame within the group of pictures is searched again by its estimated pts
+    if (current_frame >= next_keyframe) {
+        current_frame += delta;
+    } else if (current_pts != AV_NOPTS_VALUE) {
+        ssize_t found = find_frame(current_pts);
+        current_frame = found < 0 ? get_frame_count() - 1 : found;
+    }
+
+    // update stream parameters
+    int bframe_count = 0;
+    int gop_count = 0;
+    for (const packet_info_t& frame : frames) {
+        if (frame.pts - frame.dts > max_difference) {
+            max_difference = frame.pts - frame.dts;
+        }
+        if (frame.frame_type == AV_PICTURE_TYPE_B) {
+            bframe_count++;
+        } else {
+            if (bframe_count > max_bframes) {
+                max_bframes = bframe_count;
+            }
+            bframe_count = 0;
+        }
+        if (frame.frame_type == AV_PICTURE_TYPE_I && gop_count > 0) {
+            if (gop_count > gop_size) {
+                gop_size = gop_count;
+            }
+            gop_count = 0;
+        }
+        gop_count++;
+    }
+    if (gop_count > gop_size) {
+        gop_size = gop_count;
+    }
+    if (max_bframes + 1 > reorder_length) {
+        reorder_length = max_bframes + 1;
+    }
+    update_index_statistics();
+
+    return delta;
+}
+
+/**
+ * Publish the used and the mapped bytes of the index of each stream
+ */
+void MediaFile::update_index_statistics()
+{
+    if (statistics_prefix.empty()) {
+        return;
+    }
+    for (int i = 0; i < format_context->nb_streams; i++) {
+        std::string prefix = statistics_prefix + ".stream" + std::to_string(i);
+        Statistics::counter(prefix + ".bytes").set(stream_infos[i].num_infos * sizeof(packet_info_t));
+        Statistics::counter(prefix + ".mapped_bytes").set((long) stream_infos[i].infos_end - (long) stream_infos[i].infos);
+    }
+}
+
+/**
+ * Add the info of a non video packet to the cache of its stream, keeping the cache sorted by pts
+ * @param packet The packet to add
+ * @param fallback_offset The offset to use if the packet has no position
+ */
+void MediaFile::insert_packet_info(const AVPacket* packet, int64_t fallback_offset)
+{
+    stream_info_t* stream_info = stream_infos + packet->stream_index;
+    packet_info_t* last = stream_info->infos + stream_info->num_infos;
+    packet_info_t* position = std::lower_bound(stream_info->infos, last, packet->pts, [](const packet_info_t& info, int64_t pts) { return info.pts < pts; });
+    if (position != last && position->pts == packet->pts) {
+        // already known from refining a neighbouring group of pictures
+        return;
+    }
+
+    ssize_t index = position - stream_info->infos;
+    reserve_infos(packet->stream_index, stream_info->num_infos + 1);
+    position = stream_info->infos + index;
+    memmove(position + 1, position, (stream_info->num_infos - index) * sizeof(packet_info_t));
+    stream_info->num_infos++;
+
+    position->offset = packet->pos != -1 ? packet->pos : fallback_offset;
+    position->pts = packet->pts;
+    position->dts = packet->dts;
+    position->duration = packet->duration;
+    position->is_keyframe = packet->flags & AV_PKT_FLAG_KEY;
+    position->is_corrupt = packet->flags & AV_PKT_FLAG_CORRUPT;
+    position->is_estimated = false;
+    position->frame_type = AV_PICTURE_TYPE_NONE;
+}
+
+/**
+ * Refine all groups of pictures needed for cutting from the first to the last given pts.
+ * This includes the neighbouring groups of pictures, since the remuxing reads audio packets from them.
+ * Refining may move the frames, so the frames are searched again by their pts after each group of pictures.
+ * @param first_pts The pts of the first frame of the cut
+ * @param last_pts The pts of the last frame of the cut
+ */
+void MediaFile::refine_range(int64_t first_pts, int64_t last_pts)
+{
+    if (index_source != INDEX_SOURCE_SPARSE) {
+        return;
+    }
+
+    ssize_t last = find_last_frame(last_pts);
+    refine_gop(find_iframe_after(last + 1));
+    refine_gop(find_iframe_before(find_last_frame(last_pts)));
+
+    ssize_t first = find_frame(first_pts);
+    refine_gop(find_iframe_after(first + 1));
+    ssize_t first_keyframe = find_iframe_before(find_frame(first_pts));
+    refine_gop(first_keyframe);
+    refine_gop(find_iframe_before(first_keyframe - 1));
+}
+
+/**
+ * Refine the group of pictures containing a frame.
+ * The pts of the frame is only estimated before, so the frame is searched again by it afterwards.
+ * @param frame_index The index of the frame
+ * @return The index of the first frame at or after the pts of the frame, the last frame if there is none
+ */
+ssize_t MediaFile::refine_frame(ssize_t frame_index)
+{
+    const packet_info_t* info = get_frame_info(frame_index);
+    if (info == NULL || !info->is_estimated) {
+        return frame_index;
+    }
+
+    int64_t pts = info->pts;
+    refine_gop(find_iframe_before(frame_index));
+    ssize_t found = find_frame(pts);
+    return found < 0 ? get_frame_count() - 1 : found;
+}
+
+/**
+ * Report the progress of reading the file to the progress callback in steps of 1 MiB
+ * @param position The current position in the file
+ */
+void MediaFile::report_progress(int64_t position)
+{
+    if (!progress_callback || position < 0 || position >> 20 <= reported_progress >> 20) {
+        return;
+    }
+    reported_progress = position;
+    progress_callback(position, filesize);
 }
 
 /**
@@ -314,19 +941,35 @@ void MediaFile::detect_hardware_decoding()
 {
     // get decoder
     const AVCodec *codec = avcodec_find_decoder(video_stream->codecpar->codec_id);
+
+    // reuse the result of a previous file with the same codec
+    int cached_index = DecoderPool::get_hw_config_index(video_stream->codecpar);
+    if (cached_index != HW_CONFIG_UNKNOWN) {
+        hw_config = cached_index < 0 ? NULL : avcodec_get_hw_config(codec, cached_index);
+        return;
+    }
+
     AVCodecContext *codec_context = avcodec_alloc_context3(codec);
     avcodec_parameters_to_context(codec_context, video_stream->codecpar);
 
     // try hardware decoding
-    for (int i = 0;; i++) {
-        hw_config = avcodec_get_hw_config(codec, i);
+    int index;
+    for (index = 0;; index++) {
+        hw_config = avcodec_get_hw_config(codec, index);
         if (hw_config == NULL) {
+            index = -1;
             break;
         }
 
+        // skip devices that failed before
+        if (!DecoderPool::is_hw_device_usable(hw_config->device_type)) {
+            continue;
+        }
+
         // try to open device
         AVBufferRef *hw_device_ctx = NULL;
         if (av_hwdevice_ctx_create(&hw_device_ctx, hw_config->device_type, NULL, NULL, 0) < 0) {
+            DecoderPool::set_hw_device_usable(hw_config->device_type, false);
             continue;
         }
         codec_context->hw_device_ctx = av_buffer_ref(hw_device_ctx);
@@ -340,18 +983,19 @@ void MediaFile::detect_hardware_decoding()
 
         // check decoding
         if (!frame) {
-            puts("failed to decode a frame");
+            log_warning(LOG_CATEGORY_MEDIAFILE, "failed to decode a frame");
             continue;
         } else if (frame->format != hw_config->pix_fmt) {
-            printf("got wrong pixel format from %s: expected %s but got %s\n", av_hwdevice_get_type_name(hw_config->device_type), av_get_pix_fmt_name(hw_config->pix_fmt), av_get_pix_fmt_name((AVPixelFormat) frame->format));
+            log_warning(LOG_CATEGORY_MEDIAFILE, "got wrong pixel format from %s: expected %s but got %s", av_hwdevice_get_type_name(hw_config->device_type), av_get_pix_fmt_name(hw_config->pix_fmt), av_get_pix_fmt_name((AVPixelFormat) frame->format));
             av_frame_free(&frame);
             continue;
         }
 
         av_frame_free(&frame);
-        printf("found hardware decoder of type %s\n", av_hwdevice_get_type_name(hw_config->device_type));
+        log_info(LOG_CATEGORY_MEDIAFILE, "found hardware decoder of type %s", av_hwdevice_get_type_name(hw_config->device_type));
         break;
     }
+    DecoderPool::set_hw_config_index(video_stream->codecpar, index);
 
     // cleanup
     avcodec_free_context(&codec_context);
@@ -369,10 +1013,53 @@ int MediaFile::seek(ssize_t frame_index)
     // printf("starting decoding at frame %d\n", current);
 
     // get frame
-    int64_t offset = stream_infos[video_stream->index].infos[iframe].offset;
+    return seek_offset(stream_infos[video_stream->index].infos[iframe].offset);
+}
+
+/**
+ * Seek to a byte offset. Packets starting before the offset are skipped
+ * @param offset The offset of the first packet to read
+ * @return >= 0 on success, < 0 on error
+ */
+int MediaFile::seek_offset(int64_t offset)
+{
+    if (sequential_read) {
+        // replay already read packets
+        if (!read_buffer.empty() && read_buffer.front()->pos >= 0 && read_buffer.front()->pos <= offset && offset <= last_read_pos) {
+            replay_position = 0;
+            while (read_buffer[replay_position]->pos < offset) {
+                replay_position++;
+            }
+            skip_offset = offset;
+            return 0;
+        }
+
+        // read through small gaps instead of seeking
+        if (last_read_pos >= 0 && offset > last_read_pos && offset - last_read_pos <= SEQUENTIAL_READ_MAX_GAP) {
+            replay_position = read_buffer.size();
+            skip_offset = offset;
+            return 0;
+        }
+    }
+
+    return seek_file(offset);
+}
+
+/**
+ * Seek the demuxer to a byte offset, which discards the packets kept in sequential read mode
+ * @param offset The byte offset to seek to
+ * @return >= 0 on success, < 0 on error
+ */
+int MediaFile::seek_file(int64_t offset)
+{
+    TraceSpan span("seek");
+    static Counter& seeks = Statistics::counter("mediafile.seeks");
+    seeks.add();
+    discard_read_buffer();
+
     int error = avformat_seek_file(format_context, video_stream->index, offset-64, offset, offset+64, AVSEEK_FLAG_BYTE);
     if (error < 0) {
-        puts("Seek failed");
+        log_error(LOG_CATEGORY_MEDIAFILE, "seek failed");
     }
 
     return error;
@@ -381,12 +1068,16 @@ int MediaFile::seek(ssize_t frame_index)
 /**
  * Extract a raw frame by index
  * @param frame_index  The frame index to extract
+ * @param fast True to decode with reduced quality in software, hardware decoders are used as they are
  * @return The extracted raw frame or NULL on failure
  */
-AVFrame* MediaFile::get_raw_frame(ssize_t frame_index)
+AVFrame* MediaFile::get_raw_frame(ssize_t frame_index, bool fast)
 {
+    // make sure the group of pictures is indexed exactly
+    frame_index = refine_frame(frame_index);
+
     // get decoder
-    AVCodecContext *codec_context = get_video_decode_context(true);
+    AVCodecContext *codec_context = fast && !hw_config ? DecoderPool::acquire(video_stream->codecpar, max_bframes, true) : get_video_decode_context(true);
 
     // find keyframe
     int current = find_iframe_before(frame_index);
@@ -400,13 +1091,18 @@ AVFrame* MediaFile::get_raw_frame(ssize_t frame_index)
     // printf("start  pts: %ld\n", start_pts);
     // printf("target pts: %ld\n", target_pts);
 
-    if (seek(current) < 0) {
+    if (seek_file(stream_info->infos[current].offset) < 0) {
+        if (codec_context != this->codec_context) {
+            DecoderPool::release(codec_context);
+        }
         return NULL;
     }
 
     // preparations
     AVPacket *packet = av_packet_alloc();
     AVFrame *frame = av_frame_alloc();
+    int64_t start_bytes = input_io->get_bytes_read();
+    int decoded_frames = 0;
 
     // decode frame
     frame->pts = target_pts-1;
@@ -417,9 +1113,11 @@ AVFrame* MediaFile::get_raw_frame(ssize_t frame_index)
         }
         if (packet->stream_index == video_stream->index && packet->pts >= start_pts) {
             // printf("found packet with dts/pts %ld/%ld\n", packet->dts, packet->pts);
+            TraceSpan span("decode");
             avcodec_send_packet(codec_context, packet);
             while (frame->pts != target_pts && avcodec_receive_frame(codec_context, frame) == 0) {
                 // printf("got frame with pts %ld and type %c\n", frame->pts, av_get_picture_type_char(frame->pict_type));
+                decoded_frames++;
             }
         }
         av_packet_unref(packet);
@@ -428,12 +1126,23 @@ AVFrame* MediaFile::get_raw_frame(ssize_t frame_index)
     // get last frames
     while (frame->pts != target_pts && avcodec_receive_frame(codec_context, frame) == 0) {
         // printf("got frame with pts %ld and type %c\n", frame->pts, av_get_picture_type_char(frame->pict_type));
+        decoded_frames++;
     }
 
+    // count the work needed for a single frame
+    static Histogram& decoded_frames_histogram = Statistics::histogram("get_frame.decoded_frames");
+    static Histogram& bytes_read_histogram = Statistics::histogram("get_frame.bytes_read");
+    decoded_frames_histogram.observe(decoded_frames);
+    bytes_read_histogram.observe(input_io->get_bytes_read() - start_bytes);
+
     // cleanup
     if (frame->pts != target_pts) {
         av_frame_free(&frame);
     }
+    // software decoders are not kept by the media file
+    if (codec_context != this->codec_context) {
+        DecoderPool::release(codec_context);
+    }
 
     av_packet_free(&packet);
     return frame;
@@ -446,13 +1155,21 @@ AVFrame* MediaFile::get_raw_frame(ssize_t frame_index)
  */
 AVFrame* MediaFile::get_frame(ssize_t frame_index)
 {
-    AVFrame* frame = get_raw_frame(frame_index);
+    TraceSpan span("get_frame");
+    return transfer_frame(get_raw_frame(frame_index));
+}
 
-    // convert hardware decoded frame to actually usable frame
+/**
+ * Convert a hardware decoded frame to actually usable frame
+ * @param frame The decoded frame, it is freed if it is replaced
+ * @return The frame in system memory or NULL if frame is NULL
+ */
+AVFrame* MediaFile::transfer_frame(AVFrame* frame)
+{
     if (frame && hw_config && frame->format == hw_config->pix_fmt) {
         AVFrame* soft_frame = av_frame_alloc();
         if (av_hwframe_transfer_data(soft_frame, frame, 0) < 0) {
-            puts("Failed to transfer frame");
+            log_error(LOG_CATEGORY_MEDIAFILE, "failed to transfer frame");
         } else {
             av_frame_free(&frame);
             frame = soft_frame;
@@ -461,6 +1178,53 @@ AVFrame* MediaFile::get_frame(ssize_t frame_index)
     return frame;
 }
 
+/**
+ * Open a proxy for previews, replacing the current one
+ * @param proxy_filename The proxy file, its timestamps must match the video stream
+ * @return True on success
+ */
+bool MediaFile::open_proxy(const std::string& proxy_filename)
+{
+    MediaFile* new_proxy;
+    try {
+        new_proxy = new MediaFile(proxy_filename);
+    } catch (const std::runtime_error& error) {
+        log_warning(LOG_CATEGORY_MEDIAFILE, "failed to open proxy %s: %s", proxy_filename.c_str(), error.what());
+        return false;
+    }
+    delete proxy;
+    proxy = new_proxy;
+    return true;
+}
+
+/**
+ * Extract a frame for a quick preview. It is taken from the proxy if there is one, which only decodes a single small frame.
+ * Otherwise it is decoded with reduced quality, skipping the loop filter and the IDCT of non-reference frames
+ * @param frame_index The frame index to extract
+ * @return The extracted frame, which may have a lower resolution and artifacts, or NULL on failure
+ */
+AVFrame* MediaFile::get_preview_frame(ssize_t frame_index)
+{
+    TraceSpan span("get_preview_frame");
+    const packet_info_t* info = get_frame_info(frame_index);
+    if (proxy != NULL && info != NULL) {
+        // the proxy container may round the timestamps
+        int64_t proxy_pts = av_rescale_q(info->pts, video_stream->time_base, proxy->video_stream->time_base);
+        ssize_t proxy_index = proxy->find_frame(proxy_pts - 1);
+        const packet_info_t* proxy_info = proxy->get_frame_info(proxy_index);
+        while (proxy_info != NULL && proxy_info->pts < proxy_pts - 1) {
+            proxy_info = proxy->get_frame_info(++proxy_index);
+        }
+        if (proxy_info != NULL && proxy_info->pts <= proxy_pts + 1) {
+            AVFrame* frame = proxy->get_frame(proxy_index);
+            if (frame != NULL) {
+                return frame;
+            }
+        }
+    }
+    return transfer_frame(get_raw_frame(frame_index, true));
+}
+
 /**
  * Find first I frame before or at specified frame
  * @param search The index to search from
@@ -545,7 +1309,7 @@ const packet_info_t * MediaFile::get_frame_info(ssize_t frame_index) const
 bool compare_packet(const packet_info_t &a, const packet_info_t &b) { return a.pts < b.pts; }
 
 /**
- * Get the first packet ending after the given pts
+ * Get the first packet starting at or after the given pts
  * @param stream_index The index of the stream
  * @param pts The pts to search for
  * @returns The frame info or NULL if the pts is after file end
@@ -563,6 +1327,148 @@ const packet_info_t *MediaFile::get_packet_info(int stream_index, int64_t pts) c
     return lower_bound == last ? NULL : lower_bound;
 }
 
+/**
+ * Find a frame by its pts
+ * @param pts The pts to search for
+ * @return The index of the first frame starting at or after the pts or -1 if the pts is after the last frame
+ */
+ssize_t MediaFile::find_frame(int64_t pts) const
+{
+    const packet_info_t* info = get_packet_info(video_stream->index, pts);
+    return info == NULL ? -1 : info - stream_infos[video_stream->index].infos;
+}
+
+/**
+ * Find the last frame starting at or before a pts
+ * @param pts The pts to search for
+ * @return The index of the frame or -1 if the pts is before the first frame
+ */
+ssize_t MediaFile::find_last_frame(int64_t pts) const
+{
+    ssize_t next = pts == INT64_MAX ? -1 : find_frame(pts + 1);
+    return next < 0 ? get_frame_count() - 1 : next - 1;
+}
+
+/**
+ * Extend a byte range, so that it contains all packets of a stream within a pts range
+ * @param stream_index The index of the stream
+ * @param start_pts The first pts to include
+ * @param end_pts The first pts to exclude
+ * @param first_offset Lower end of the range, lowered if needed
+ * @param last_offset Offset of the last packet in the range, raised if needed
+ */
+void MediaFile::extend_offset_range(int stream_index, int64_t start_pts, int64_t end_pts, int64_t* first_offset, int64_t* last_offset) const
+{
+    const packet_info_t* info = get_packet_info(stream_index, start_pts);
+    if (info == NULL) {
+        return;
+    }
+
+    // packets are sorted by pts, but not by offset if they are reordered
+    const packet_info_t* end = stream_infos[stream_index].infos + stream_infos[stream_index].num_infos;
+    for (; info < end && info->pts < end_pts; info++) {
+        int64_t offset = info->offset;
+        if (offset < *first_offset) {
+            *first_offset = offset;
+        }
+        if (offset > *last_offset) {
+            *last_offset = offset;
+        }
+    }
+}
+
+/**
+ * Find where the packets following a byte range start
+ * @param start_pts Packets of all streams with a lower pts are ignored
+ * @param last_offset Offset of the last packet in the range, e.g. from extend_offset_range
+ * @return The lowest offset of a packet after the range or the file size if there is none
+ */
+int64_t MediaFile::offset_after_range(int64_t start_pts, int64_t last_offset) const
+{
+    int64_t result = filesize;
+    for (int i = 0; i < format_context->nb_streams; i++) {
+        const packet_info_t* info = get_packet_info(i, start_pts);
+        if (info == NULL) {
+            continue;
+        }
+
+        // packets are sorted by pts, so the reordered frames following the first packet after the range are checked as well
+        const packet_info_t* end = stream_infos[i].infos + stream_infos[i].num_infos;
+        ssize_t remaining = -1;
+        for (; info < end && remaining != 0; info++) {
+            if ((int64_t) info->offset > last_offset) {
+                result = std::min(result, (int64_t) info->offset);
+                if (remaining < 0) {
+                    remaining = reorder_length + 1;
+                }
+            }
+            if (remaining > 0) {
+                remaining--;
+            }
+        }
+    }
+    return result;
+}
+
+/**
+ * Convert a decoded frame to RGB24 for displaying it, non-square pixels are scaled to square ones
+ * @param frame The decoded frame
+ * @param fast True to convert a preview with a faster scaler, at most PREVIEW_HEIGHT lines high
+ * @param sws_context Keeps the scaler for converting a sequence of frames, it must be freed with sws_freeContext. NULL to convert a single frame
+ * @return The converted frame, it must be freed manually
+ */
+AVFrame* MediaFile::convert_to_rgb(const AVFrame* frame, bool fast, struct SwsContext** sws_context)
+{
+    TraceSpan span("scale");
+    AVFrame *rgb = av_frame_alloc();
+    rgb->format = AV_PIX_FMT_RGB24;
+    if (frame->sample_aspect_ratio.num == 0 || frame->sample_aspect_ratio.den == 0) {
+        rgb->width = frame->width;
+        rgb->height = frame->height;
+    } else if (frame->sample_aspect_ratio.num > frame->sample_aspect_ratio.den) {
+        rgb->width = frame->width * frame->sample_aspect_ratio.num / frame->sample_aspect_ratio.den;
+        rgb->height = frame->height;
+    } else {
+        rgb->width = frame->width;
+        rgb->height = frame->height * frame->sample_aspect_ratio.den / frame->sample_aspect_ratio.num;
+    }
+    if (fast && rgb->height > PREVIEW_HEIGHT) {
+        rgb->width = std::max(rgb->width * PREVIEW_HEIGHT / rgb->height, 1);
+        rgb->height = PREVIEW_HEIGHT;
+    }
+    av_frame_get_buffer(rgb, 4);
+    int flags = fast ? SWS_FAST_BILINEAR : SWS_BILINEAR;
+    if (sws_context != NULL) {
+        *sws_context = sws_getCachedContext(*sws_context, frame->width, frame->height, (AVPixelFormat)frame->format, rgb->width, rgb->height, (AVPixelFormat)rgb->format, flags, NULL, NULL, NULL);
+        sws_scale_frame(*sws_context, rgb, frame);
+        return rgb;
+    }
+    struct SwsContext *single_context = sws_getContext(frame->width, frame->height, (AVPixelFormat)frame->format, rgb->width, rgb->height, (AVPixelFormat)rgb->format, flags, NULL, NULL, NULL);
+    sws_scale_frame(single_context, rgb, frame);
+    sws_freeContext(single_context);
+    return rgb;
+}
+
+/**
+ * Count the packets of a stream within a pts range
+ * @param stream_index The index of the stream
+ * @param start_pts The first pts to include
+ * @param end_pts The first pts to exclude
+ * @return The number of packets
+ */
+ssize_t MediaFile::count_packets(int stream_index, int64_t start_pts, int64_t end_pts) const
+{
+    const packet_info_t* first = get_packet_info(stream_index, start_pts);
+    if (first == NULL) {
+        return 0;
+    }
+    const packet_info_t* last = get_packet_info(stream_index, end_pts);
+    if (last == NULL) {
+        last = stream_infos[stream_index].infos + stream_infos[stream_index].num_infos;
+    }
+    return last > first ? last - first : 0;
+}
+
 /**
  * Get the file offset of the first packet ending after the given pts
  * @param int64_t pts The pts to search for
@@ -661,7 +1567,7 @@ const AVStream* MediaFile::get_stream(size_t index) const
 }
 
 /**
- * Create a decode context for the video stream of the given medie file. The returned software codec context must be freed manually
+ * Create a decode context for the video stream of the given medie file. The returned software codec context is taken from the DecoderPool and must be returned with DecoderPool::release
  * @return The codec context for decoding the video stream
  */
 AVCodecContext* MediaFile::get_video_decode_context(bool hw_accel)
@@ -670,6 +1576,9 @@ AVCodecContext* MediaFile::get_video_decode_context(bool hw_accel)
         avcodec_flush_buffers(codec_context);
         return codec_context;
     }
+    if (!hw_accel || !hw_config) {
+        return DecoderPool::acquire(video_stream->codecpar, max_bframes);
+    }
 
     // get decoder
     const AVCodec *decoder = avcodec_find_decoder(video_stream->codecpar->codec_id);
@@ -677,12 +1586,9 @@ AVCodecContext* MediaFile::get_video_decode_context(bool hw_accel)
     avcodec_parameters_to_context(decode_context, video_stream->codecpar);
 
     // add hardware acceleration
-    if (hw_accel && hw_config) {
-        // try to open device
-        AVBufferRef *hw_device_ctx = NULL;
-        av_hwdevice_ctx_create(&hw_device_ctx, hw_config->device_type, NULL, NULL, 0);
-        decode_context->hw_device_ctx = av_buffer_ref(hw_device_ctx);
-    }
+    AVBufferRef *hw_device_ctx = NULL;
+    av_hwdevice_ctx_create(&hw_device_ctx, hw_config->device_type, NULL, NULL, 0);
+    decode_context->hw_device_ctx = av_buffer_ref(hw_device_ctx);
 
     // set reorder buffer length
     // this is needed, frames that cause an automatic resizing are lost (at least for h264)
@@ -690,11 +1596,37 @@ AVCodecContext* MediaFile::get_video_decode_context(bool hw_accel)
     // printf("has bframes: %d\n", codec_context->has_b_frames);
 
     avcodec_open2(decode_context, decoder, NULL);
+    codec_context = decode_context;
+
+    return decode_context;
+}
 
-    if (hw_accel && hw_config) {
-        codec_context = decode_context;
+/**
+ * Open a software decoder for a stream that is not shared with other threads
+ * @param stream_index The index of the stream to decode
+ * @param thread_count The number of decoder threads
+ * @param lowres The requested resolution reduction as power of two, limited to what the decoder supports
+ * @return The decode context, which must be freed manually, or NULL if the stream can not be decoded
+ */
+AVCodecContext* MediaFile::open_decoder(int stream_index, int thread_count, int lowres) const
+{
+    const AVStream* stream = format_context->streams[stream_index];
+    const AVCodec* decoder = avcodec_find_decoder(stream->codecpar->codec_id);
+    if (decoder == NULL) {
+        return NULL;
     }
 
+    AVCodecContext* decode_context = avcodec_alloc_context3(decoder);
+    avcodec_parameters_to_context(decode_context, stream->codecpar);
+    if (stream == video_stream) {
+        decode_context->has_b_frames = max_bframes;
+    }
+    decode_context->lowres = std::min<int>(lowres, decoder->max_lowres);
+    decode_context->thread_count = thread_count;
+    if (avcodec_open2(decode_context, decoder, NULL) < 0) {
+        avcodec_free_context(&decode_context);
+        return NULL;
+    }
     return decode_context;
 }
 
@@ -705,7 +1637,188 @@ AVCodecContext* MediaFile::get_video_decode_context(bool hw_accel)
  */
 int MediaFile::next_packet(AVPacket* packet)
 {
-    return av_read_frame(format_context, packet);
+    TraceSpan span("demux");
+    if (!sequential_read) {
+        return av_read_frame(format_context, packet);
+    }
+
+    while (true) {
+        if (replay_position < read_buffer.size()) {
+            // replay a packet that was read before
+            av_packet_ref(packet, read_buffer[replay_position++]);
+        } else {
+            int error = av_read_frame(format_context, packet);
+            if (error) {
+                return error;
+            }
+            if (packet->pos >= 0) {
+                last_read_pos = packet->pos;
+            }
+
+            // keep the packet for replaying
+            read_buffer.push_back(av_packet_clone(packet));
+            read_buffer_size += packet->size;
+            while (read_buffer_size > SEQUENTIAL_READ_BUFFER && read_buffer.size() > 1) {
+                read_buffer_size -= read_buffer.front()->size;
+                av_packet_free(&read_buffer.front());
+                read_buffer.pop_front();
+            }
+            replay_position = read_buffer.size();
+        }
+
+        // skip packets before the seek position
+        if (packet->pos >= 0 && packet->pos < skip_offset) {
+            av_packet_unref(packet);
+            continue;
+        }
+        return 0;
+    }
+}
+
+/**
+ * Decode a stream from a byte offset and pass the frames in presentation order
+ * @param decode_context The decoder to use, it is flushed first
+ * @param stream_index The index of the stream to decode
+ * @param offset The offset to start reading at
+ * @param first_pts Packets and frames before this pts are skipped, e.g. the leading frames of an open group of pictures
+ * @param end_pts Decoding ends with the first frame at or after this pts, which is not passed
+ * @param first_only True to decode only the first packet that is not skipped
+ * @param stopping Decoding ends once this is set
+ * @param handle Called for every frame, returns false to stop
+ * @return False if seeking failed
+ */
+bool MediaFile::decode_stream(AVCodecContext* decode_context, int stream_index, int64_t offset, int64_t first_pts, int64_t end_pts, bool first_only, const std::atomic<bool>& stopping, const frame_callback_t& handle)
+{
+    if (seek_offset(offset) < 0) {
+        return false;
+    }
+    avcodec_flush_buffers(decode_context);
+
+    AVPacket* packet = av_packet_alloc();
+    AVFrame* frame = av_frame_alloc();
+    int64_t position = offset;
+    bool draining = false;
+    bool done = false;
+    while (!done && !stopping) {
+        if (!draining) {
+            if (next_packet(packet) < 0) {
+                draining = true;
+                avcodec_send_packet(decode_context, NULL);
+            } else {
+                if (packet->stream_index == stream_index && (packet->pts == AV_NOPTS_VALUE || packet->pts >= first_pts)) {
+                    if (packet->pos > 0) {
+                        position = packet->pos;
+                    }
+                    TraceSpan span("decode");
+                    avcodec_send_packet(decode_context, packet);
+                    if (first_only) {
+                        draining = true;
+                        avcodec_send_packet(decode_context, NULL);
+                    }
+                }
+                av_packet_unref(packet);
+            }
+        }
+
+        // frames are returned in presentation order
+        int error = 0;
+        while (!done && (error = avcodec_receive_frame(decode_context, frame)) == 0) {
+            if (frame->pts != AV_NOPTS_VALUE && frame->pts >= end_pts) {
+                done = true;
+            } else if (frame->pts >= first_pts) {
+                done = !handle(frame, position);
+            }
+            av_frame_unref(frame);
+        }
+        if (draining && error == AVERROR_EOF) {
+            done = true;
+        }
+    }
+
+    av_frame_free(&frame);
+    av_packet_free(&packet);
+    return true;
+}
+
+/**
+ * Decode the video from a keyframe and pass the frames in presentation order.
+ * Leading frames of an open group of pictures reference the group before, they are skipped
+ * @param decode_context The decoder to use, it is flushed first
+ * @param keyframe The index of the keyframe to start at
+ * @param end_pts Decoding ends with the first frame at or after this pts, which is not passed
+ * @param first_only True to decode only the keyframe
+ * @param stopping Decoding ends once this is set
+ * @param handle Called for every frame, returns false to stop
+ * @return False if seeking failed
+ */
+bool MediaFile::decode_gop_range(AVCodecContext* decode_context, ssize_t keyframe, int64_t end_pts, bool first_only, const std::atomic<bool>& stopping, const frame_callback_t& handle)
+{
+    const packet_info_t* keyframe_info = get_frame_info(keyframe);
+    if (keyframe_info == NULL) {
+        return false;
+    }
+    return decode_stream(decode_context, video_stream->index, keyframe_info->offset, keyframe_info->pts, end_pts, first_only, stopping, handle);
+}
+
+/**
+ * Serve seeks that only move forward or back within the recently read data without touching the file again.
+ * Packets returned by next_packet are kept, so that consecutive cuts and their re-encoded parts are read in a single forward pass
+ */
+void MediaFile::begin_sequential_read()
+{
+    discard_read_buffer();
+    sequential_read = true;
+}
+
+/**
+ * Stop serving seeks from recently read data and free the kept packets
+ */
+void MediaFile::end_sequential_read()
+{
+    sequential_read = false;
+    discard_read_buffer();
+}
+
+/**
+ * Announce a byte range that will be read soon, so it is read ahead of the demuxer
+ * @param start The first byte of the range
+ * @param end The last byte of the range
+ */
+void MediaFile::plan_read(int64_t start, int64_t end)
+{
+    input_io->plan(start, end);
+}
+
+/**
+ * Forget all announced byte ranges
+ */
+void MediaFile::clear_read_plan()
+{
+    input_io->clear_plan();
+}
+
+/**
+ * Set the number of bytes read ahead of the demuxer
+ * @param window The size of the read ahead window in bytes
+ */
+void MediaFile::set_read_ahead(size_t window)
+{
+    input_io->set_window(window);
+}
+
+/**
+ * Free all packets kept for replaying
+ */
+void MediaFile::discard_read_buffer()
+{
+    for (AVPacket* packet : read_buffer) {
+        av_packet_free(&packet);
+    }
+    read_buffer.clear();
+    read_buffer_size = 0;
+    replay_position = 0;
+    last_read_pos = -1;
+    skip_offset = -1;
 }
 
 /**
@@ -7,6 +7,9 @@
 #ifndef MEDIAFILE_H
 #define MEDIAFILE_H
 
+#include <atomic>
+#include <deque>
+#include <functional>
 #include <string>
 
 extern "C" {
@@ -16,6 +19,8 @@ extern "C" {
     #include <libswscale/swscale.h>
 }
 
+class InputIO;
+
 typedef struct {
     unsigned long offset;
     long pts;
@@ -23,6 +28,7 @@ typedef struct {
     unsigned int duration;
     bool is_keyframe;
     bool is_corrupt;
+    bool is_estimated;
     char frame_type;
 } packet_info_t;
 
@@ -32,14 +38,37 @@ typedef struct {
     packet_info_t* infos_end;
 } stream_info_t;
 
+typedef enum {
+    INDEX_SOURCE_SCAN,          // all packets were read
+    INDEX_SOURCE_CONTAINER,     // taken from the index of the container
+    INDEX_SOURCE_SPARSE,        // only keyframes are indexed, groups of pictures are refined on use
+} index_source_t;
+
+// index only keyframes on open and refine the groups of pictures on first use
+#define MEDIAFILE_QUICK_OPEN 0x1
+// keep extending the index while the file grows, e.g. for recordings that are still being written
+#define MEDIAFILE_FOLLOW 0x2
+
+// maximum height of preview frames converted to RGB
+#define PREVIEW_HEIGHT 540
+
+// called while reading the file with the current position and the file size in bytes
+typedef std::function<void(int64_t position, int64_t total)> progress_callback_t;
+// called with each decoded frame and the offset of the last packet read, returns false to stop decoding
+typedef std::function<bool(const AVFrame* frame, int64_t position)> frame_callback_t;
+
 class MediaFile
 {
 public:
-    MediaFile(const std::string& filename);
+    MediaFile(const std::string& filename, int flags = 0, progress_callback_t progress_callback = NULL);
+    explicit MediaFile(const MediaFile& other);
     ~MediaFile();
 
     int seek(ssize_t frame_index);
     AVFrame* get_frame(ssize_t frame_index);
+    AVFrame* get_preview_frame(ssize_t frame_index);
+    bool open_proxy(const std::string& proxy_filename);
+    bool has_proxy() const { return proxy != NULL; }
 
     ssize_t find_iframe_before(ssize_t search) const;
     ssize_t find_pframe_before(ssize_t search) const;
@@ -48,6 +77,13 @@ public:
 
     ssize_t offset_before_pts(int64_t pts) const;
     ssize_t offset_after_pts(int64_t pts) const;
+    void extend_offset_range(int stream_index, int64_t start_pts, int64_t end_pts, int64_t* first_offset, int64_t* last_offset) const;
+    int64_t offset_after_range(int64_t start_pts, int64_t last_offset) const;
+    ssize_t count_packets(int stream_index, int64_t start_pts, int64_t end_pts) const;
+
+    void refine_range(int64_t first_pts, int64_t last_pts);
+    ssize_t refine_frame(ssize_t frame_index);
+    ssize_t update_cache();
 
     ssize_t get_frame_count() const { return stream_infos[video_stream->index].num_infos; }
     ssize_t get_stream_count() const { return format_context->nb_streams; }
@@ -56,26 +92,61 @@ public:
     int get_gop_size() const { return gop_size; }
     int get_max_difference() const { return max_difference; }
 
+    bool is_following() const { return flags & MEDIAFILE_FOLLOW; }
+    bool is_quick_open() const { return index_source == INDEX_SOURCE_SPARSE; }
+    index_source_t get_index_source() const { return index_source; }
     const std::string& get_filename() const { return filename; }
     const packet_info_t* get_frame_info(ssize_t frame_index) const;
     const packet_info_t* get_packet_info(int stream_index, int64_t pts) const;
+    ssize_t find_frame(int64_t pts) const;
+    ssize_t find_last_frame(int64_t pts) const;
     const AVStream* get_video_stream() const { return video_stream; }
     AVCodecContext* get_video_decode_context(bool hw_accel = false);
+    AVCodecContext* open_decoder(int stream_index, int thread_count, int lowres = 0) const;
     const AVStream* get_stream(size_t index) const;
 
+    int seek_offset(int64_t offset);
     int next_packet(AVPacket* packet);
+    bool decode_stream(AVCodecContext* decode_context, int stream_index, int64_t offset, int64_t first_pts, int64_t end_pts, bool first_only, const std::atomic<bool>& stopping, const frame_callback_t& handle);
+    bool decode_gop_range(AVCodecContext* decode_context, ssize_t keyframe, int64_t end_pts, bool first_only, const std::atomic<bool>& stopping, const frame_callback_t& handle);
+    void begin_sequential_read();
+    void end_sequential_read();
+    void plan_read(int64_t start, int64_t end);
+    void clear_read_plan();
+    void set_read_ahead(size_t window);
 
     bool is_audio_stream(int stream_index) const;
 
+    static AVFrame* convert_to_rgb(const AVFrame* frame, bool fast = false, struct SwsContext** sws_context = NULL);
+
     ssize_t current_frame = 0;
 
 private:
-    void build_cache();
+    void open_input();
+    void allocate_cache();
+    void reserve_infos(int stream_index, ssize_t count);
+    void build_cache(bool video_only = false);
+    bool build_container_cache(bool allow_scan);
+    bool build_sparse_cache();
+    ssize_t refine_gop(ssize_t keyframe_index);
+    void insert_packet_info(const AVPacket* packet, int64_t fallback_offset);
+    void index_packet(const AVPacket* packet);
+    void analyze_cache(bool report_gaps = true);
     void detect_hardware_decoding();
+    void report_progress(int64_t position);
+    int seek_file(int64_t offset);
+    void update_index_statistics();
+    void discard_read_buffer();
 
-    AVFrame* get_raw_frame(ssize_t frame_index);
+    AVFrame* get_raw_frame(ssize_t frame_index, bool fast = false);
+    AVFrame* transfer_frame(AVFrame* frame);
 
     std::string filename;
+    int flags = 0;
+    progress_callback_t progress_callback;
+    int64_t reported_progress = -1;
+    index_source_t index_source = INDEX_SOURCE_SCAN;
+    InputIO *input_io = NULL;
     AVFormatContext *format_context = NULL;
     AVCodecContext *codec_context = NULL;
     const AVCodecHWConfig *hw_config = NULL;
@@ -83,10 +154,23 @@ private:
     int max_bframes = 0;
     int gop_size = 0;
     ssize_t filesize = 0;
+    int64_t first_pts = LONG_MIN;
     int64_t max_difference = 0;
+    std::string statistics_prefix;      // index.<instance>:<filename>, empty for clones, only the first reader of a file publishes its index size
+
+    // packets kept for replaying in sequential read mode
+    bool sequential_read = false;
+    std::deque<AVPacket*> read_buffer;
+    size_t read_buffer_size = 0;
+    size_t replay_position = 0;
+    int64_t last_read_pos = -1;
+    int64_t skip_offset = -1;
 
     stream_info_t* stream_infos = NULL;
 
+    // intra coded low resolution copy serving previews, frames are matched by pts
+    MediaFile* proxy = NULL;
+
     // temporary
     AVStream *video_stream = NULL;
 };
@@ -0,0 +1,143 @@
+// SPDX-FileCopyrightText: 2023-2026 Minei3oat
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "mediafileloader.h"
+
+#include <stdexcept>
+
+#include <sys/stat.h>
+
+MediaFileLoader::MediaFileLoader(const std::vector<std::string>& filenames, int flags) : flags(flags), jobs(filenames.size())
+{
+    // group files by device
+    for (size_t i = 0; i < filenames.size(); i++) {
+        jobs[i].filename = filenames[i];
+        struct stat info;
+        dev_t device = 0;
+        if (stat(filenames[i].c_str(), &info) == 0) {
+            jobs[i].size = info.st_size;
+            device = info.st_dev;
+        }
+        queues[device].push_back(i);
+    }
+}
+
+MediaFileLoader::~MediaFileLoader()
+{
+    wait();
+
+    // close files that were not taken
+    for (load_job_t& job : jobs) {
+        delete job.media_file;
+    }
+}
+
+/**
+ * Start the worker threads
+ */
+void MediaFileLoader::start()
+{
+    for (const auto& [device, queue] : queues) {
+        size_t worker_count = queue.size() < MAX_READERS_PER_DEVICE ? queue.size() : MAX_READERS_PER_DEVICE;
+        for (size_t i = 0; i < worker_count; i++) {
+            workers.emplace_back(&MediaFileLoader::run, this, device);
+        }
+    }
+}
+
+/**
+ * Wait until all files are opened
+ */
+void MediaFileLoader::wait()
+{
+    for (std::thread& worker : workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+/**
+ * Open the queued files of a device one after another
+ * @param device The device to open the files from
+ */
+void MediaFileLoader::run(dev_t device)
+{
+    while (true) {
+        size_t index;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::deque<size_t>& queue = queues[device];
+            if (queue.empty()) {
+                return;
+            }
+            index = queue.front();
+            queue.pop_front();
+        }
+
+        load_job_t& job = jobs[index];
+        try {
+            job.media_file = new MediaFile(job.filename, flags, [&job](int64_t position, int64_t total) { job.position = position; });
+        } catch (const std::runtime_error& error) {
+            job.error = error.what();
+        }
+        job.position = job.size;
+        job.done = true;
+    }
+}
+
+/**
+ * Check whether all files are opened
+ * @return True if no file is pending
+ */
+bool MediaFileLoader::is_finished() const
+{
+    for (const load_job_t& job : jobs) {
+        if (!job.done) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Get the number of bytes read by all workers
+ * @return The sum of the positions of all files
+ */
+int64_t MediaFileLoader::get_position() const
+{
+    int64_t position = 0;
+    for (const load_job_t& job : jobs) {
+        position += job.position;
+    }
+    return position;
+}
+
+/**
+ * Get the number of bytes of all files
+ * @return The sum of the sizes of all files
+ */
+int64_t MediaFileLoader::get_total() const
+{
+    int64_t total = 0;
+    for (const load_job_t& job : jobs) {
+        total += job.size;
+    }
+    return total;
+}
+
+/**
+ * Take ownership of an opened media file
+ * @param index The index of the file
+ * @return The media file or NULL if it is not opened yet, failed to open or was already taken
+ */
+MediaFile* MediaFileLoader::take(size_t index)
+{
+    if (index >= jobs.size() || !jobs[index].done) {
+        return NULL;
+    }
+    MediaFile* media_file = jobs[index].media_file;
+    jobs[index].media_file = NULL;
+    return media_file;
+}
@@ -0,0 +1,67 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2026 Minei3oat
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef MEDIAFILELOADER_H
+#define MEDIAFILELOADER_H
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "mediafile.h"
+
+// number of files opened concurrently from the same device
+#define MAX_READERS_PER_DEVICE 2
+
+typedef struct load_job {
+    std::string filename;
+    MediaFile* media_file = NULL;
+    std::string error;
+    int64_t size = 0;
+    std::atomic<int64_t> position { 0 };
+    std::atomic<bool> done { false };
+} load_job_t;
+
+/**
+ * Opens several media files concurrently on a bounded pool of worker threads.
+ * Files on the same device share a limited number of workers, so spinning disks are not thrashed.
+ */
+class MediaFileLoader
+{
+public:
+    MediaFileLoader(const std::vector<std::string>& filenames, int flags = 0);
+    ~MediaFileLoader();
+
+    void start();
+    void wait();
+
+    size_t get_count() const { return jobs.size(); }
+    bool is_done(size_t index) const { return jobs[index].done; }
+    bool is_finished() const;
+    const std::string& get_filename(size_t index) const { return jobs[index].filename; }
+    const std::string& get_error(size_t index) const { return jobs[index].error; }
+    int64_t get_position() const;
+    int64_t get_total() const;
+
+    MediaFile* take(size_t index);
+
+private:
+    void run(dev_t device);
+
+    int flags;
+    std::vector<load_job_t> jobs;
+    std::map<dev_t, std::deque<size_t>> queues;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+};
+
+#endif // MEDIAFILELOADER_H
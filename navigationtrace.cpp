@@ -0,0 +1,79 @@
+// SPDX-FileCopyrightText: 2023-2026 Minei3oat
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "navigationtrace.h"
+
+#include <string.h>
+
+static const char* action_names[] = { "step", "jump12", "jump48", "seek", "cut", "event", "file" };
+
+/**
+ * Start a recording
+ * @param filename The file to write the trace to, it is overwritten
+ */
+NavigationTrace::NavigationTrace(const std::string& filename) : start(std::chrono::steady_clock::now())
+{
+    file = fopen(filename.c_str(), "w");
+    if (file == NULL) {
+        perror("failed to open navigation trace");
+    }
+}
+
+NavigationTrace::~NavigationTrace()
+{
+    if (file != NULL) {
+        fclose(file);
+    }
+}
+
+/**
+ * Record that a frame is shown
+ * @param filename The file the frame belongs to
+ * @param frame_index The index of the frame
+ * @param action The navigation that led to the frame
+ */
+void NavigationTrace::record(const std::string& filename, ssize_t frame_index, navigation_action_t action)
+{
+    if (file == NULL) {
+        return;
+    }
+
+    int64_t time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    fprintf(file, "%ld %zd %s %s\n", time, frame_index, action_names[action], filename.c_str());
+    fflush(file);
+}
+
+/**
+ * Load a recorded trace
+ * @param filename The file to read the trace from
+ * @param events The recorded events are appended to it
+ * @return True on success
+ */
+bool NavigationTrace::load(const std::string& filename, std::vector<navigation_event_t>& events)
+{
+    FILE* file = fopen(filename.c_str(), "r");
+    if (file == NULL) {
+        return false;
+    }
+
+    char line[4096];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        line[strcspn(line, "\n")] = 0;
+        long time;
+        ssize_t frame_index;
+        char action[16];
+        int consumed = 0;
+        if (sscanf(line, "%ld %zd %15s %n", &time, &frame_index, action, &consumed) < 3 || consumed == 0) {
+            continue;
+        }
+        navigation_event_t event;
+        event.time = time;
+        event.frame_index = frame_index;
+        event.action = action;
+        event.filename = line + consumed;
+        events.push_back(event);
+    }
+    fclose(file);
+    return true;
+}
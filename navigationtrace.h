@@ -0,0 +1,57 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2026 Minei3oat
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef NAVIGATIONTRACE_H
+#define NAVIGATIONTRACE_H
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <sys/types.h>
+
+// environment variable naming the file the navigation of the editor is recorded to
+#define NAVIGATION_TRACE_ENV "MCUT_NAVIGATION_TRACE"
+
+typedef enum {
+    NAVIGATION_STEP,        // previous or next frame
+    NAVIGATION_JUMP12,      // 12 frames back or forth
+    NAVIGATION_JUMP48,      // 48 frames back or forth
+    NAVIGATION_SEEK,        // position slider or frame number
+    NAVIGATION_CUT,         // going to a cut point
+    NAVIGATION_EVENT,       // going to a scene change, black frame, silence or suggested cut
+    NAVIGATION_FILE,        // changing the media file
+} navigation_action_t;
+
+typedef struct navigation_event {
+    int64_t time;           // microseconds since the start of the recording
+    ssize_t frame_index;
+    std::string action;     // step, jump12, jump48, seek, cut, event or file
+    std::string filename;
+} navigation_event_t;
+
+/**
+ * Records the frames shown in the editor with timestamps, one line per frame: <time> <frame> <action> <file>.
+ * The trace can be replayed headless with mcut_replay to compare the preview latency of different caching strategies.
+ */
+class NavigationTrace
+{
+public:
+    NavigationTrace(const std::string& filename);
+    ~NavigationTrace();
+
+    bool is_open() const { return file != NULL; }
+    void record(const std::string& filename, ssize_t frame_index, navigation_action_t action);
+
+    static bool load(const std::string& filename, std::vector<navigation_event_t>& events);
+
+private:
+    FILE* file = NULL;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif // NAVIGATIONTRACE_H
@@ -0,0 +1,304 @@
+// SPDX-FileCopyrightText: 2023-2026 Minei3oat
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "outputio.h"
+#include "logger.h"
+#include "statistics.h"
+#include "tracing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// size of the buffer the muxer writes to
+#define OUTPUT_IO_BUFFER_SIZE (64 << 10)
+
+/**
+ * Create an output file
+ * @param filename The file to create
+ * @param size_estimate The expected file size in bytes for preallocation or 0
+ * @param direct Write full aligned chunks with O_DIRECT
+ */
+OutputIO::OutputIO(const std::string& filename, int64_t size_estimate, bool direct)
+{
+    fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        throw std::runtime_error(strerror(errno));
+    }
+
+    // reserve the space up front, so the file is not fragmented
+    if (size_estimate > 0 && fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, size_estimate) == 0) {
+        preallocated = true;
+    }
+
+    // not all file systems support direct I/O, keep writing buffered in that case
+    if (direct) {
+        direct_fd = open(filename.c_str(), O_WRONLY | O_DIRECT | O_CLOEXEC);
+        if (direct_fd < 0) {
+            log_warning(LOG_CATEGORY_EXPORT, "Direct I/O not available: %s", strerror(errno));
+        }
+    }
+
+    init();
+}
+
+/**
+ * Write to an already opened pipe
+ * @param fd The file descriptor to write to, it is closed by the output
+ */
+OutputIO::OutputIO(int fd) : fd(fd), seekable(false)
+{
+    init();
+}
+
+/**
+ * Create the IO context and start the writer thread
+ */
+void OutputIO::init()
+{
+    unsigned char* buffer = (unsigned char*) av_malloc(OUTPUT_IO_BUFFER_SIZE);
+    context = avio_alloc_context(buffer, OUTPUT_IO_BUFFER_SIZE, 1, this, NULL, &OutputIO::write, seekable ? &OutputIO::seek : NULL);
+    if (context == NULL) {
+        av_free(buffer);
+        ::close(fd);
+        if (direct_fd >= 0) {
+            ::close(direct_fd);
+        }
+        throw std::runtime_error("Failed to allocate IO context");
+    }
+
+    writer = std::thread(&OutputIO::run, this);
+}
+
+OutputIO::~OutputIO()
+{
+    close();
+    av_freep(&context->buffer);
+    avio_context_free(&context);
+    free(chunk);
+    for (uint8_t* buffer : free_buffers) {
+        free(buffer);
+    }
+}
+
+/**
+ * Write all remaining data and close the file. The muxer must have flushed the IO context before
+ * @return 0 on success, a negative AVERROR on failure
+ */
+int OutputIO::close()
+{
+    if (closed) {
+        return error ? AVERROR(error) : 0;
+    }
+    closed = true;
+
+    flush();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    queue_changed.notify_all();
+    writer.join();
+
+    // release the preallocated space after the end of the output
+    if (preallocated && ftruncate(fd, file_end) < 0 && !error) {
+        error = errno;
+    }
+    if (direct_fd >= 0) {
+        ::close(direct_fd);
+    }
+    if (::close(fd) < 0 && !error) {
+        error = errno;
+    }
+    return error ? AVERROR(error) : 0;
+}
+
+/**
+ * Write callback of the IO context
+ */
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+int OutputIO::write(void* opaque, const uint8_t* buffer, int size)
+#else
+int OutputIO::write(void* opaque, uint8_t* buffer, int size)
+#endif
+{
+    OutputIO* io = (OutputIO*) opaque;
+    int written = size;
+
+    while (size > 0) {
+        // start a new chunk
+        if (io->chunk == NULL) {
+            std::lock_guard<std::mutex> lock(io->mutex);
+            if (io->free_buffers.empty()) {
+                io->chunk = (uint8_t*) aligned_alloc(OUTPUT_IO_ALIGNMENT, OUTPUT_IO_CHUNK_SIZE);
+            } else {
+                io->chunk = io->free_buffers.back();
+                io->free_buffers.pop_back();
+            }
+            io->chunk_offset = io->position;
+            io->chunk_size = 0;
+        }
+
+        // fill the chunk
+        size_t length = std::min((size_t) size, OUTPUT_IO_CHUNK_SIZE - io->chunk_size);
+        memcpy(io->chunk + io->chunk_size, buffer, length);
+        io->chunk_size += length;
+        io->position += length;
+        io->file_end = std::max(io->file_end, io->position);
+        buffer += length;
+        size -= length;
+
+        if (io->chunk_size == OUTPUT_IO_CHUNK_SIZE) {
+            io->submit();
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(io->mutex);
+    return io->error ? AVERROR(io->error) : written;
+}
+
+/**
+ * Seek callback of the IO context. Seeking waits until everything written before is on disk
+ */
+int64_t OutputIO::seek(void* opaque, int64_t offset, int whence)
+{
+    OutputIO* io = (OutputIO*) opaque;
+
+    switch (whence & ~AVSEEK_FORCE) {
+        case AVSEEK_SIZE:
+            return io->file_end;
+        case SEEK_SET:
+            break;
+        case SEEK_CUR:
+            offset += io->position;
+            break;
+        case SEEK_END:
+            offset += io->file_end;
+            break;
+        default:
+            return AVERROR(EINVAL);
+    }
+    if (offset < 0) {
+        return AVERROR(EINVAL);
+    }
+
+    // the muxer may read back what it wrote, e.g. when moving the index to the front
+    io->flush();
+    io->position = offset;
+    return offset;
+}
+
+/**
+ * Hand the current chunk to the writer thread, waiting if too many chunks are pending
+ */
+void OutputIO::submit()
+{
+    if (chunk == NULL) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if (queue.size() >= OUTPUT_IO_MAX_CHUNKS) {
+        TraceSpan span("write_wait");
+        auto stall_start = std::chrono::steady_clock::now();
+        queue_changed.wait(lock, [this] { return queue.size() < OUTPUT_IO_MAX_CHUNKS; });
+        stall_time += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - stall_start).count();
+    }
+    queue.push_back({ chunk_offset, chunk, chunk_size });
+    chunk = NULL;
+    chunk_size = 0;
+    lock.unlock();
+    queue_changed.notify_all();
+}
+
+/**
+ * Submit the current chunk and wait until all chunks are written
+ */
+void OutputIO::flush()
+{
+    submit();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!queue.empty()) {
+        TraceSpan span("write_wait");
+        auto stall_start = std::chrono::steady_clock::now();
+        queue_changed.wait(lock, [this] { return queue.empty(); });
+        stall_time += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - stall_start).count();
+    }
+}
+
+/**
+ * Writer thread
+ */
+void OutputIO::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        queue_changed.wait(lock, [this] { return !queue.empty() || stopping; });
+        if (queue.empty()) {
+            break;
+        }
+
+        // write without holding the lock, the chunk stays queued so flush waits for it
+        output_chunk_t current = queue.front();
+        lock.unlock();
+        int result = write_chunk(current);
+        lock.lock();
+
+        if (result != 0 && !error) {
+            error = result;
+        }
+        queue.pop_front();
+        free_buffers.push_back(current.data);
+        queue_changed.notify_all();
+    }
+}
+
+/**
+ * Write a chunk to the file
+ * @param chunk The chunk to write
+ * @return 0 on success, errno on failure
+ */
+int OutputIO::write_chunk(const output_chunk_t& chunk)
+{
+    TraceSpan span("write");
+    // O_DIRECT requires aligned offsets and sizes
+    int target = fd;
+    if (direct_fd >= 0 && chunk.offset % OUTPUT_IO_ALIGNMENT == 0 && chunk.size % OUTPUT_IO_ALIGNMENT == 0) {
+        target = direct_fd;
+    }
+
+    size_t done = 0;
+    while (done < chunk.size) {
+        ssize_t result;
+        if (seekable) {
+            result = pwrite(target, chunk.data + done, chunk.size - done, chunk.offset + done);
+        } else {
+            result = ::write(target, chunk.data + done, chunk.size - done);
+        }
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // fall back to buffered writes if the file system rejects direct I/O
+            if (target == direct_fd && errno == EINVAL) {
+                target = fd;
+                continue;
+            }
+            return errno;
+        }
+        done += result;
+        bytes_written += result;
+    }
+    static Counter& bytes_written_counter = Statistics::counter("io.bytes_written");
+    bytes_written_counter.add(chunk.size);
+    return 0;
+}
@@ -0,0 +1,98 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2026 Minei3oat
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef OUTPUTIO_H
+#define OUTPUTIO_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+    #include <libavformat/avformat.h>
+    #include <libavformat/avio.h>
+}
+
+// size of the chunks handed to the writer thread
+#define OUTPUT_IO_CHUNK_SIZE (4 << 20)
+// number of chunks that may wait for the writer thread before the muxer has to wait
+#define OUTPUT_IO_MAX_CHUNKS 8
+// alignment of chunks written with O_DIRECT
+#define OUTPUT_IO_ALIGNMENT 4096
+// use O_DIRECT for outputs estimated to be at least this large
+#define OUTPUT_IO_DIRECT_THRESHOLD (1LL << 30)
+
+typedef struct {
+    int64_t offset;
+    uint8_t* data;
+    size_t size;
+} output_chunk_t;
+
+/**
+ * Writes the output of a muxer in large chunks on a background thread, so the muxer does not wait for the storage.
+ * The file is preallocated from a size estimate and full aligned chunks may be written with O_DIRECT.
+ * Pipes are written strictly sequentially without seek support.
+ */
+class OutputIO
+{
+public:
+    OutputIO(const std::string& filename, int64_t size_estimate = 0, bool direct = false);
+    OutputIO(int fd);
+    ~OutputIO();
+
+    AVIOContext* get_context() const { return context; }
+    int close();
+
+    int64_t get_bytes_written() const { return bytes_written; }
+    int64_t get_stall_time() const { return stall_time; }
+
+private:
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+    static int write(void* opaque, const uint8_t* buffer, int size);
+#else
+    static int write(void* opaque, uint8_t* buffer, int size);
+#endif
+    static int64_t seek(void* opaque, int64_t offset, int whence);
+
+    void init();
+    void submit();
+    void flush();
+    void run();
+    int write_chunk(const output_chunk_t& chunk);
+
+    int fd = -1;
+    int direct_fd = -1;
+    bool seekable = true;
+    bool preallocated = false;
+    bool closed = false;
+    AVIOContext* context = NULL;
+
+    // chunk currently filled by the muxer
+    uint8_t* chunk = NULL;
+    size_t chunk_size = 0;
+    int64_t chunk_offset = 0;
+    int64_t position = 0;
+    int64_t file_end = 0;
+
+    // chunks waiting for the writer thread
+    std::mutex mutex;
+    std::condition_variable queue_changed;
+    std::deque<output_chunk_t> queue;
+    std::vector<uint8_t*> free_buffers;
+    std::thread writer;
+    bool stopping = false;
+    int error = 0;
+
+    // statistics
+    std::atomic<int64_t> bytes_written { 0 };
+    std::atomic<int64_t> stall_time { 0 };
+};
+
+#endif // OUTPUTIO_H
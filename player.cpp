@@ -0,0 +1,248 @@
+// SPDX-FileCopyrightText: 2023-2026 Minei3oat
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "player.h"
+#include "logger.h"
+#include "statistics.h"
+#include "tracing.h"
+
+#include <cstdlib>
+
+Player::Player(const MediaFile* source, int64_t start_pts, int speed)
+    : start_pts(start_pts)
+    , speed(speed)
+    , clock_pts(start_pts)
+{
+    media_file = new MediaFile(*source);
+    time_base = media_file->get_video_stream()->time_base;
+}
+
+Player::~Player()
+{
+    stop();
+    for (playback_frame_t& frame : queue) {
+        av_frame_free(&frame.rgb);
+    }
+    sws_freeContext(sws_context);
+    delete media_file;
+}
+
+/**
+ * Start the decoder thread, the clock starts with the first frame taken
+ */
+void Player::start()
+{
+    worker = std::thread(&Player::run, this);
+}
+
+/**
+ * Stop decoding and wait for the thread, queued frames are kept
+ */
+void Player::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    queue_changed.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+/**
+ * Check whether the playback reached the end or the start of the video
+ * @return True if all frames were decoded and taken
+ */
+bool Player::is_finished() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return decoded && queue.empty();
+}
+
+/**
+ * Take the frame to display now. Frames whose time passed before they were taken are dropped
+ * @param pts Set to the pts of the returned frame
+ * @return The RGB frame, which must be freed manually, or NULL if no new frame is due
+ */
+AVFrame* Player::take_frame(int64_t* pts)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (queue.empty()) {
+        return NULL;
+    }
+
+    // the first frame starts the clock, so filling the queue does not count as delay
+    playback_clock::time_point now = playback_clock::now();
+    if (!clock_started) {
+        clock_started = true;
+        clock_start = now;
+        clock_pts = queue.front().pts;
+    }
+
+    static Counter& dropped_frames = Statistics::counter("playback.dropped_frames");
+    AVFrame* rgb = NULL;
+    while (!queue.empty() && get_presentation_time(queue.front().pts) <= now) {
+        if (rgb != NULL) {
+            av_frame_free(&rgb);
+            dropped++;
+            dropped_frames.add();
+        }
+        rgb = queue.front().rgb;
+        *pts = queue.front().pts;
+        queue.pop_front();
+    }
+    if (rgb != NULL) {
+        queue_changed.notify_all();
+    }
+    return rgb;
+}
+
+/**
+ * Get the time a frame is due, the mutex must be held
+ * @param pts The pts of the frame
+ * @return The time to display the frame
+ */
+playback_clock::time_point Player::get_presentation_time(int64_t pts) const
+{
+    int64_t distance = speed > 0 ? pts - clock_pts : clock_pts - pts;
+    return clock_start + std::chrono::microseconds(av_rescale_q(distance, time_base, AV_TIME_BASE_Q) / std::abs(speed));
+}
+
+/**
+ * Decode the video and queue the frames in playback order
+ */
+void Player::run()
+{
+    // frame threading keeps up with real time on a pair of cores
+    AVCodecContext* decode_context = media_file->open_decoder(media_file->get_video_stream()->index, PLAYBACK_DECODE_THREADS);
+    if (decode_context == NULL) {
+        log_warning(LOG_CATEGORY_MEDIAFILE, "no decoder for playing %s", media_file->get_filename().c_str());
+    } else {
+        media_file->begin_sequential_read();
+        if (!(speed > 0 ? play_forward(decode_context) : play_reverse(decode_context)) && !stopping) {
+            log_warning(LOG_CATEGORY_MEDIAFILE, "playback of %s stopped, reading failed", media_file->get_filename().c_str());
+        }
+        media_file->end_sequential_read();
+        avcodec_free_context(&decode_context);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    decoded = true;
+}
+
+/**
+ * Play from the start frame to the end of the video
+ * @param decode_context The decoder to use
+ * @return False if reading failed
+ */
+bool Player::play_forward(AVCodecContext* decode_context)
+{
+    static Counter& dropped_frames = Statistics::counter("playback.dropped_frames");
+    ssize_t keyframe = media_file->find_iframe_before(media_file->find_frame(start_pts));
+    return media_file->decode_gop_range(decode_context, keyframe, INT64_MAX, false, stopping, [&](const AVFrame* frame, int64_t position) {
+        if (frame->pts < start_pts) {
+            return true;
+        }
+
+        // skip the work for late frames, including decoding frames nothing depends on
+        if (is_late(frame->pts)) {
+            decode_context->skip_frame = AVDISCARD_NONREF;
+            dropped++;
+            dropped_frames.add();
+            return true;
+        }
+        decode_context->skip_frame = AVDISCARD_DEFAULT;
+        return enqueue(frame->pts, MediaFile::convert_to_rgb(frame, speed != 1, &sws_context));
+    });
+}
+
+/**
+ * Play from the start frame back to the start of the video, one group of pictures at a time.
+ * A pass shows the frames up to the keyframe of the previous pass, including the leading frames of that keyframe,
+ * which follow it in decoding order and can only be decoded together with the group of pictures before it
+ * @param decode_context The decoder to use
+ * @return False if reading failed
+ */
+bool Player::play_reverse(AVCodecContext* decode_context)
+{
+    static Counter& dropped_frames = Statistics::counter("playback.dropped_frames");
+    int64_t limit_pts = start_pts + 1;
+    int64_t end_pts = limit_pts;
+    ssize_t keyframe = media_file->find_iframe_before(media_file->find_frame(start_pts));
+    std::vector<playback_frame_t> frames;
+    while (keyframe >= 0 && !stopping) {
+        // previews are small enough to buffer a whole group of pictures
+        int64_t keyframe_pts = media_file->get_frame_info(keyframe)->pts;
+        bool success = media_file->decode_gop_range(decode_context, keyframe, end_pts, false, stopping, [&](const AVFrame* frame, int64_t position) {
+            if (frame->pts < limit_pts) {
+                frames.push_back({ frame->pts, MediaFile::convert_to_rgb(frame, true, &sws_context) });
+            }
+            return true;
+        });
+
+        for (auto frame = frames.rbegin(); frame != frames.rend(); frame++) {
+            if (!success || stopping) {
+                av_frame_free(&frame->rgb);
+            } else if (is_late(frame->pts)) {
+                av_frame_free(&frame->rgb);
+                dropped++;
+                dropped_frames.add();
+            } else {
+                enqueue(frame->pts, frame->rgb);
+            }
+        }
+        frames.clear();
+        if (!success) {
+            return false;
+        }
+
+        // the next pass shows the leading frames skipped by this pass, it decodes up to the frame after this keyframe,
+        // so the leading frames are passed even if the decoder returns the keyframe before them
+        const packet_info_t* after_keyframe = media_file->get_frame_info(media_file->find_frame(keyframe_pts) + 1);
+        limit_pts = keyframe_pts;
+        end_pts = after_keyframe != NULL ? after_keyframe->pts : INT64_MAX;
+        keyframe = media_file->find_iframe_before(media_file->find_frame(keyframe_pts) - 1);
+    }
+    return true;
+}
+
+/**
+ * Check whether a frame would be displayed too late. If decoding fell far behind, the clock is moved instead
+ * @param pts The pts of the frame
+ * @return True if the frame should be dropped
+ */
+bool Player::is_late(int64_t pts)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!clock_started) {
+        return false;
+    }
+    playback_clock::duration lateness = playback_clock::now() - get_presentation_time(pts);
+    if (lateness > std::chrono::milliseconds(PLAYBACK_RESYNC_DELAY)) {
+        clock_start += lateness;
+        return false;
+    }
+    return lateness > std::chrono::milliseconds(PLAYBACK_DROP_DELAY);
+}
+
+/**
+ * Add a frame to the queue, waiting for space
+ * @param pts The pts of the frame
+ * @param rgb The converted frame, the queue takes ownership
+ * @return False if the playback was stopped
+ */
+bool Player::enqueue(int64_t pts, AVFrame* rgb)
+{
+    static Counter& played_frames = Statistics::counter("playback.frames");
+    std::unique_lock<std::mutex> lock(mutex);
+    queue_changed.wait(lock, [this] { return stopping || queue.size() < PLAYBACK_QUEUE_SIZE; });
+    if (stopping) {
+        av_frame_free(&rgb);
+        return false;
+    }
+    queue.push_back({ pts, rgb });
+    played_frames.add();
+    return true;
+}
@@ -0,0 +1,88 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2026 Minei3oat
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef PLAYER_H
+#define PLAYER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "mediafile.h"
+
+// number of display-ready frames decoded ahead of the presentation clock
+#define PLAYBACK_QUEUE_SIZE 8
+// fastest playback speed as a multiple of real time
+#define PLAYBACK_MAX_SPEED 4
+// decoder threads used for playback
+#define PLAYBACK_DECODE_THREADS 2
+// frames later than this many milliseconds are dropped
+#define PLAYBACK_DROP_DELAY 20
+// if decoding falls behind by more than this many milliseconds, the clock waits for it instead of dropping more frames
+#define PLAYBACK_RESYNC_DELAY 500
+
+typedef std::chrono::steady_clock playback_clock;
+
+typedef struct playback_frame {
+    int64_t pts;
+    AVFrame* rgb;
+} playback_frame_t;
+
+/**
+ * Plays the video of a media file forwards or backwards at a multiple of real time.
+ * A decoder thread fills a bounded queue of RGB frames ahead of the presentation clock, the UI takes the frame that is due.
+ * Frames that would be late are not converted and non-reference frames are skipped until decoding catches up.
+ * Reverse playback decodes a group of pictures at a time and presents it from the end.
+ */
+class Player
+{
+public:
+    Player(const MediaFile* source, int64_t start_pts, int speed);
+    ~Player();
+
+    void start();
+    void stop();
+
+    bool is_finished() const;
+    int get_speed() const { return speed; }
+    size_t get_dropped_frames() const { return dropped; }
+
+    AVFrame* take_frame(int64_t* pts);
+
+private:
+    void run();
+    bool play_forward(AVCodecContext* decode_context);
+    bool play_reverse(AVCodecContext* decode_context);
+    bool is_late(int64_t pts);
+    bool enqueue(int64_t pts, AVFrame* rgb);
+    playback_clock::time_point get_presentation_time(int64_t pts) const;
+
+    MediaFile* media_file;
+    int64_t start_pts;
+    int speed;
+    AVRational time_base;
+    struct SwsContext* sws_context = NULL;
+
+    // the clock starts when the first frame is taken, clock_pts is presented at clock_start
+    bool clock_started = false;
+    playback_clock::time_point clock_start;
+    int64_t clock_pts;
+
+    std::deque<playback_frame_t> queue;
+    mutable std::mutex mutex;
+    std::condition_variable queue_changed;
+
+    std::thread worker;
+    std::atomic<bool> stopping { false };
+    std::atomic<bool> decoded { false };
+    std::atomic<size_t> dropped { 0 };
+};
+
+#endif // PLAYER_H
@@ -0,0 +1,249 @@
+// SPDX-FileCopyrightText: 2023-2026 Minei3oat
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "proxygenerator.h"
+#include "cache.h"
+#include "logger.h"
+#include "sceneanalyzer.h"
+#include "statistics.h"
+#include "tracing.h"
+
+#include <algorithm>
+
+#include <stdio.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+extern "C" {
+#include <libswscale/swscale.h>
+}
+
+ProxyGenerator::ProxyGenerator(const MediaFile* source)
+{
+    proxy_path = get_proxy_path(source->get_filename());
+    media_file = new MediaFile(*source);
+}
+
+ProxyGenerator::~ProxyGenerator()
+{
+    stop();
+    delete media_file;
+}
+
+/**
+ * Get the path of the proxy of a media file in the cache directory
+ * @param filename The media file
+ * @return The path or an empty string if there is no cache directory
+ */
+std::string ProxyGenerator::get_proxy_path(const std::string& filename)
+{
+    return Cache::get_path(filename, PROXY_CACHE_SUFFIX);
+}
+
+/**
+ * Start the transcoding thread
+ */
+void ProxyGenerator::start()
+{
+    if (proxy_path.empty()) {
+        finished = true;
+        return;
+    }
+    worker = std::thread(&ProxyGenerator::run, this);
+}
+
+/**
+ * Cancel the transcoding and wait for the thread, an incomplete proxy is discarded
+ */
+void ProxyGenerator::stop()
+{
+    stopping = true;
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+/**
+ * Transcode with a low priority into a temporary file and move it to the cache when it is complete
+ */
+void ProxyGenerator::run()
+{
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), ANALYSIS_NICENESS);
+    std::string temporary_path = proxy_path + ".tmp";
+    if (generate(temporary_path) && !stopping && Cache::replace(temporary_path, proxy_path)) {
+        progress = 100;
+        successful = true;
+        log_info(LOG_CATEGORY_ANALYSIS, "generated proxy %s", proxy_path.c_str());
+    } else {
+        remove(temporary_path.c_str());
+    }
+    finished = true;
+}
+
+/**
+ * Open a fast decoder for the video, a reduced resolution is enough for the proxy
+ * @return The decode context or NULL if the video can not be decoded
+ */
+AVCodecContext* ProxyGenerator::open_decoder() const
+{
+    // only use lowres if the result is still at least as high as the proxy
+    const AVStream* video_stream = media_file->get_video_stream();
+    int lowres = 0;
+    while ((video_stream->codecpar->height >> (lowres + 1)) >= PROXY_HEIGHT) {
+        lowres++;
+    }
+    return media_file->open_decoder(video_stream->index, 1, lowres);
+}
+
+/**
+ * Open the JPEG encoder for the scaled frames and add the proxy stream
+ * @param frame The first scaled frame, the encoder uses its size and format
+ * @param global_header True if the muxer needs the global header
+ * @return The encode context or NULL if there is no JPEG encoder
+ */
+AVCodecContext* ProxyGenerator::open_encoder(const AVFrame* frame, bool global_header)
+{
+    const AVCodec* encoder = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+    if (encoder == NULL) {
+        return NULL;
+    }
+
+    const AVStream* video_stream = media_file->get_video_stream();
+    AVCodecContext* encode_context = avcodec_alloc_context3(encoder);
+    encode_context->width = frame->width;
+    encode_context->height = frame->height;
+    encode_context->pix_fmt = (AVPixelFormat) frame->format;
+    encode_context->sample_aspect_ratio = video_stream->codecpar->sample_aspect_ratio;
+    encode_context->time_base = video_stream->time_base;
+    encode_context->flags |= AV_CODEC_FLAG_QSCALE;
+    encode_context->global_quality = PROXY_QUALITY * FF_QP2LAMBDA;
+    if (global_header) {
+        encode_context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+    if (avcodec_open2(encode_context, encoder, NULL) < 0) {
+        avcodec_free_context(&encode_context);
+        return NULL;
+    }
+
+    output_stream = avformat_new_stream(output_context, NULL);
+    avcodec_parameters_from_context(output_stream->codecpar, encode_context);
+    output_stream->time_base = encode_context->time_base;
+    output_stream->sample_aspect_ratio = encode_context->sample_aspect_ratio;
+    return encode_context;
+}
+
+/**
+ * Encode a frame and write all packets the encoder returns
+ * @param encode_context The encoder
+ * @param frame The frame to encode or NULL to flush the encoder
+ * @return True on success
+ */
+bool ProxyGenerator::encode_frame(AVCodecContext* encode_context, AVFrame* frame)
+{
+    TraceSpan span("encode");
+    if (avcodec_send_frame(encode_context, frame) < 0) {
+        return false;
+    }
+    AVPacket* packet = av_packet_alloc();
+    bool success = true;
+    while (success && avcodec_receive_packet(encode_context, packet) == 0) {
+        av_packet_rescale_ts(packet, encode_context->time_base, output_stream->time_base);
+        packet->stream_index = output_stream->index;
+        success = av_interleaved_write_frame(output_context, packet) >= 0;
+    }
+    av_packet_free(&packet);
+    return success;
+}
+
+/**
+ * Decode the whole video once, scale every frame down and write it as a JPEG frame with the source timestamp
+ * @param path The file to write, it is a Matroska file regardless of its extension
+ * @return False if the video can not be decoded or the proxy can not be written
+ */
+bool ProxyGenerator::generate(const std::string& path)
+{
+    AVCodecContext* decode_context = open_decoder();
+    if (decode_context == NULL) {
+        log_warning(LOG_CATEGORY_ANALYSIS, "no decoder for the proxy of %s", media_file->get_filename().c_str());
+        return false;
+    }
+    avformat_alloc_output_context2(&output_context, NULL, "matroska", path.c_str());
+    if (output_context == NULL || avio_open(&output_context->pb, path.c_str(), AVIO_FLAG_WRITE) < 0) {
+        log_warning(LOG_CATEGORY_ANALYSIS, "failed to create proxy %s", path.c_str());
+        avformat_free_context(output_context);
+        output_context = NULL;
+        avcodec_free_context(&decode_context);
+        return false;
+    }
+
+    // the progress is measured by the offset of the last video frame
+    const packet_info_t* last_frame = media_file->get_frame_info(media_file->get_frame_count() - 1);
+    int64_t end_offset = last_frame != NULL && last_frame->offset > 0 ? last_frame->offset : 1;
+    int video_index = media_file->get_video_stream()->index;
+    media_file->begin_sequential_read();
+
+    static Counter& proxy_frames = Statistics::counter("proxy.frames");
+    AVCodecContext* encode_context = NULL;
+    struct SwsContext* sws_context = NULL;
+    AVFrame* scaled = av_frame_alloc();
+    bool success = true;
+    bool read = media_file->decode_stream(decode_context, video_index, 0, INT64_MIN, INT64_MAX, false, stopping, [&](const AVFrame* frame, int64_t position) {
+        progress = std::min<int64_t>(position * 100 / end_offset, 99);
+        int64_t pts = frame->best_effort_timestamp;
+        if (pts == AV_NOPTS_VALUE || frame->height <= 0) {
+            return true;
+        }
+
+        // same aspect ratio, even dimensions for the chroma subsampling
+        if (encode_context == NULL) {
+            const AVCodec* encoder = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+            scaled->height = std::min(frame->height, PROXY_HEIGHT) & ~1;
+            scaled->width = std::max<int64_t>((int64_t) frame->width * scaled->height / frame->height, 2) & ~1;
+            scaled->format = encoder != NULL && encoder->pix_fmts != NULL ? encoder->pix_fmts[0] : AV_PIX_FMT_YUVJ420P;
+        }
+        sws_context = sws_getCachedContext(sws_context, frame->width, frame->height, (AVPixelFormat) frame->format,
+            scaled->width, scaled->height, (AVPixelFormat) scaled->format, SWS_FAST_BILINEAR, NULL, NULL, NULL);
+        {
+            TraceSpan span("scale");
+            av_frame_unref(scaled);
+            success = sws_context != NULL && sws_scale_frame(sws_context, scaled, frame) >= 0;
+        }
+        if (!success) {
+            return false;
+        }
+        if (encode_context == NULL) {
+            encode_context = open_encoder(scaled, output_context->oformat->flags & AVFMT_GLOBALHEADER);
+            success = encode_context != NULL && avformat_write_header(output_context, NULL) >= 0;
+            if (!success) {
+                return false;
+            }
+        }
+        scaled->pts = pts;
+        scaled->pict_type = AV_PICTURE_TYPE_I;
+        success = encode_frame(encode_context, scaled);
+        proxy_frames.add();
+        return success;
+    });
+    success = success && read;
+
+    // flush and cleanup
+    if (success && !stopping) {
+        success = encode_context != NULL && encode_frame(encode_context, NULL) && av_write_trailer(output_context) >= 0;
+    }
+    media_file->end_sequential_read();
+    av_frame_free(&scaled);
+    sws_freeContext(sws_context);
+    avcodec_free_context(&encode_context);
+    avcodec_free_context(&decode_context);
+    avio_closep(&output_context->pb);
+    avformat_free_context(output_context);
+    output_context = NULL;
+    output_stream = NULL;
+
+    if (!success && !stopping) {
+        log_warning(LOG_CATEGORY_ANALYSIS, "failed to generate proxy for %s", media_file->get_filename().c_str());
+    }
+    return success;
+}
@@ -0,0 +1,64 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2026 Minei3oat
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef PROXYGENERATOR_H
+#define PROXYGENERATOR_H
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "mediafile.h"
+
+// maximum height of the proxy, smaller videos keep their size
+#define PROXY_HEIGHT 360
+// quantizer of the JPEG frames, 2 is the best quality
+#define PROXY_QUALITY 5
+// suffix of the proxy files in the cache directory
+#define PROXY_CACHE_SUFFIX ".proxy.mkv"
+
+/**
+ * Transcodes the video of a media file in the background into a small proxy of JPEG frames.
+ * Every frame of the proxy is a keyframe with the timestamp of the source frame, so a preview frame is a single small decode.
+ * The proxy is written to the cache directory and only replaces an existing one once it is complete.
+ */
+class ProxyGenerator
+{
+public:
+    ProxyGenerator(const MediaFile* source);
+    ~ProxyGenerator();
+
+    void start();
+    void stop();
+
+    bool is_finished() const { return finished; }
+    bool is_successful() const { return successful; }
+    int get_progress() const { return progress; }
+    const std::string& get_proxy_path() const { return proxy_path; }
+
+    static std::string get_proxy_path(const std::string& filename);
+
+private:
+    void run();
+    bool generate(const std::string& path);
+    AVCodecContext* open_decoder() const;
+    AVCodecContext* open_encoder(const AVFrame* frame, bool global_header);
+    bool encode_frame(AVCodecContext* encode_context, AVFrame* frame);
+
+    MediaFile* media_file;
+    std::string proxy_path;
+
+    AVFormatContext* output_context = NULL;
+    AVStream* output_stream = NULL;
+
+    std::thread worker;
+    std::atomic<bool> stopping { false };
+    std::atomic<bool> finished { false };
+    std::atomic<bool> successful { false };
+    std::atomic<int> progress { 0 };
+};
+
+#endif // PROXYGENERATOR_H
@@ -0,0 +1,173 @@
+// SPDX-FileCopyrightText: 2023-2026 Minei3oat
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Replays a navigation trace recorded by the editor (see NavigationTrace) without a window
+// and reports the time from requesting a frame until it is converted for display.
+
+#include "mediafile.h"
+#include "navigationtrace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef std::chrono::steady_clock replay_clock;
+
+/**
+ * Get a percentile of measured values
+ * @param values The values, they are sorted
+ * @param percentile The percentile between 0 and 100
+ * @return The value at the percentile or 0 if there are no values
+ */
+static double percentile(std::vector<double>& values, int percentile)
+{
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[(values.size() - 1) * percentile / 100];
+}
+
+/**
+ * Write the statistics of a set of latencies
+ * @param results The JSON output
+ * @param name The name of the set
+ * @param latencies The latencies in milliseconds
+ * @param last True if this is the last set
+ */
+static void print_latencies(FILE* results, const std::string& name, std::vector<double>& latencies, bool last)
+{
+    double p50 = percentile(latencies, 50);
+    double p95 = percentile(latencies, 95);
+    double p99 = percentile(latencies, 99);
+    double max = latencies.empty() ? 0 : latencies.back();
+    fprintf(results, "    \"%s\": { \"count\": %zu, \"p50_ms\": %.3f, \"p95_ms\": %.3f, \"p99_ms\": %.3f, \"max_ms\": %.3f }%s\n",
+        name.c_str(), latencies.size(), p50, p95, p99, max, last ? "" : ",");
+}
+
+/**
+ * Print the command line usage
+ * @param program The name of the executable
+ */
+static void print_usage(const char* program)
+{
+    fprintf(stderr, "Usage: %s <trace> [--quick-open] [--realtime] [--output <file>]\n", program);
+    fprintf(stderr, "  <trace>       navigation recorded with %s=<trace> mcut\n", NAVIGATION_TRACE_ENV);
+    fprintf(stderr, "  --quick-open  only index keyframes of the source files\n");
+    fprintf(stderr, "  --realtime    keep the recorded pauses between the frames instead of replaying as fast as possible\n");
+    fprintf(stderr, "  --output      write the JSON results to a file instead of stdout\n");
+}
+
+int main(int argc, char* argv[])
+{
+    // parse arguments
+    std::string trace_filename;
+    std::string output_filename;
+    int flags = 0;
+    bool realtime = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick-open") == 0) {
+            flags |= MEDIAFILE_QUICK_OPEN;
+        } else if (strcmp(argv[i], "--realtime") == 0) {
+            realtime = true;
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output_filename = argv[++i];
+        } else if (trace_filename.empty() && argv[i][0] != '-') {
+            trace_filename = argv[i];
+        } else {
+            print_usage(argv[0]);
+            return 2;
+        }
+    }
+    if (trace_filename.empty()) {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    // keep the log out of the results
+    fflush(stdout);
+    FILE* results = output_filename.empty() ? fdopen(dup(STDOUT_FILENO), "w") : fopen(output_filename.c_str(), "w");
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+    if (results == NULL) {
+        perror("failed to open results");
+        return 1;
+    }
+
+    std::vector<navigation_event_t> events;
+    if (!NavigationTrace::load(trace_filename, events)) {
+        fprintf(stderr, "failed to read %s\n", trace_filename.c_str());
+        return 1;
+    }
+
+    // open all files before replaying, opening is not part of the preview latency
+    std::map<std::string, MediaFile*> media_files;
+    for (const navigation_event_t& event : events) {
+        if (media_files.count(event.filename)) {
+            continue;
+        }
+        try {
+            media_files[event.filename] = new MediaFile(event.filename, flags);
+        } catch (const std::runtime_error& error) {
+            fprintf(stderr, "failed to open %s: %s\n", event.filename.c_str(), error.what());
+            media_files[event.filename] = NULL;
+        }
+    }
+
+    // replay
+    std::vector<double> latencies;
+    std::map<std::string, std::vector<double>> action_latencies;
+    size_t missing = 0;
+    replay_clock::time_point replay_start = replay_clock::now();
+    for (const navigation_event_t& event : events) {
+        MediaFile* media_file = media_files[event.filename];
+        if (media_file == NULL || event.frame_index < 0 || event.frame_index >= media_file->get_frame_count()) {
+            missing++;
+            continue;
+        }
+        if (realtime) {
+            std::this_thread::sleep_until(replay_start + std::chrono::microseconds(event.time));
+        }
+
+        replay_clock::time_point start = replay_clock::now();
+        media_file->current_frame = event.frame_index;
+        AVFrame* frame = media_file->get_frame(event.frame_index);
+        if (frame == NULL) {
+            missing++;
+            continue;
+        }
+        AVFrame* rgb = MediaFile::convert_to_rgb(frame);
+        double latency = std::chrono::duration<double, std::milli>(replay_clock::now() - start).count();
+        av_frame_free(&frame);
+        av_frame_free(&rgb);
+
+        latencies.push_back(latency);
+        action_latencies[event.action].push_back(latency);
+    }
+
+    // report
+    fprintf(results, "{\n");
+    fprintf(results, "  \"trace\": \"%s\",\n", trace_filename.c_str());
+    fprintf(results, "  \"events\": %zu,\n", events.size());
+    fprintf(results, "  \"missing\": %zu,\n", missing);
+    fprintf(results, "  \"time_to_frame\": {\n");
+    for (auto& [action, values] : action_latencies) {
+        print_latencies(results, action, values, false);
+    }
+    print_latencies(results, "all", latencies, true);
+    fprintf(results, "  }\n}\n");
+    fclose(results);
+
+    for (auto& [filename, media_file] : media_files) {
+        delete media_file;
+    }
+    return 0;
+}
@@ -0,0 +1,475 @@
+// SPDX-FileCopyrightText: 2023-2026 Minei3oat
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "sceneanalyzer.h"
+#include "logger.h"
+#include "statistics.h"
+#include "tracing.h"
+
+#include <algorithm>
+#include <condition_variable>
+
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+extern "C" {
+    #include <libavutil/pixdesc.h>
+}
+
+// analyses running at the same time, the others wait for a free slot
+static std::mutex slots_mutex;
+static std::condition_variable slots_available;
+static unsigned running_analyses = 0;
+
+/**
+ * Wait for a free analysis slot, scene and audio analyses together use at most half of the cores
+ * @param stopping The flag of the analysis to stop waiting on, set through stop_analysis_wait
+ * @return True if a slot was acquired, false if the analysis was stopped while waiting
+ */
+bool acquire_analysis_slot(const std::atomic<bool>& stopping)
+{
+    unsigned max_analyses = std::max(1u, std::thread::hardware_concurrency() / 2);
+    std::unique_lock<std::mutex> lock(slots_mutex);
+    slots_available.wait(lock, [&stopping, max_analyses]() { return stopping || running_analyses < max_analyses; });
+    if (stopping) {
+        return false;
+    }
+    running_analyses++;
+    return true;
+}
+
+/**
+ * Free an analysis slot acquired with acquire_analysis_slot
+ */
+void release_analysis_slot()
+{
+    {
+        std::lock_guard<std::mutex> lock(slots_mutex);
+        running_analyses--;
+    }
+    slots_available.notify_all();
+}
+
+/**
+ * Stop an analysis, waking it up if it waits for a slot
+ * @param stopping The flag of the analysis
+ */
+void stop_analysis_wait(std::atomic<bool>& stopping)
+{
+    {
+        std::lock_guard<std::mutex> lock(slots_mutex);
+        stopping = true;
+    }
+    slots_available.notify_all();
+}
+
+/**
+ * Sum up a row of luma values
+ * @param row The luma values
+ * @param width The number of values
+ * @return The sum of the values
+ */
+static uint64_t sum_row(const uint8_t* row, int width)
+{
+    uint64_t sum = 0;
+    int x = 0;
+#ifdef __SSE2__
+    // sum of absolute differences to zero adds up 8 values per 64 bit lane
+    __m128i zero = _mm_setzero_si128();
+    __m128i sums = zero;
+    for (; x + 16 <= width; x += 16) {
+        sums = _mm_add_epi64(sums, _mm_sad_epu8(_mm_loadu_si128((const __m128i*) (row + x)), zero));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i*) lanes, sums);
+    sum = lanes[0] + lanes[1];
+#endif
+    for (; x < width; x++) {
+        sum += row[x];
+    }
+    return sum;
+}
+
+/**
+ * Count a row of luma values into histograms.
+ * Consecutive values go to different histograms, so the increments do not depend on each other.
+ * @param row The luma values
+ * @param width The number of values
+ * @param histograms Four histograms to add the values to
+ */
+static void count_row(const uint8_t* row, int width, uint32_t histograms[4][ANALYSIS_BINS])
+{
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        histograms[0][row[x] / (256 / ANALYSIS_BINS)]++;
+        histograms[1][row[x + 1] / (256 / ANALYSIS_BINS)]++;
+        histograms[2][row[x + 2] / (256 / ANALYSIS_BINS)]++;
+        histograms[3][row[x + 3] / (256 / ANALYSIS_BINS)]++;
+    }
+    for (; x < width; x++) {
+        histograms[0][row[x] / (256 / ANALYSIS_BINS)]++;
+    }
+}
+
+SceneAnalyzer::SceneAnalyzer(const MediaFile* source) : media_file(new MediaFile(*source))
+{
+}
+
+SceneAnalyzer::~SceneAnalyzer()
+{
+    stop();
+    delete media_file;
+}
+
+/**
+ * Start the analysis thread
+ */
+void SceneAnalyzer::start()
+{
+    worker = std::thread(&SceneAnalyzer::run, this);
+}
+
+/**
+ * Cancel the analysis and wait for the thread, the results found so far are kept
+ */
+void SceneAnalyzer::stop()
+{
+    stop_analysis_wait(stopping);
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+/**
+ * Wait for a free slot and analyze the file with a low priority
+ */
+void SceneAnalyzer::run()
+{
+    if (!acquire_analysis_slot(stopping)) {
+        finished = true;
+        return;
+    }
+
+    // the niceness of a thread only applies to the thread itself on Linux
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), ANALYSIS_NICENESS);
+    analyze();
+
+    release_analysis_slot();
+    finished = true;
+}
+
+/**
+ * Analyze the keyframes, then all frames of the groups of pictures that may contain black frames or scene changes
+ */
+void SceneAnalyzer::analyze()
+{
+    // the frames are just good enough for statistics
+    AVCodecContext* decode_context = media_file->open_decoder(media_file->get_video_stream()->index, 1, ANALYSIS_LOWRES);
+    if (decode_context == NULL) {
+        log_warning(LOG_CATEGORY_ANALYSIS, "no decoder for analyzing %s", media_file->get_filename().c_str());
+        return;
+    }
+    decode_context->skip_loop_filter = AVDISCARD_ALL;
+    media_file->begin_sequential_read();
+
+    // keyframes are kept by pts, their index changes if the groups of pictures before are refined
+    std::vector<int64_t> keyframes;
+    for (ssize_t keyframe = media_file->find_iframe_after(0); keyframe >= 0; keyframe = media_file->find_iframe_after(keyframe + 1)) {
+        keyframes.push_back(media_file->get_frame_info(keyframe)->pts);
+    }
+
+    // analyze the keyframes and select the groups of pictures to refine
+    static Counter& analyzed_frames = Statistics::counter("analysis.frames");
+    std::vector<luma_stats_t> keyframe_stats(keyframes.size());
+    std::vector<bool> candidates(keyframes.size(), false);
+    std::vector<analyzed_frame_t> frames;
+    bool failed = false;
+    for (size_t i = 0; i < keyframes.size() && !stopping && !failed; i++) {
+        ssize_t keyframe = media_file->find_frame(keyframes[i]);
+        frames.clear();
+        failed = !decode_frames(decode_context, keyframe, keyframe + 1, true, frames);
+        analyzed_frames.add(frames.size());
+        if (frames.empty()) {
+            // pixels stays 0, so the keyframe is not compared
+            keyframe_stats[i] = { };
+            continue;
+        }
+
+        keyframe_stats[i] = frames[0].stats;
+        if (keyframe_stats[i].black_ratio >= BLACK_RATIO) {
+            mark(keyframes[i], ANALYSIS_BLACK);
+        }
+        if (keyframe_stats[i].mean <= CANDIDATE_LUMA) {
+            candidates[i] = true;
+            if (i > 0) {
+                candidates[i - 1] = true;
+            }
+        }
+        if (i > 0 && get_difference(&keyframe_stats[i - 1], &keyframe_stats[i]) >= CANDIDATE_THRESHOLD) {
+            candidates[i - 1] = true;
+        }
+        progress = (i + 1) * 50 / keyframes.size();
+    }
+
+    // analyze every frame of the candidates
+    size_t candidate_count = std::count(candidates.begin(), candidates.end(), true);
+    size_t refined = 0;
+    for (size_t i = 0; i < keyframes.size() && !stopping && !failed; i++) {
+        if (!candidates[i]) {
+            continue;
+        }
+
+        // the analysis needs the exact frames of the group of pictures
+        ssize_t keyframe = media_file->refine_frame(media_file->find_frame(keyframes[i]));
+        ssize_t end = i + 1 < keyframes.size() ? media_file->find_frame(keyframes[i + 1]) : media_file->get_frame_count();
+
+        frames.clear();
+        failed = !decode_frames(decode_context, keyframe, end, false, frames);
+        analyzed_frames.add(frames.size());
+        for (size_t j = 0; j < frames.size(); j++) {
+            if (frames[j].stats.black_ratio >= BLACK_RATIO) {
+                mark(frames[j].pts, ANALYSIS_BLACK);
+            }
+            if (j > 0 && get_difference(&frames[j - 1].stats, &frames[j].stats) >= SCENE_CHANGE_THRESHOLD) {
+                mark(frames[j].pts, ANALYSIS_SCENE_CHANGE);
+            }
+        }
+
+        // the scene may change with the next keyframe
+        if (!frames.empty() && i + 1 < keyframes.size() && get_difference(&frames.back().stats, &keyframe_stats[i + 1]) >= SCENE_CHANGE_THRESHOLD) {
+            mark(keyframes[i + 1], ANALYSIS_SCENE_CHANGE);
+        }
+
+        refined++;
+        progress = 50 + refined * 50 / candidate_count;
+    }
+
+    media_file->end_sequential_read();
+    avcodec_free_context(&decode_context);
+
+    if (failed) {
+        log_warning(LOG_CATEGORY_ANALYSIS, "stopped analyzing %s, its frames can not be analyzed", media_file->get_filename().c_str());
+    } else if (!stopping) {
+        progress = 100;
+        std::lock_guard<std::mutex> lock(mutex);
+        log_info(LOG_CATEGORY_ANALYSIS, "analyzed %s: %zu keyframes, %zu refined, %zu marked frames", media_file->get_filename().c_str(), keyframes.size(), candidate_count, events.size());
+    }
+}
+
+/**
+ * Decode the frames of a group of pictures and compute their luma statistics
+ * @param decode_context The decoder to use, it is flushed first
+ * @param keyframe The index of the keyframe to start at
+ * @param end The index of the first frame not to analyze
+ * @param keyframe_only True to decode only the keyframe
+ * @param frames The analyzed frames are appended to this in presentation order
+ * @return False if reading failed or the frames have an unsupported pixel format
+ */
+bool SceneAnalyzer::decode_frames(AVCodecContext* decode_context, ssize_t keyframe, ssize_t end, bool keyframe_only, std::vector<analyzed_frame_t>& frames)
+{
+    const packet_info_t* end_info = media_file->get_frame_info(end);
+    int64_t end_pts = end_info != NULL ? end_info->pts : INT64_MAX;
+
+    // the group of pictures ends with the next keyframe
+    bool success = true;
+    bool read = media_file->decode_gop_range(decode_context, keyframe, end_pts, keyframe_only, stopping, [&](const AVFrame* frame, int64_t position) {
+        TraceSpan span("analyze");
+        analyzed_frame_t analyzed;
+        analyzed.pts = frame->pts;
+        success = get_luma_stats(frame, &analyzed.stats);
+        if (success) {
+            frames.push_back(analyzed);
+        }
+        return success;
+    });
+    return read && success;
+}
+
+/**
+ * Compute the luma statistics of a frame from a subset of its rows
+ * @param frame The decoded frame
+ * @param stats The statistics to fill
+ * @return False if the frame has no 8 bit luma plane
+ */
+bool SceneAnalyzer::get_luma_stats(const AVFrame* frame, luma_stats_t* stats)
+{
+    const AVPixFmtDescriptor* descriptor = av_pix_fmt_desc_get((AVPixelFormat) frame->format);
+    if (descriptor == NULL || descriptor->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_BITSTREAM) || descriptor->comp[0].depth != 8 || descriptor->comp[0].step != 1) {
+        return false;
+    }
+
+    uint32_t histograms[4][ANALYSIS_BINS] = { };
+    uint64_t sum = 0;
+    int row_step = frame->height > ANALYSIS_ROWS ? frame->height / ANALYSIS_ROWS : 1;
+    stats->pixels = 0;
+    for (int y = 0; y < frame->height; y += row_step) {
+        const uint8_t* row = frame->data[0] + (ptrdiff_t) y * frame->linesize[0];
+        sum += sum_row(row, frame->width);
+        count_row(row, frame->width, histograms);
+        stats->pixels += frame->width;
+    }
+    if (stats->pixels == 0) {
+        return false;
+    }
+
+    int64_t black_pixels = 0;
+    for (int i = 0; i < ANALYSIS_BINS; i++) {
+        stats->histogram[i] = histograms[0][i] + histograms[1][i] + histograms[2][i] + histograms[3][i];
+        if (i < BLACK_LUMA / (256 / ANALYSIS_BINS)) {
+            black_pixels += stats->histogram[i];
+        }
+    }
+    stats->mean = sum / stats->pixels;
+    stats->black_ratio = black_pixels * 100 / stats->pixels;
+    return true;
+}
+
+/**
+ * Compare the luma histograms of two frames
+ * @param a The statistics of the first frame
+ * @param b The statistics of the second frame
+ * @return The share of pixels in percent that would have to change their bin, 0 if a frame is missing
+ */
+int SceneAnalyzer::get_difference(const luma_stats_t* a, const luma_stats_t* b)
+{
+    if (a->pixels == 0 || b->pixels == 0) {
+        return 0;
+    }
+
+    // compare the shares of both histograms without dividing per bin
+    int64_t difference = 0;
+    for (int i = 0; i < ANALYSIS_BINS; i++) {
+        difference += llabs((int64_t) a->histogram[i] * b->pixels - (int64_t) b->histogram[i] * a->pixels);
+    }
+    return difference * 50 / (a->pixels * b->pixels);
+}
+
+/**
+ * Mark a frame
+ * @param pts The pts of the frame
+ * @param flag The ANALYSIS_* flag to set
+ */
+void SceneAnalyzer::mark(int64_t pts, int flag)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    events[pts] |= flag;
+}
+
+/**
+ * Check if a marked frame starts a run of frames with the same mark, the mutex must be held
+ * @param media_file The media file to resolve the index with, the analyzed file or a file sharing its source
+ * @param frame_index The index of the frame
+ * @param flag The ANALYSIS_* flag to check
+ * @return True if the frame is marked, but the one before is not
+ */
+bool SceneAnalyzer::is_run_start(const MediaFile* media_file, ssize_t frame_index, int flag) const
+{
+    const packet_info_t* info = media_file->get_frame_info(frame_index);
+    if (info == NULL) {
+        return false;
+    }
+    auto event = events.find(info->pts);
+    if (event == events.end() || !(event->second & flag)) {
+        return false;
+    }
+    const packet_info_t* previous_info = media_file->get_frame_info(frame_index - 1);
+    if (previous_info == NULL) {
+        return true;
+    }
+    auto previous = events.find(previous_info->pts);
+    return previous == events.end() || !(previous->second & flag);
+}
+
+/**
+ * Find the next run of marked frames after a frame
+ * @param media_file The media file to resolve the index with
+ * @param frame_index The index to search from
+ * @param flag The ANALYSIS_* flag to search for
+ * @return The index of the first frame of the run or -1 if there is none
+ */
+ssize_t SceneAnalyzer::find_next(const MediaFile* media_file, ssize_t frame_index, int flag) const
+{
+    const packet_info_t* info = media_file->get_frame_info(frame_index);
+    if (info == NULL) {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto event = events.upper_bound(info->pts); event != events.end(); event++) {
+        ssize_t found = media_file->find_frame(event->first);
+        if (found > frame_index && is_run_start(media_file, found, flag)) {
+            return found;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Find the previous run of marked frames before a frame
+ * @param media_file The media file to resolve the index with
+ * @param frame_index The index to search from
+ * @param flag The ANALYSIS_* flag to search for
+ * @return The index of the first frame of the run or -1 if there is none
+ */
+ssize_t SceneAnalyzer::find_previous(const MediaFile* media_file, ssize_t frame_index, int flag) const
+{
+    const packet_info_t* info = media_file->get_frame_info(frame_index);
+    if (info == NULL) {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto event = std::make_reverse_iterator(events.lower_bound(info->pts)); event != events.rend(); event++) {
+        ssize_t found = media_file->find_frame(event->first);
+        if (found >= 0 && found < frame_index && is_run_start(media_file, found, flag)) {
+            return found;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Suggest the segments between black frames that are long enough to be part of the programme, rather than an advertisement
+ * The segments are given by pts, so they need no refined index and stay valid when refining a quick opened file moves the frames.
+ * @param media_file The media file to take the time base and the bounds from
+ * @return Pairs of the first and last pts of each segment, the frames are found with find_frame and find_last_frame
+ */
+std::vector<std::pair<int64_t, int64_t>> SceneAnalyzer::get_suggested_cuts(const MediaFile* media_file) const
+{
+    std::vector<std::pair<int64_t, int64_t>> cuts;
+    const packet_info_t* first_frame = media_file->get_frame_info(0);
+    const packet_info_t* last_frame = media_file->get_frame_info(media_file->get_frame_count() - 1);
+    if (first_frame == NULL || last_frame == NULL) {
+        return cuts;
+    }
+    int64_t min_duration = av_rescale_q(SUGGESTED_CUT_MIN_DURATION, AVRational { 1, 1 }, media_file->get_video_stream()->time_base);
+    auto suggest = [&](int64_t first_pts, int64_t last_pts) {
+        if (last_pts - first_pts >= min_duration) {
+            cuts.emplace_back(first_pts, last_pts);
+        }
+    };
+
+    int64_t segment_start = first_frame->pts;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& [pts, flags] : events) {
+            if (!(flags & ANALYSIS_BLACK)) {
+                continue;
+            }
+            if (pts > last_frame->pts) {
+                break;
+            }
+            suggest(segment_start, pts - 1);
+            segment_start = std::max(segment_start, pts + 1);
+        }
+    }
+    suggest(segment_start, last_frame->pts);
+    return cuts;
+}
@@ -0,0 +1,100 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2026 Minei3oat
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef SCENEANALYZER_H
+#define SCENEANALYZER_H
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "mediafile.h"
+
+// number of luma histogram bins
+#define ANALYSIS_BINS 64
+// number of rows analyzed per frame at most, others are skipped
+#define ANALYSIS_ROWS 144
+// resolution reduction requested from decoders supporting it, as power of two
+#define ANALYSIS_LOWRES 2
+// niceness of the analysis threads, so they only use cores the preview does not need
+#define ANALYSIS_NICENESS 10
+
+// pixels darker than this luma value count as black
+#define BLACK_LUMA 32
+// minimum percentage of black pixels of a black frame
+#define BLACK_RATIO 98
+// minimum histogram difference in percent between two frames for a scene change
+#define SCENE_CHANGE_THRESHOLD 40
+// keyframes are refined if their histograms differ by this percentage or their mean luma is this dark
+#define CANDIDATE_THRESHOLD 25
+#define CANDIDATE_LUMA 48
+// minimum duration in seconds of a segment between black frames to be suggested as cut
+#define SUGGESTED_CUT_MIN_DURATION 120
+
+// flags of analyzed frames
+#define ANALYSIS_BLACK 0x1
+#define ANALYSIS_SCENE_CHANGE 0x2
+
+typedef struct luma_stats {
+    int mean;
+    int black_ratio;
+    int64_t pixels;
+    uint32_t histogram[ANALYSIS_BINS];
+} luma_stats_t;
+
+typedef struct analyzed_frame {
+    int64_t pts;
+    luma_stats_t stats;
+} analyzed_frame_t;
+
+bool acquire_analysis_slot(const std::atomic<bool>& stopping);
+void release_analysis_slot();
+void stop_analysis_wait(std::atomic<bool>& stopping);
+
+/**
+ * Detects black frames and scene changes of a media file in the background to propose cut points.
+ * Keyframes are analyzed first, the groups of pictures around candidates are decoded completely afterwards.
+ * The analysis reads through its own clone of the media file, results are kept by pts, so they stay valid while the index is refined.
+ */
+class SceneAnalyzer
+{
+public:
+    SceneAnalyzer(const MediaFile* source);
+    ~SceneAnalyzer();
+
+    void start();
+    void stop();
+
+    bool is_finished() const { return finished; }
+    int get_progress() const { return progress; }
+
+    ssize_t find_next(const MediaFile* media_file, ssize_t frame_index, int flag) const;
+    ssize_t find_previous(const MediaFile* media_file, ssize_t frame_index, int flag) const;
+    bool is_run_start(const MediaFile* media_file, ssize_t frame_index, int flag) const;
+    std::vector<std::pair<int64_t, int64_t>> get_suggested_cuts(const MediaFile* media_file) const;
+
+private:
+    void run();
+    void analyze();
+    bool decode_frames(AVCodecContext* decode_context, ssize_t keyframe, ssize_t end, bool keyframe_only, std::vector<analyzed_frame_t>& frames);
+    void mark(int64_t pts, int flag);
+
+    static bool get_luma_stats(const AVFrame* frame, luma_stats_t* stats);
+    static int get_difference(const luma_stats_t* a, const luma_stats_t* b);
+
+    MediaFile* media_file = NULL;
+    std::map<int64_t, int> events;
+    mutable std::mutex mutex;
+    std::thread worker;
+    std::atomic<bool> stopping { false };
+    std::atomic<bool> finished { false };
+    std::atomic<int> progress { 0 };
+};
+
+#endif // SCENEANALYZER_H
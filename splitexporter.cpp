@@ -0,0 +1,200 @@
+// SPDX-FileCopyrightText: 2023-2026 Minei3oat
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "splitexporter.h"
+#include "logger.h"
+
+#include <stdexcept>
+
+#include <stdio.h>
+
+SplitExporter::SplitExporter(const std::vector<cut_t>& cuts, const std::string& target, const std::string& format) : format(format), jobs(cuts.size())
+{
+    // take the pts before anything refines the index, the indices are resolved from them when starting
+    std::vector<cut_t> pts_cuts(cuts);
+    Exporter::set_cut_pts(pts_cuts);
+
+    // group cuts by source
+    for (size_t i = 0; i < cuts.size(); i++) {
+        jobs[i].cut = pts_cuts[i];
+        jobs[i].target = get_target_name(target, i + 1);
+        jobs[i].total = cuts[i].cut_out - cuts[i].cut_in + 1;
+        queues[cuts[i].media_file].push_back(i);
+    }
+}
+
+SplitExporter::~SplitExporter()
+{
+    wait();
+
+    // close the additional readers
+    for (MediaFile* reader : readers) {
+        delete reader;
+    }
+}
+
+/**
+ * Start the worker threads
+ */
+void SplitExporter::start()
+{
+    for (auto& [source, queue] : queues) {
+        // index the cut points before the index is cloned, so it is refined only once
+        // the indices are resolved after all cuts of the source are refined, since refining moves the following frames
+        for (size_t index : queue) {
+            source->refine_range(jobs[index].cut.first_pts, jobs[index].cut.last_pts);
+        }
+        for (size_t index : queue) {
+            std::vector<cut_t> cut { jobs[index].cut };
+            if (Exporter::resolve_cuts(cut)) {
+                jobs[index].cut = cut[0];
+                jobs[index].total = cut[0].cut_out - cut[0].cut_in + 1;
+            }
+        }
+
+        // every worker reads through its own clone, the source stays with the GUI thread
+        size_t worker_count = queue.size() < MAX_EXPORTS_PER_SOURCE ? queue.size() : MAX_EXPORTS_PER_SOURCE;
+        size_t hardware_threads = std::thread::hardware_concurrency();
+        if (hardware_threads > 0 && worker_count > hardware_threads) {
+            worker_count = hardware_threads;
+        }
+        std::vector<MediaFile*> source_readers;
+        for (size_t i = 0; i < worker_count; i++) {
+            try {
+                source_readers.push_back(new MediaFile(*source));
+                readers.push_back(source_readers.back());
+            } catch (const std::runtime_error& error) {
+                log_warning(LOG_CATEGORY_EXPORT, "failed to open another reader for %s: %s", source->get_filename().c_str(), error.what());
+                break;
+            }
+        }
+
+        // without any reader the cuts of this source fail
+        if (source_readers.empty()) {
+            log_error(LOG_CATEGORY_EXPORT, "no reader for %s, %zu cuts not exported", source->get_filename().c_str(), queue.size());
+            for (size_t index : queue) {
+                jobs[index].position = jobs[index].total;
+                jobs[index].done = true;
+            }
+            queue.clear();
+            continue;
+        }
+        for (MediaFile* reader : source_readers) {
+            workers.emplace_back(&SplitExporter::run, this, source, reader);
+        }
+    }
+}
+
+/**
+ * Wait until all cuts are exported
+ */
+void SplitExporter::wait()
+{
+    for (std::thread& worker : workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+/**
+ * Export the queued cuts of a source one after another
+ * @param source The media file the cuts refer to
+ * @param reader The clone of the source to read the cuts from
+ */
+void SplitExporter::run(MediaFile* source, MediaFile* reader)
+{
+    while (true) {
+        size_t index;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::deque<size_t>& queue = queues[source];
+            if (queue.empty()) {
+                return;
+            }
+            index = queue.front();
+            queue.pop_front();
+        }
+
+        split_job_t& job = jobs[index];
+        cut_t cut = job.cut;
+        cut.media_file = reader;
+        Exporter exporter(std::vector<cut_t> { cut }, [&job](size_t position, size_t total) { job.position = position; });
+        job.success = exporter.run(job.target, format);
+        job.position = job.total;
+        job.done = true;
+    }
+}
+
+/**
+ * Check whether all cuts are exported
+ * @return True if no cut is pending
+ */
+bool SplitExporter::is_finished() const
+{
+    for (const split_job_t& job : jobs) {
+        if (!job.done) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Check whether all cuts were exported successfully
+ * @return True if all outputs were written
+ */
+bool SplitExporter::is_successful() const
+{
+    for (const split_job_t& job : jobs) {
+        if (!job.done || !job.success) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Get the number of frames written by all workers
+ * @return The sum of the written frames of all cuts
+ */
+size_t SplitExporter::get_position() const
+{
+    size_t position = 0;
+    for (const split_job_t& job : jobs) {
+        position += job.position;
+    }
+    return position;
+}
+
+/**
+ * Get the number of frames of all cuts
+ * @return The sum of the frames of all cuts
+ */
+size_t SplitExporter::get_total() const
+{
+    size_t total = 0;
+    for (const split_job_t& job : jobs) {
+        total += job.total;
+    }
+    return total;
+}
+
+/**
+ * Get the output name of a cut by appending its number to the file name
+ * @param target The output name given by the user, e.g. clip.mkv
+ * @param index The number of the cut, starting at 1
+ * @return The output name of the cut, e.g. clip-001.mkv
+ */
+std::string SplitExporter::get_target_name(const std::string& target, size_t index)
+{
+    char number[32];
+    snprintf(number, sizeof(number), "-%03zu", index);
+    size_t slash = target.rfind('/');
+    size_t dot = target.rfind('.');
+    if (dot == std::string::npos || dot == 0 || (slash != std::string::npos && dot < slash + 2)) {
+        return target + number;
+    }
+    return target.substr(0, dot) + number + target.substr(dot);
+}
@@ -0,0 +1,66 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2026 Minei3oat
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef SPLITEXPORTER_H
+#define SPLITEXPORTER_H
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "exporter.h"
+#include "mediafile.h"
+
+// number of cuts exported concurrently from the same source
+#define MAX_EXPORTS_PER_SOURCE 4
+
+typedef struct split_job {
+    cut_t cut;
+    std::string target;
+    size_t total = 0;
+    std::atomic<size_t> position { 0 };
+    std::atomic<bool> done { false };
+    bool success = false;
+} split_job_t;
+
+/**
+ * Exports each cut into its own output on a bounded pool of worker threads.
+ * Every worker of a source reads through its own clone of the media file, the number of workers per source is limited.
+ */
+class SplitExporter
+{
+public:
+    SplitExporter(const std::vector<cut_t>& cuts, const std::string& target, const std::string& format = "");
+    ~SplitExporter();
+
+    void start();
+    void wait();
+
+    size_t get_count() const { return jobs.size(); }
+    bool is_finished() const;
+    bool is_successful() const;
+    const std::string& get_target(size_t index) const { return jobs[index].target; }
+    size_t get_position() const;
+    size_t get_total() const;
+
+    static std::string get_target_name(const std::string& target, size_t index);
+
+private:
+    void run(MediaFile* source, MediaFile* reader);
+
+    std::string format;
+    std::vector<split_job_t> jobs;
+    std::map<MediaFile*, std::deque<size_t>> queues;
+    std::vector<MediaFile*> readers;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+};
+
+#endif // SPLITEXPORTER_H
@@ -0,0 +1,188 @@
+// SPDX-FileCopyrightText: 2023-2026 Minei3oat
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "statistics.h"
+
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+#include <stdio.h>
+
+static std::mutex registry_mutex;
+static std::map<std::string, Counter*> counters;
+static std::map<std::string, Histogram*> histograms;
+
+/**
+ * Count a value
+ * @param value The value, negative values are counted as 0
+ */
+void Histogram::observe(int64_t value)
+{
+    if (value < 0) {
+        value = 0;
+    }
+    int bucket = value == 0 ? 0 : 64 - __builtin_clzll(value);
+    if (bucket >= STATISTICS_BUCKETS) {
+        bucket = STATISTICS_BUCKETS - 1;
+    }
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(value, std::memory_order_relaxed);
+    int64_t current_max = max.load(std::memory_order_relaxed);
+    while (value > current_max && !max.compare_exchange_weak(current_max, value, std::memory_order_relaxed)) {
+    }
+}
+
+/**
+ * Get an upper bound of a percentile
+ * @param percentile The percentile between 0 and 100
+ * @return The upper end of the bucket containing the percentile, at most the maximum
+ */
+int64_t Histogram::get_percentile(int percentile) const
+{
+    int64_t total = get_count();
+    if (total == 0) {
+        return 0;
+    }
+    int64_t rank = (total * percentile + 99) / 100;
+    int64_t seen = 0;
+    for (int i = 0; i < STATISTICS_BUCKETS; i++) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank && seen > 0) {
+            int64_t upper = i == 0 ? 0 : (i >= 63 ? INT64_MAX : (1LL << i) - 1);
+            return upper < get_max() ? upper : get_max();
+        }
+    }
+    return get_max();
+}
+
+/**
+ * Get a counter, it is created on first use
+ * @param name The name of the counter
+ * @return The counter
+ */
+Counter& Statistics::counter(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    Counter*& counter = counters[name];
+    if (counter == NULL) {
+        counter = new Counter;
+    }
+    return *counter;
+}
+
+/**
+ * Get a histogram, it is created on first use
+ * @param name The name of the histogram
+ * @return The histogram
+ */
+Histogram& Statistics::histogram(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    Histogram*& histogram = histograms[name];
+    if (histogram == NULL) {
+        histogram = new Histogram;
+    }
+    return *histogram;
+}
+
+/**
+ * Count the time spent in a stage, the histograms are cached per thread, so the registry is only locked once per stage and thread
+ * @param name The name of the stage, it must be a static string
+ * @param duration The time spent in microseconds
+ */
+void Statistics::record_stage(const char* name, int64_t duration)
+{
+    static thread_local std::unordered_map<const char*, Histogram*> stages;
+    Histogram*& histogram = stages[name];
+    if (histogram == NULL) {
+        histogram = &Statistics::histogram(std::string("stage.") + name + "_us");
+    }
+    histogram->observe(duration);
+}
+
+/**
+ * Remove all entries whose name starts with a prefix, e.g. the ones of a closed file. References to them must not be kept
+ * @param prefix The prefix of the names
+ */
+void Statistics::remove(const std::string& prefix)
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (auto it = counters.lower_bound(prefix); it != counters.end() && it->first.compare(0, prefix.size(), prefix) == 0;) {
+        delete it->second;
+        it = counters.erase(it);
+    }
+    for (auto it = histograms.lower_bound(prefix); it != histograms.end() && it->first.compare(0, prefix.size(), prefix) == 0;) {
+        delete it->second;
+        it = histograms.erase(it);
+    }
+}
+
+/**
+ * Escape a name for JSON
+ * @param name The name
+ * @return The escaped name
+ */
+static std::string escape(const std::string& name)
+{
+    std::string escaped;
+    for (char c : name) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+        }
+        if ((unsigned char) c >= 0x20) {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+/**
+ * Get all entries as JSON
+ * @return An object with the counters and one with the count, sum, max and percentiles of each histogram
+ */
+std::string Statistics::to_json()
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    std::string json = "{\n  \"counters\": {";
+    char buffer[512];
+    bool first = true;
+    for (const auto& [name, counter] : counters) {
+        snprintf(buffer, sizeof(buffer), "%s\n    \"%s\": %ld", first ? "" : ",", escape(name).c_str(), counter->get());
+        json += buffer;
+        first = false;
+    }
+    json += "\n  },\n  \"histograms\": {";
+    first = true;
+    for (const auto& [name, histogram] : histograms) {
+        snprintf(buffer, sizeof(buffer), "%s\n    \"%s\": { \"count\": %ld, \"sum\": %ld, \"max\": %ld, \"p50\": %ld, \"p95\": %ld, \"p99\": %ld }", first ? "" : ",",
+            escape(name).c_str(), histogram->get_count(), histogram->get_sum(), histogram->get_max(), histogram->get_percentile(50), histogram->get_percentile(95), histogram->get_percentile(99));
+        json += buffer;
+        first = false;
+    }
+    json += "\n  }\n}\n";
+    return json;
+}
+
+/**
+ * Get all entries as text for displaying them, one per line
+ * @return The text
+ */
+std::string Statistics::to_text()
+{
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    std::string text;
+    char buffer[512];
+    for (const auto& [name, counter] : counters) {
+        snprintf(buffer, sizeof(buffer), "%s: %ld\n", name.c_str(), counter->get());
+        text += buffer;
+    }
+    for (const auto& [name, histogram] : histograms) {
+        int64_t count = histogram->get_count();
+        snprintf(buffer, sizeof(buffer), "%s: %ld values, mean %ld, p95 <= %ld, max %ld\n", name.c_str(), count, count ? histogram->get_sum() / count : 0, histogram->get_percentile(95), histogram->get_max());
+        text += buffer;
+    }
+    return text;
+}
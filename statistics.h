@@ -0,0 +1,67 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2026 Minei3oat
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include <atomic>
+#include <string>
+
+#include <stdint.h>
+
+// histograms count values in power of two buckets, the last one takes all larger values
+#define STATISTICS_BUCKETS 48
+
+/**
+ * A value that is counted up or set, e.g. bytes read or the size of an index
+ */
+class Counter
+{
+public:
+    void add(int64_t value = 1) { this->value.fetch_add(value, std::memory_order_relaxed); }
+    void set(int64_t value) { this->value.store(value, std::memory_order_relaxed); }
+    int64_t get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> value { 0 };
+};
+
+/**
+ * Distribution of non-negative values, e.g. decoded frames per request or microseconds per stage
+ */
+class Histogram
+{
+public:
+    void observe(int64_t value);
+    int64_t get_count() const { return count.load(std::memory_order_relaxed); }
+    int64_t get_sum() const { return sum.load(std::memory_order_relaxed); }
+    int64_t get_max() const { return max.load(std::memory_order_relaxed); }
+    int64_t get_percentile(int percentile) const;
+
+private:
+    std::atomic<int64_t> count { 0 };
+    std::atomic<int64_t> sum { 0 };
+    std::atomic<int64_t> max { 0 };
+    std::atomic<int64_t> buckets[STATISTICS_BUCKETS] = { };
+};
+
+/**
+ * Registry of named counters and histograms fed by the media files and the export engine.
+ * Looking up an entry locks the registry, so hot paths keep the returned reference, entries live until they are removed.
+ * Names are dot separated, e.g. "io.bytes_read" or "stage.decode_us".
+ */
+class Statistics
+{
+public:
+    static Counter& counter(const std::string& name);
+    static Histogram& histogram(const std::string& name);
+    static void record_stage(const char* name, int64_t duration);
+    static void remove(const std::string& prefix);
+    static std::string to_json();
+    static std::string to_text();
+};
+
+#endif // STATISTICS_H
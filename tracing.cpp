@@ -0,0 +1,99 @@
+// SPDX-FileCopyrightText: 2023-2026 Minei3oat
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "tracing.h"
+#include "logger.h"
+
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+typedef struct trace_buffer {
+    long thread_id;
+    trace_span_t spans[TRACING_BUFFER_SIZE];
+    std::atomic<uint64_t> count { 0 };
+} trace_buffer_t;
+
+std::atomic<bool> Tracing::enabled { false };
+
+// buffers of all threads that recorded spans, they are kept after their thread ended
+static std::mutex buffers_mutex;
+static std::vector<trace_buffer_t*> buffers;
+static thread_local trace_buffer_t* thread_buffer = NULL;
+static const std::chrono::steady_clock::time_point process_start = std::chrono::steady_clock::now();
+
+/**
+ * Get the current time for spans
+ * @return The microseconds since the start of the process
+ */
+int64_t Tracing::now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - process_start).count();
+}
+
+/**
+ * Record a span in the buffer of the calling thread
+ * @param name The name of the span, it must be a static string
+ * @param start The start of the span from now()
+ * @param end The end of the span from now()
+ */
+void Tracing::record(const char* name, int64_t start, int64_t end)
+{
+    if (thread_buffer == NULL) {
+        thread_buffer = new trace_buffer_t;
+        thread_buffer->thread_id = syscall(SYS_gettid);
+        std::lock_guard<std::mutex> lock(buffers_mutex);
+        buffers.push_back(thread_buffer);
+    }
+
+    // only this thread writes the buffer, readers take the count after the span is complete
+    uint64_t count = thread_buffer->count.load(std::memory_order_relaxed);
+    trace_span_t* span = thread_buffer->spans + count % TRACING_BUFFER_SIZE;
+    span->name = name;
+    span->start = start;
+    span->duration = end - start;
+    thread_buffer->count.store(count + 1, std::memory_order_release);
+}
+
+/**
+ * Write the recorded spans of all threads as Chrome trace JSON.
+ * Spans recorded while dumping may be missing or, if their buffer wraps around, be mixed up with older ones.
+ * @param filename The file to write
+ * @return True on success
+ */
+bool Tracing::dump(const std::string& filename)
+{
+    FILE* file = fopen(filename.c_str(), "w");
+    if (file == NULL) {
+        log_error(LOG_CATEGORY_MEDIAFILE, "failed to write trace to %s: %s", filename.c_str(), strerror(errno));
+        return false;
+    }
+
+    long process_id = getpid();
+    bool first = true;
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    for (const trace_buffer_t* buffer : buffers) {
+        uint64_t count = buffer->count.load(std::memory_order_acquire);
+        uint64_t first_span = count > TRACING_BUFFER_SIZE ? count - TRACING_BUFFER_SIZE : 0;
+        for (uint64_t i = first_span; i < count; i++) {
+            const trace_span_t* span = buffer->spans + i % TRACING_BUFFER_SIZE;
+            fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%ld,\"tid\":%ld,\"ts\":%ld,\"dur\":%ld}", first ? "" : ",\n", span->name, process_id, buffer->thread_id, span->start, span->duration);
+            first = false;
+        }
+    }
+    fprintf(file, "\n]}\n");
+    if (fclose(file) != 0) {
+        log_error(LOG_CATEGORY_MEDIAFILE, "failed to write trace to %s: %s", filename.c_str(), strerror(errno));
+        return false;
+    }
+    log_info(LOG_CATEGORY_MEDIAFILE, "trace written to %s", filename.c_str());
+    return true;
+}
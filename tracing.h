@@ -0,0 +1,70 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2026 Minei3oat
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef TRACING_H
+#define TRACING_H
+
+#include <atomic>
+#include <string>
+
+#include <stdint.h>
+
+#include "statistics.h"
+
+// environment variable naming the file the trace is written to when MCut exits, enables tracing
+#define TRACING_ENV "MCUT_TRACE_FILE"
+// spans kept per thread, older spans are overwritten
+#define TRACING_BUFFER_SIZE 65536
+
+typedef struct trace_span {
+    const char* name;       // static string, e.g. "decode"
+    int64_t start;          // microseconds since the start of the process
+    int64_t duration;       // microseconds
+} trace_span_t;
+
+/**
+ * Collects timed spans of the hot paths (seek, demux, decode, scale, encode, mux and I/O) in a ring buffer per thread.
+ * Recording is off by default, the durations are always counted in the stage histograms of Statistics.
+ * The spans can be written as Chrome trace JSON, which can be opened with chrome://tracing or Perfetto.
+ */
+class Tracing
+{
+public:
+    static void set_enabled(bool enabled) { Tracing::enabled.store(enabled, std::memory_order_relaxed); }
+    static bool is_enabled() { return enabled.load(std::memory_order_relaxed); }
+    static int64_t now();
+    static void record(const char* name, int64_t start, int64_t end);
+    static bool dump(const std::string& filename);
+
+private:
+    static std::atomic<bool> enabled;
+};
+
+/**
+ * Records the time from its construction until its destruction as a span and in the histogram of its stage
+ */
+class TraceSpan
+{
+public:
+    TraceSpan(const char* name) : name(name), start(Tracing::now()) { }
+    ~TraceSpan()
+    {
+        int64_t end = Tracing::now();
+        Statistics::record_stage(name, end - start);
+        if (Tracing::is_enabled()) {
+            Tracing::record(name, start, end);
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* name;
+    int64_t start;
+};
+
+#endif // TRACING_H